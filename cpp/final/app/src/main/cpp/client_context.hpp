@@ -0,0 +1,69 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+#include <jni.h>
+#include <memory>
+#include <optional>
+#include <string>
+
+/**
+ * The HTTP requests a ClientManager makes to the server.
+ */
+class ClientTransport {
+public:
+    virtual ~ClientTransport() = default;
+
+    /**
+     * Performs an HTTP GET request.
+     *
+     * @param url The URL to GET.
+     * @param error An out parameter for an error string, if one occurs.
+     * @return The body of the response on success, or an empty result on failure.
+     */
+    virtual std::optional<std::string> Get(const std::string &url, std::string *error) = 0;
+
+    /**
+     * Performs an HTTP POST request.
+     *
+     * @param url The URL to POST.
+     * @param body The data sent by the POST.
+     * @param error An out parameter for an error string, if one occurs.
+     * @return The body of the response on success, or an empty result on failure.
+     */
+    virtual std::optional<std::string> Post(const std::string &url, const std::string &body,
+                                            std::string *error) = 0;
+};
+
+/*
+ * Everything a ClientManager needs from its surroundings, so it can run
+ * without the engine and several can run in the same process.
+ */
+struct ClientContext {
+    // Java VM and activity Play Integrity is initialized with. Play
+    // Integrity is shared by the whole process, so every client in a
+    // process has to use the same ones.
+    JavaVM *mVm;
+    jobject mActivity;
+    // Directory the client keeps its command journal in, no journal is
+    // kept if empty. Clients running at the same time need their own.
+    std::string mDataPath;
+    std::shared_ptr<ClientTransport> mTransport;
+    // Returns the current time in seconds
+    std::function<float()> mClock;
+};
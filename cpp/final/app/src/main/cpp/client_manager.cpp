@@ -14,243 +14,1375 @@
  * limitations under the License.
  */
 
-#include "http_client.hpp"
+#include "logging.hpp"
 #include "client_manager.hpp"
+#include "constexpr_sha256.hpp"
+#include "encoding.hpp"
+#include "sha256_batch.hpp"
+#include "integrity_backend.hpp"
 #include "json_util.hpp"
-#include "native_engine.hpp"
+#include "nonce_codec.hpp"
 #include "server_urls.hpp"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
 #include <inttypes.h>
-#include <openssl/sha.h>
+#include <openssl/rand.h>
 #include <optional>
 #include <string>
+#include <string_view>
 
 namespace {
     // Key for random number in JSON returned by /getRandom endpoint
     constexpr char RANDOM_KEY[] = "random";
+    // Key for the nonce formats the server accepts, returned by /getRandom
+    // when asked for. Servers that leave it out only accept hex nonces.
+    constexpr char NONCEFORMATS_KEY[] = "nonceFormats";
+    // Lists the nonce formats we can generate, the server answers with
+    // the ones it accepts
+    constexpr char GET_RANDOM_NONCE_FORMATS_QUERY[] = "?nonceFormats=hex,base64url";
+    // Keys for the session values returned by /startNonceSession
+    constexpr char SESSIONID_KEY[] = "sessionId";
+    constexpr char SESSIONSECRET_KEY[] = "sessionSecret";
+    constexpr char TIMESTAMP_KEY[] = "timestamp";
+    constexpr char LIFETIME_KEY[] = "lifetime";
     // Keys for values returned in JSON returned by /performCommand endpoint
     constexpr char COMMANDSUCCESS_KEY[] = "commandSuccess";
     constexpr char DIAGNOSTICMESSAGE_KEY[] = "diagnosticMessage";
     constexpr char EXPRESSTOKEN_KEY[] = "expressToken";
-    // Constants to construct the command JSON payload for the POST to the
-    // /performCommand endpoint
-    constexpr char COMMAND_JSON_PREFIX[] = "{ \"commandString\" : \"";
-    constexpr char COMMAND_JSON_TOKEN[] = "\", \"tokenString\" : \"";
-    constexpr char COMMAND_JSON_SUFFIX[] = "\" }";
+    constexpr char NEXTRANDOM_KEY[] = "nextRandom";
+    constexpr char ADDITIONALEXPRESSTOKENS_KEY[] = "additionalExpressTokens";
+    // Key for the per-command results returned by /performCommandBatch
+    constexpr char COMMANDRESULTS_KEY[] = "commandResults";
+    // Keys of the command JSON payload for the POST to the /performCommand
+    // endpoint
+    constexpr char COMMANDSTRING_KEY[] = "commandString";
+    constexpr char TOKENSTRING_KEY[] = "tokenString";
+    // Number of express tokens we would like issued with the command result
+    constexpr char EXPRESSTOKENCOUNT_KEY[] = "expressTokenCount";
+    // Identify the nonce session, counter and time a client-made random
+    // came from, only sent for commands whose nonce has one
+    constexpr char NONCECOUNTER_KEY[] = "nonceCounter";
+    constexpr char NONCETIME_KEY[] = "nonceTime";
+    // Asks the server to return the random for our next integrity command
+    // with the command result. Only set while the random pool has room, the
+    // server keeps every random it issues until it is used or expires.
+    constexpr char REQUESTNEXTRANDOM_KEY[] = "requestNextRandom";
+    // Key of the command list in the JSON payload for the POST to the
+    // /performCommandBatch endpoint, which takes the place of commandString,
+    // the rest of the payload matches /performCommand
+    constexpr char COMMANDSTRINGS_KEY[] = "commandStrings";
+    // Id the server performs a command once by, and the ids of the commands
+    // in a batch, in the order of commandStrings
+    constexpr char REQUESTID_KEY[] = "requestId";
+    constexpr char REQUESTIDS_KEY[] = "requestIds";
+    // Most commands sent in one batch, a full batch is sent without
+    // waiting for the batch window to close
+    constexpr size_t MAX_BATCH_COMMANDS = 8;
+    // Journal of commands that failed to reach the server, kept in the
+    // app's internal storage
+    constexpr char JOURNAL_FILENAME[] = "command_journal.bin";
+    constexpr size_t JOURNAL_CAPACITY = 64 * 1024;
+    // Journaled commands are replayed a few at a time, with a pause in
+    // between, so a backlog doesn't flood the server on reconnect
+    constexpr size_t JOURNAL_REPLAY_BATCH_SIZE = 4;
+    constexpr float JOURNAL_REPLAY_INTERVAL = 5.0f;
+    // Default time (in seconds) outstanding commands get to finish when
+    // the app is paused or they are cancelled
+    constexpr float DEFAULT_CANCELLATION_GRACE_PERIOD = 2.0f;
+    // Number of finished command results kept for GetRecentResults
+    constexpr size_t RECENT_RESULT_CAPACITY = 16;
     // Test 'command'
     constexpr char TEST_COMMAND[] = "TRANSFER FROM alice TO bob CURRENCY gems QUANTITY 1000";
-    // Hex conversion table
-    constexpr char HEX_TABLE[] = "0123456789abcdef";
+    // Commands known at compile time, with their hex SHA-256 hashes worked
+    // out by the compiler
+    struct KnownCommandHash {
+        std::string_view mCommand;
+        Sha256HexDigest mHashHex;
+    };
+    constexpr KnownCommandHash KNOWN_COMMAND_HASHES[] = {
+            {TEST_COMMAND, ConstexprSha256::HashHex(TEST_COMMAND)}
+    };
+    // OpenSSL's hash of TEST_COMMAND
+    static_assert(ConstexprSha256::HexEquals(
+            KNOWN_COMMAND_HASHES[0].mHashHex,
+            "f0eaa5f2126002e02720c36e45644d103980a1959474e3466b935d4b3ad84623"));
+    // Number of server randoms to keep fetched ahead of time
+    constexpr size_t RANDOM_POOL_CAPACITY = 2;
+    // Age (in seconds) at which a pooled random is discarded. The server
+    // rejects randoms older than five minutes (NONCE_TIMEOUT), keep a
+    // minute of headroom for token generation and the command round trip
+    constexpr float RANDOM_POOL_MAX_AGE = 4.0f * 60.0f;
+    // Minimum time (in seconds) between random pool fetches, so refilling
+    // never costs more than one round trip per interval and an unreachable
+    // server isn't polled every frame
+    constexpr float RANDOM_POOL_FETCH_INTERVAL = 1.0f;
+    // Minimum time (in seconds) between nonce session fetches, so a server
+    // without nonce sessions isn't asked over and over
+    constexpr float NONCE_SESSION_FETCH_INTERVAL = 30.0f;
+    // Number of express tokens to keep on hand, so several express
+    // commands can be sent without waiting on each other's responses
+    constexpr size_t EXPRESS_TOKEN_POOL_CAPACITY = 4;
+    // Age (in seconds) at which an express token is discarded. The server
+    // expires them after eight hours (EXPRESS_TOKEN_TIMEOUT)
+    constexpr float EXPRESS_TOKEN_MAX_AGE = 7.5f * 60.0f * 60.0f;
+    // Default limits for speculative integrity token requests: keep one
+    // token ready, let at most two go unused every ten minutes, and drop
+    // a completed token after two minutes so the verdict stays fresh
+    constexpr SpeculativeTokenCache::Config DEFAULT_SPECULATION_CONFIG = {
+            1,
+            2,
+            10.0f * 60.0f,
+            2.0f * 60.0f
+    };
+    // Default path policy limits, per sensitivity class (low, normal, high).
+    // Low sensitivity commands accept any pooled express token as long as
+    // the verdict is under an hour old, normal ones want both to be recent,
+    // and high sensitivity commands always get a fresh integrity check.
+    constexpr CommandPathPolicy::Config DEFAULT_PATH_POLICY_CONFIG = {
+            {EXPRESS_TOKEN_MAX_AGE, 30.0f * 60.0f, -1.0f},
+            {60.0f * 60.0f, 10.0f * 60.0f, -1.0f},
+            0.2f
+    };
+    // Command pipeline stage limits. Randoms are fetched and commands sent
+    // with blocking HTTP calls, so those stages take one command per
+    // update. Token requests complete asynchronously and can overlap.
+    constexpr size_t PIPELINE_UNLIMITED = SIZE_MAX;
+    constexpr size_t PIPELINE_RANDOM_STAGE_LIMIT = 1;
+    constexpr size_t PIPELINE_TOKEN_STAGE_LIMIT = 2;
+    constexpr size_t PIPELINE_SEND_STAGE_LIMIT = 1;
+    // Rate limiter masks for a Play Integrity token request and a command POST
+    constexpr uint32_t INTEGRITY_TOKEN_ENDPOINT =
+            RateLimiter::EndpointBit(RateLimiter::RATE_LIMIT_ENDPOINT_INTEGRITY_TOKEN);
+    constexpr uint32_t SERVER_COMMAND_ENDPOINT =
+            RateLimiter::EndpointBit(RateLimiter::RATE_LIMIT_ENDPOINT_SERVER_COMMAND);
+    // Default rate limits. Play Integrity token requests count against the
+    // app's daily quota, so they are limited the hardest. The command
+    // classes are limited in calls started, whichever endpoints they use.
+    constexpr RateLimiter::Config DEFAULT_RATE_LIMITER_CONFIG = {
+            {{0.5f, 5.0f}, {4.0f, 10.0f}},
+            {{2.0f, 6.0f}, {2.0f, 8.0f}, {0.5f, 4.0f}}
+    };
+    // Default wake windows. Cellular radios typically stay in their high
+    // power state for several seconds after a transfer.
+    constexpr NetworkScheduler::Config DEFAULT_NETWORK_SCHEDULER_CONFIG = {30.0f, 5.0f};
+    // Default scheduling of the interactive, normal and background classes.
+    // Interactive commands get four dispatches for every one background
+    // dispatch when both are queued, background commands send one at a
+    // time, and no class waits more than its limit for a turn.
+    constexpr CommandSchedulerConfig DEFAULT_SCHEDULER_CONFIG = {
+            {4.0f, 2.0f, 1.0f},
+            {2, 2, 1},
+            {1.0f, 5.0f, 30.0f},
+            // Interactive and normal commands are game actions that
+            // shouldn't vanish quietly, so the caller is told instead. Old
+            // background commands are the least valuable ones to keep.
+            {8, 16, 16},
+            {COMMAND_QUEUE_POLICY_REJECT, COMMAND_QUEUE_POLICY_REJECT,
+             COMMAND_QUEUE_POLICY_DROP_OLDEST},
+            0.75f
+    };
+
+    bool IsValidRandom(std::string_view random) {
+        return random.size() == RANDOM_LENGTH && Encoding::IsHex(random);
+    }
+
+    // Express tokens are opaque to us, but always base64url (hex included)
+    bool IsValidExpressToken(std::string_view expressToken) {
+        return !expressToken.empty() && expressToken.size() <= EXPRESS_TOKEN_MAX_LENGTH &&
+                Encoding::IsBase64Url(expressToken);
+    }
+
+    // Integrity tokens are compact JWE, base64url segments separated by dots
+    bool IsValidIntegrityToken(std::string_view token) {
+        if (token.empty()) {
+            return false;
+        }
+        size_t segmentStart = 0;
+        while (true) {
+            const size_t segmentEnd = token.find('.', segmentStart);
+            if (!Encoding::IsBase64Url(token.substr(segmentStart, segmentEnd - segmentStart))) {
+                return false;
+            }
+            if (segmentEnd == std::string_view::npos) {
+                return true;
+            }
+            segmentStart = segmentEnd + 1;
+        }
+    }
+
+    // Request ids from every client share one namespace on the server, so
+    // they come from OpenSSL's generator. Without one the command is sent
+    // with no id, and the server doesn't de-duplicate it.
+    RequestIdString GenerateRequestId() {
+        uint8_t bytes[REQUEST_ID_SIZE];
+        if (RAND_bytes(bytes, sizeof(bytes)) != 1) {
+            ALOGE("Failed to generate a command request id");
+            return RequestIdString();
+        }
+        char hex[REQUEST_ID_LENGTH];
+        Encoding::HexEncode(bytes, sizeof(bytes), hex);
+        return RequestIdString(std::string_view(hex, sizeof(hex)));
+    }
+
+    // The command made it into the outbound queue, or the open batch
+    bool IsEnqueued(CommandQueueResult result) {
+        return result != COMMAND_QUEUE_DROPPED && result != COMMAND_QUEUE_REJECTED &&
+               result != COMMAND_QUEUE_RATE_LIMITED;
+    }
 }
 
-ClientManager::ClientManager() {
+ClientManager::ClientManager(const ClientContext &context)
+        : mContext(context),
+          mScheduler(DEFAULT_SCHEDULER_CONFIG),
+          mPipeline(context.mClock),
+          mRateLimiter(DEFAULT_RATE_LIMITER_CONFIG),
+          mNetworkScheduler(DEFAULT_NETWORK_SCHEDULER_CONFIG, context.mClock),
+          mRandomPool(RANDOM_POOL_CAPACITY, RANDOM_POOL_MAX_AGE),
+          mExpressTokenPool(EXPRESS_TOKEN_POOL_CAPACITY, EXPRESS_TOKEN_MAX_AGE),
+          mSpeculativeTokens(DEFAULT_SPECULATION_CONFIG),
+          mPathPolicy(DEFAULT_PATH_POLICY_CONFIG) {
     mResult = SERVER_OPERATION_NONE;
-    mStatus = CLIENT_MANAGER_IDLE;
-    mCurrentExpressToken = "";
-    mCurrentNonce = "";
-    mCurrentRandom = "";
+    mRetryAfter = 0.0f;
+    mNextCommandId = 1;
+    mBatchWindow = 0.0f;
+    mBatchOpenTime = 0.0f;
+    mServerReachable = true;
+    mLastJournalReplay = -JOURNAL_REPLAY_INTERVAL;
+    mCancellationGracePeriod = DEFAULT_CANCELLATION_GRACE_PERIOD;
+    mCancelBeforeId = 0;
+    mSuspended = false;
+    mLifecycleStats = {};
+    mCoalesceCommands = true;
+    mCoalescedCommandCount = 0;
+    mPreferredNonceFormat = NonceCodec::NONCE_FORMAT_COMPACT;
+    mServerNonceFormats = 1u << NonceCodec::NONCE_FORMAT_HEX;
+    mUseNonceSession = false;
+    mLastNonceSessionFetch = -NONCE_SESSION_FETCH_INTERVAL;
+    mLastRandomPoolFetch = -RANDOM_POOL_FETCH_INTERVAL;
+    // The demo only ever sends the test command, so it is always worth
+    // having a token ready for it
+    mPredictedCommands.push_back(TEST_COMMAND);
+    mCurrentExpressToken.Clear();
+    mCurrentNonce.Clear();
+    mCurrentRandom.Clear();
     mCurrentSummary = "";
-    mValidExpressToken = false;
     mValidRandom = false;
-    mTokenRequest = nullptr;
-    mTokenResponse = nullptr;
+    SetupPipeline();
 
-    const android_app *app = NativeEngine::GetInstance()->GetAndroidApp();
-    const IntegrityErrorCode errorCode = IntegrityManager_init(app->activity->vm,
-                                                               app->activity->javaGameActivity);
-    if (errorCode == INTEGRITY_NO_ERROR) {
-        mInitialized = true;
-    } else {
-        mInitialized = false;
-        ALOGE("Play Integrity returned error: %d", errorCode);
+    if (!mContext.mDataPath.empty()) {
+        mJournal.Open(mContext.mDataPath + "/" + JOURNAL_FILENAME, JOURNAL_CAPACITY);
     }
 
+    mInitialized = IntegrityBackend::Acquire(mContext.mVm, mContext.mActivity);
 }
 
 ClientManager::~ClientManager() {
+    // Outstanding token requests have to be released before Play Integrity is shut down
+    mOpenBatch.reset();
+    mScheduler.Clear();
+    mPipeline.Clear();
+    mSpeculativeTokens.Clear(CurrentTime());
     if (mInitialized) {
-        IntegrityManager_destroy();
+        IntegrityBackend::Release();
         mInitialized = false;
     }
 }
 
+ClientManager::PendingCommand::PendingCommand() {
+    mId = 0;
+    mPriority = COMMAND_PRIORITY_NORMAL;
+    mPath = CommandPathPolicy::COMMAND_PATH_INTEGRITY;
+    mRequestCount = 1;
+    mExpressTokenIssueTime = 0.0f;
+    mNonceCounter = 0;
+    mNonceTime = 0;
+    mTokenRequest = nullptr;
+    mTokenResponse = nullptr;
+    mTokenExpireTime = 0.0f;
+    mSendTime = 0.0f;
+    // Commands that fail before reaching the server leave no result behind
+    mResult = SERVER_OPERATION_NONE;
+    mTiming = {};
+}
+
+ClientManager::PendingCommand::~PendingCommand() {
+    CleanupRequest();
+}
+
+void ClientManager::PendingCommand::CleanupRequest() {
+    if (mTokenResponse != nullptr) {
+        IntegrityTokenResponse_destroy(mTokenResponse);
+        mTokenResponse = nullptr;
+    }
+    if (mTokenRequest != nullptr) {
+        IntegrityTokenRequest_destroy(mTokenRequest);
+        mTokenRequest = nullptr;
+    }
+}
+
+void ClientManager::SetupPipeline() {
+    // The integrity flow is random fetch, nonce, token, send and parse.
+    // Commands that already have a token (express commands, or integrity
+    // commands with a speculative token) pass through the earlier stages
+    // without doing anything.
+    mPipeline.AddStage("random", PIPELINE_RANDOM_STAGE_LIMIT,
+                       [this](PendingCommand &command, float currentTime) {
+                           return RandomStage(command, currentTime);
+                       });
+    mPipeline.AddStage("nonce", PIPELINE_UNLIMITED,
+                       [this](PendingCommand &command, float currentTime) {
+                           return NonceStage(command, currentTime);
+                       });
+    mPipeline.AddStage("token", PIPELINE_TOKEN_STAGE_LIMIT,
+                       [this](PendingCommand &command, float currentTime) {
+                           return TokenStage(command, currentTime);
+                       });
+    mPipeline.AddStage("send", PIPELINE_SEND_STAGE_LIMIT,
+                       [this](PendingCommand &command, float currentTime) {
+                           return SendStage(command, currentTime);
+                       });
+    mPipeline.AddStage("parse", PIPELINE_UNLIMITED,
+                       [this](PendingCommand &command, float currentTime) {
+                           return ParseStage(command, currentTime);
+                       });
+    mPipeline.SetCompletionHandler([this](std::unique_ptr<PendingCommand> command) {
+        CompleteCommand(std::move(command));
+    });
+}
+
 void ClientManager::RequestRandom() {
     // Reset internal state
     mValidRandom = false;
-    mCurrentRandom = "";
+    mCurrentRandom.Clear();
+
+    ServerOperationResult errorResult = SERVER_OPERATION_NONE;
+    auto random = FetchRandom(&errorResult);
+    if (random) {
+        mCurrentRandom = *random;
+        mValidRandom = true;
+    } else {
+        mResult = errorResult;
+    }
+}
 
+std::optional<RandomString> ClientManager::FetchRandom(ServerOperationResult *errorResult) {
     // HTTP GET request to the server for a random number
 	// Note that for simplicity, we are doing HTTP operations as
 	// synchronous blocking instead of managing them from a
 	// separate network thread
-    HTTPClient client;
     std::string errorString;
-    auto result = client.Get(GET_RANDOM_URL, &errorString);
+    auto result = mContext.mTransport->Get(
+            std::string(GET_RANDOM_URL) + GET_RANDOM_NONCE_FORMATS_QUERY, &errorString);
+    mNetworkScheduler.RecordActivity();
 
     if (!result) {
         ALOGE("Curl Error: %s", errorString.c_str());
-        mResult = SERVER_OPERATION_NETWORK_ERROR;
-    } else {
-        ALOGI("RequestRandom Result: %s", (*result).c_str());
-        JsonLookup jsonLookup;
-        if (jsonLookup.ParseJson(*result)) {
-            // Check for a success value of true
-            auto resultValue = jsonLookup.GetStringValueForKey(RANDOM_KEY);
-            if (resultValue) {
-                mCurrentRandom = *resultValue;
-                mValidRandom = true;
+        mServerReachable = false;
+        if (errorResult != nullptr) {
+            *errorResult = SERVER_OPERATION_NETWORK_ERROR;
+        }
+        return std::nullopt;
+    }
+
+    ALOGI("RequestRandom Result: %s", (*result).c_str());
+    mServerReachable = true;
+    JsonLookup jsonLookup;
+    if (jsonLookup.ParseJson(*result)) {
+        auto resultValue = jsonLookup.GetStringViewForKey(RANDOM_KEY);
+        if (resultValue && IsValidRandom(*resultValue)) {
+            mServerNonceFormats = 1u << NonceCodec::NONCE_FORMAT_HEX;
+            auto nonceFormats = jsonLookup.GetStringArrayForKey(NONCEFORMATS_KEY);
+            if (nonceFormats) {
+                for (const std::string &formatName : *nonceFormats) {
+                    auto format = NonceCodec::GetFormatForName(formatName);
+                    if (format) {
+                        mServerNonceFormats |= 1u << *format;
+                    }
+                }
             }
+            return RandomString(*resultValue);
+        }
+    }
+
+    ALOGE("getRandom returned invalid json object");
+    if (errorResult != nullptr) {
+        *errorResult = SERVER_OPERATION_INVALID_RANDOM;
+    }
+    return std::nullopt;
+}
+
+void ClientManager::RefillRandomPool() {
+    const float currentTime = CurrentTime();
+    mRandomPool.DiscardExpired(currentTime);
+    if (!mRandomPool.NeedsRefill() ||
+            (currentTime - mLastRandomPoolFetch) < RANDOM_POOL_FETCH_INTERVAL) {
+        return;
+    }
+    if (!mNetworkScheduler.CanSendDeferrable()) {
+        mNetworkScheduler.RecordDeferred();
+        return;
+    }
+    // Stamp the random with the time the request was sent, the server
+    // timestamps it no earlier than that
+    mLastRandomPoolFetch = currentTime;
+    mNetworkScheduler.RecordDeferrableSend();
+    auto random = FetchRandom(nullptr);
+    if (random) {
+        mRandomPool.AddToken(*random, currentTime);
+    }
+}
+
+void ClientManager::RenewNonceSession() {
+    const float currentTime = CurrentTime();
+    if (!mUseNonceSession || !mNonceSession.NeedsRenewal(currentTime) ||
+            (currentTime - mLastNonceSessionFetch) < NONCE_SESSION_FETCH_INTERVAL) {
+        return;
+    }
+    if (!mNetworkScheduler.CanSendDeferrable()) {
+        mNetworkScheduler.RecordDeferred();
+        return;
+    }
+    mLastNonceSessionFetch = currentTime;
+    mNetworkScheduler.RecordDeferrableSend();
+    std::string errorString;
+    auto result = mContext.mTransport->Get(START_NONCE_SESSION_URL, &errorString);
+    mNetworkScheduler.RecordActivity();
+    if (!result) {
+        ALOGE("Curl Error: %s", errorString.c_str());
+        mServerReachable = false;
+        return;
+    }
+
+    mServerReachable = true;
+    JsonLookup jsonLookup;
+    if (jsonLookup.ParseJson(*result)) {
+        auto sessionId = jsonLookup.GetStringValueForKey(SESSIONID_KEY);
+        auto sessionSecret = jsonLookup.GetStringValueForKey(SESSIONSECRET_KEY);
+        auto timestamp = jsonLookup.GetStringValueForKey(TIMESTAMP_KEY);
+        auto lifetime = jsonLookup.GetStringValueForKey(LIFETIME_KEY);
+        // The lifetime is in milliseconds, and counts from when the server
+        // issued the session, which is no earlier than when we asked
+        if (sessionId && sessionSecret && timestamp && lifetime &&
+                mNonceSession.Start(*sessionId, *sessionSecret,
+                                    strtoll(timestamp->c_str(), nullptr, 10),
+                                    strtoll(lifetime->c_str(), nullptr, 10) / 1000.0f,
+                                    currentTime)) {
+            ALOGI("Started nonce session %s", sessionId->c_str());
+            return;
+        }
+    }
+    ALOGE("startNonceSession returned invalid json object");
+}
+
+CommandQueueResult ClientManager::StartCommandIntegrity() {
+    // The test command is sent when the user presses a button
+    return StartCommandIntegrity(TEST_COMMAND, COMMAND_PRIORITY_INTERACTIVE);
+}
+
+CommandQueueResult ClientManager::StartCommandIntegrity(const std::string &command,
+                                                        CommandPriority priority) {
+    if (mCoalesceCommands && CoalesceCommand(command)) {
+        return COMMAND_QUEUE_ACCEPTED;
+    }
+    // A command joining an open batch shares its token request and POST,
+    // and a single command with a speculative token ready makes no token
+    // request of its own
+    const bool joinsBatch = mBatchWindow > 0.0f && mOpenBatch;
+    const bool hasSpeculativeToken = mBatchWindow <= 0.0f &&
+            mSpeculativeTokens.HasReadyToken(command, CurrentTime());
+    uint32_t endpoints = 0;
+    if (!joinsBatch) {
+        endpoints = SERVER_COMMAND_ENDPOINT;
+        if (!hasSpeculativeToken) {
+            endpoints |= INTEGRITY_TOKEN_ENDPOINT;
+        }
+    }
+    if (!CheckRateLimit(priority, endpoints)) {
+        return COMMAND_QUEUE_RATE_LIMITED;
+    }
+    CommandQueueResult queueResult;
+    if (mBatchWindow > 0.0f) {
+        queueResult = AddToBatch(command, priority);
+    } else {
+        auto pendingCommand = std::make_unique<PendingCommand>();
+        pendingCommand->mPriority = priority;
+        pendingCommand->mCommand = command;
+        pendingCommand->mRequestId = GenerateRequestId();
+        pendingCommand->mPath = CommandPathPolicy::COMMAND_PATH_INTEGRITY;
+        queueResult = SubmitCommand(std::move(pendingCommand));
+    }
+    // The token request is paid for by the token stage, if the command
+    // doesn't get a speculative token instead
+    if (IsEnqueued(queueResult)) {
+        mRateLimiter.Take(priority, joinsBatch ? 0 : SERVER_COMMAND_ENDPOINT, CurrentTime());
+    }
+    return queueResult;
+}
+
+CommandQueueResult ClientManager::StartCommandExpress() {
+    return StartCommandExpress(TEST_COMMAND, COMMAND_PRIORITY_INTERACTIVE);
+}
+
+CommandQueueResult ClientManager::StartCommandExpress(const std::string &command,
+                                                      CommandPriority priority) {
+    // Express tokens come from a pool, so an express command doesn't need
+    // to wait for an in-flight integrity request or a previous response
+    const float currentTime = CurrentTime();
+    mExpressTokenPool.DiscardExpired(currentTime);
+    if (mExpressTokenPool.GetCount() > 0 && !CheckRateLimit(priority, SERVER_COMMAND_ENDPOINT)) {
+        return COMMAND_QUEUE_RATE_LIMITED;
+    }
+    auto expressToken = mExpressTokenPool.TakeToken(currentTime);
+    if (expressToken) {
+        auto pendingCommand = std::make_unique<PendingCommand>();
+        pendingCommand->mPriority = priority;
+        pendingCommand->mCommand = command;
+        pendingCommand->mRequestId = GenerateRequestId();
+        pendingCommand->mPath = CommandPathPolicy::COMMAND_PATH_EXPRESS;
+        pendingCommand->mExpressToken = expressToken->mToken;
+        pendingCommand->mExpressTokenIssueTime = expressToken->mIssueTime;
+        const CommandQueueResult queueResult = SubmitCommand(std::move(pendingCommand));
+        if (IsEnqueued(queueResult)) {
+            mRateLimiter.Take(priority, SERVER_COMMAND_ENDPOINT, currentTime);
         }
+        return queueResult;
+    }
+    return COMMAND_QUEUE_REJECTED;
+}
+
+CommandQueueResult ClientManager::StartCommand(
+        CommandPathPolicy::CommandSensitivity sensitivity) {
+    return StartCommand(TEST_COMMAND, sensitivity, COMMAND_PRIORITY_INTERACTIVE);
+}
+
+CommandQueueResult ClientManager::StartCommand(const std::string &command,
+                                               CommandPathPolicy::CommandSensitivity sensitivity,
+                                               CommandPriority priority) {
+    const float currentTime = CurrentTime();
+    mExpressTokenPool.DiscardExpired(currentTime);
+    std::optional<float> expressTokenAge;
+    auto expressIssueTime = mExpressTokenPool.GetOldestIssueTime();
+    if (expressIssueTime) {
+        expressTokenAge = currentTime - *expressIssueTime;
+    }
+    std::optional<float> verdictAge;
+    if (mLastVerdictTime) {
+        verdictAge = currentTime - *mLastVerdictTime;
+    }
+    const bool integrityTokenReady = mSpeculativeTokens.HasReadyToken(command, currentTime);
+
+    const CommandPathPolicy::CommandPath path = mPathPolicy.SelectPath(
+            sensitivity, expressTokenAge, verdictAge, integrityTokenReady);
+    if (path == CommandPathPolicy::COMMAND_PATH_EXPRESS) {
+        return StartCommandExpress(command, priority);
+    }
+    return StartCommandIntegrity(command, priority);
+}
+
+bool ClientManager::CheckRateLimit(CommandPriority priority, uint32_t endpoints) {
+    // Never waits, a refused caller is told when to try again
+    return mRateLimiter.CanAcquire(priority, endpoints, CurrentTime(), &mRetryAfter);
+}
 
-        if (!mValidRandom) {
-            ALOGE("getRandom returned invalid json object");
-            mResult = SERVER_OPERATION_INVALID_RANDOM;
+CommandQueueResult ClientManager::SubmitCommand(std::unique_ptr<PendingCommand> command) {
+    command->mId = mNextCommandId++;
+    const CommandQueueResult queueResult =
+            mScheduler.Enqueue(command->mPriority, command, CurrentTime());
+    // Whatever the scheduler handed back never gets sent
+    if (command) {
+        ALOGE("Outbound queue full, dropping command %" PRIu64, command->mId);
+        command->mResult = SERVER_OPERATION_DROPPED;
+        // A dropped replay stays in the journal for a later attempt
+        for (uint64_t journalId : command->mJournalIds) {
+            mJournal.ReturnEntry(journalId);
         }
+        RecordResults(*command);
+    }
+    if (queueResult == COMMAND_QUEUE_DROPPED || queueResult == COMMAND_QUEUE_REJECTED) {
+        mResult = SERVER_OPERATION_DROPPED;
+        return queueResult;
+    }
+
+    mResult = SERVER_OPERATION_PENDING;
+    DispatchCommands();
+    // Run the stages that don't have to wait right away, so express
+    // commands and commands with a ready token are sent immediately
+    mPipeline.Pump();
+    return queueResult;
+}
+
+void ClientManager::DispatchCommands() {
+    if (mSuspended) {
+        return;
+    }
+    const float currentTime = CurrentTime();
+    // Background commands go out with other traffic, or in a wake window,
+    // SendStage records them as deferrable sends
+    const bool holdBackground = mScheduler.GetQueuedCount(COMMAND_PRIORITY_BACKGROUND) > 0 &&
+            !mNetworkScheduler.CanSendDeferrable();
+    if (holdBackground) {
+        mNetworkScheduler.RecordDeferred();
+    }
+    mScheduler.SetHeld(COMMAND_PRIORITY_BACKGROUND, holdBackground);
+    CommandPriority priority = COMMAND_PRIORITY_NORMAL;
+    while (auto command = mScheduler.Dispatch(currentTime, &priority)) {
+        mPipeline.Submit(std::move(command));
     }
 }
 
-void ClientManager::StartCommandIntegrity() {
-    // Only one request can be in-flight at a time
-    if (mStatus != CLIENT_MANAGER_REQUEST_TOKEN) {
+bool ClientManager::CoalesceCommand(const std::string &command) {
+    // Attach to a matching command waiting in the open batch, or to a
+    // matching single integrity command anywhere in the pipeline. The
+    // caller then sees that command's result, without another random,
+    // token or POST being spent on it.
+    if (mOpenBatch) {
+        std::vector<std::string> &batchCommands = mOpenBatch->mBatchCommands;
+        auto iter = std::find(batchCommands.begin(), batchCommands.end(), command);
+        if (iter != batchCommands.end()) {
+            ++mOpenBatch->mBatchRequestCounts[iter - batchCommands.begin()];
+            ++mCoalescedCommandCount;
+            return true;
+        }
+    }
+    auto matchesCommand = [&command](const PendingCommand &pending) {
+        return !pending.IsBatch() && pending.mPath == CommandPathPolicy::COMMAND_PATH_INTEGRITY &&
+                pending.mCommand == command;
+    };
+    PendingCommand *inFlight = mScheduler.FindItem(matchesCommand);
+    if (inFlight == nullptr) {
+        inFlight = mPipeline.FindItem(matchesCommand);
+    }
+    if (inFlight != nullptr) {
+        ++inFlight->mRequestCount;
+        ++mCoalescedCommandCount;
         mResult = SERVER_OPERATION_PENDING;
-        // Request a fresh random
-        RequestRandom();
-        if (mValidRandom) {
-            GenerateNonce();
-            IntegrityTokenRequest_create(&mTokenRequest);
-            IntegrityTokenRequest_setNonce(mTokenRequest, mCurrentNonce.c_str());
-
-            const IntegrityErrorCode errorCode =
-                    IntegrityManager_requestIntegrityToken(mTokenRequest, &mTokenResponse);
-            if (errorCode != INTEGRITY_NO_ERROR) {
-                ALOGE("Play Integrity returned error: %d", errorCode);
-                CleanupRequest();
-                mStatus = CLIENT_MANAGER_IDLE;
+        return true;
+    }
+    return false;
+}
+
+CommandQueueResult ClientManager::AddToBatch(const std::string &command,
+                                             CommandPriority priority) {
+    if (!mOpenBatch) {
+        mOpenBatch = std::make_unique<PendingCommand>();
+        mOpenBatch->mPriority = priority;
+        mOpenBatch->mPath = CommandPathPolicy::COMMAND_PATH_INTEGRITY;
+        mBatchOpenTime = CurrentTime();
+    }
+    // The batch is scheduled as its most urgent command
+    mOpenBatch->mPriority = Min(mOpenBatch->mPriority, priority);
+    mOpenBatch->mBatchCommands.push_back(command);
+    mOpenBatch->mBatchRequestIds.push_back(GenerateRequestId());
+    mOpenBatch->mBatchRequestCounts.push_back(1);
+    mResult = SERVER_OPERATION_PENDING;
+    if (mOpenBatch->mBatchCommands.size() >= MAX_BATCH_COMMANDS) {
+        return FlushBatch();
+    }
+    return COMMAND_QUEUE_ACCEPTED;
+}
+
+CommandQueueResult ClientManager::FlushBatch() {
+    UnbatchSingleCommand(*mOpenBatch);
+    return SubmitCommand(std::move(mOpenBatch));
+}
+
+void ClientManager::UnbatchSingleCommand(PendingCommand &command) {
+    if (command.mBatchCommands.size() == 1) {
+        // A lone command goes out as a regular command, which can use
+        // a speculative token
+        command.mCommand = std::move(command.mBatchCommands.front());
+        command.mRequestId = command.mBatchRequestIds.front();
+        command.mRequestCount = command.mBatchRequestCounts.front();
+        command.mBatchCommands.clear();
+        command.mBatchRequestIds.clear();
+        command.mBatchRequestCounts.clear();
+    }
+}
+
+void ClientManager::UpdateJournal(PendingCommand &command) {
+    const bool networkError = command.mResult == SERVER_OPERATION_NETWORK_ERROR;
+    if (!command.mJournalIds.empty()) {
+        // A replay that failed the same way stays journaled, anything
+        // else means the server has dealt with it, or never will
+        for (uint64_t journalId : command.mJournalIds) {
+            if (networkError) {
+                mJournal.ReturnEntry(journalId);
             } else {
-                mStatus = CLIENT_MANAGER_REQUEST_TOKEN;
+                mJournal.MarkDone(journalId);
             }
         }
+        return;
+    }
+    if (!networkError) {
+        return;
+    }
+
+    // The command may have reached the server even though its response
+    // didn't reach us, the request id keeps a replay from performing it twice
+    if (command.IsBatch()) {
+        for (size_t i = 0; i < command.mBatchCommands.size(); ++i) {
+            mJournal.Append(command.mBatchCommands[i], command.mBatchRequestIds[i].ToString(),
+                            "", 0);
+        }
+    } else if (command.mPath == CommandPathPolicy::COMMAND_PATH_EXPRESS) {
+        // The journal outlives the process, so it keeps wall clock time
+        const int64_t expressTokenIssueTime = static_cast<int64_t>(time(nullptr)) -
+                static_cast<int64_t>(CurrentTime() - command.mExpressTokenIssueTime);
+        mJournal.Append(command.mCommand, command.mRequestId.ToString(),
+                        command.mExpressToken.ToString(), expressTokenIssueTime);
+    } else {
+        mJournal.Append(command.mCommand, command.mRequestId.ToString(), "", 0);
     }
 }
 
-void ClientManager::StartCommandExpress() {
-    // Only one request can be in-flight at a time
-    if (mStatus != CLIENT_MANAGER_REQUEST_TOKEN) {
-        if (mValidExpressToken) {
-            SendCommandToServer(mCurrentExpressToken);
-            mStatus = CLIENT_MANAGER_RESPONSE_AVAILABLE;
+void ClientManager::ReplayJournal() {
+    const float currentTime = CurrentTime();
+    if (!mServerReachable || mJournal.GetReplayableCount() == 0 ||
+            (currentTime - mLastJournalReplay) < JOURNAL_REPLAY_INTERVAL) {
+        return;
+    }
+    // Replayed commands are background commands, they are recorded as
+    // deferrable sends when they are sent
+    if (!mNetworkScheduler.CanSendDeferrable()) {
+        mNetworkScheduler.RecordDeferred();
+        return;
+    }
+    mLastJournalReplay = currentTime;
+
+    const int64_t wallTime = static_cast<int64_t>(time(nullptr));
+    auto integrityBatch = std::make_unique<PendingCommand>();
+    integrityBatch->mPriority = COMMAND_PRIORITY_BACKGROUND;
+    integrityBatch->mPath = CommandPathPolicy::COMMAND_PATH_INTEGRITY;
+    for (CommandJournal::Entry &entry : mJournal.TakeReplayEntries(JOURNAL_REPLAY_BATCH_SIZE)) {
+        const float expressTokenAge = static_cast<float>(wallTime - entry.mExpressTokenIssueTime);
+        if (IsValidExpressToken(entry.mExpressToken) && expressTokenAge < EXPRESS_TOKEN_MAX_AGE) {
+            // Replays count against the same limits as the commands they
+            // replay, one refused now is tried again next time
+            if (!mRateLimiter.CanAcquire(COMMAND_PRIORITY_BACKGROUND, SERVER_COMMAND_ENDPOINT,
+                                         currentTime, nullptr)) {
+                mJournal.ReturnEntry(entry.mId);
+                continue;
+            }
+            auto expressCommand = std::make_unique<PendingCommand>();
+            expressCommand->mPriority = COMMAND_PRIORITY_BACKGROUND;
+            expressCommand->mCommand = std::move(entry.mCommand);
+            expressCommand->mRequestId.Assign(entry.mRequestId);
+            expressCommand->mPath = CommandPathPolicy::COMMAND_PATH_EXPRESS;
+            expressCommand->mExpressToken.Assign(entry.mExpressToken);
+            expressCommand->mExpressTokenIssueTime = currentTime - expressTokenAge;
+            expressCommand->mJournalIds.push_back(entry.mId);
+            if (IsEnqueued(SubmitCommand(std::move(expressCommand)))) {
+                mRateLimiter.Take(COMMAND_PRIORITY_BACKGROUND, SERVER_COMMAND_ENDPOINT,
+                                  currentTime);
+            }
+        } else {
+            // Integrity commands, and express commands whose token has
+            // expired in the meantime, are replayed together under a
+            // single integrity token
+            integrityBatch->mBatchCommands.push_back(std::move(entry.mCommand));
+            integrityBatch->mBatchRequestIds.push_back(RequestIdString(entry.mRequestId));
+            integrityBatch->mBatchRequestCounts.push_back(1);
+            integrityBatch->mJournalIds.push_back(entry.mId);
+        }
+    }
+    if (integrityBatch->mBatchCommands.empty()) {
+        return;
+    }
+    if (!mRateLimiter.CanAcquire(COMMAND_PRIORITY_BACKGROUND,
+                                 INTEGRITY_TOKEN_ENDPOINT | SERVER_COMMAND_ENDPOINT,
+                                 currentTime, nullptr)) {
+        for (uint64_t journalId : integrityBatch->mJournalIds) {
+            mJournal.ReturnEntry(journalId);
         }
+        return;
+    }
+    UnbatchSingleCommand(*integrityBatch);
+    if (IsEnqueued(SubmitCommand(std::move(integrityBatch)))) {
+        mRateLimiter.Take(COMMAND_PRIORITY_BACKGROUND, SERVER_COMMAND_ENDPOINT, currentTime);
     }
 }
 
 void ClientManager::Update() {
-    if (mStatus == CLIENT_MANAGER_REQUEST_TOKEN) {
-        IntegrityResponseStatus responseStatus = INTEGRITY_RESPONSE_UNKNOWN;
-        const IntegrityErrorCode errorCode =
-                IntegrityTokenResponse_getStatus(mTokenResponse, &responseStatus);
+    if (mOpenBatch && (CurrentTime() - mBatchOpenTime) >= mBatchWindow) {
+        FlushBatch();
+    }
+    if (!mSuspended) {
+        ReplayJournal();
+    }
+    DispatchCommands();
+    mPipeline.Pump();
+    UpdateCancellation();
+    if (!mSuspended && mPipeline.GetInFlightCount() == 0 && mScheduler.GetQueuedCount() == 0 &&
+            !mOpenBatch) {
+        mExpressTokenPool.DiscardExpired(CurrentTime());
+        // Top up the random pool while no command is in flight
+        RefillRandomPool();
+        RenewNonceSession();
+        StartSpeculativeRequests();
+    }
+}
+
+void ClientManager::CancelPendingCommands() {
+    // An open batch is outstanding work too, send it on its way so it
+    // gets an id below the cutoff
+    if (mOpenBatch) {
+        FlushBatch();
+    }
+    mCancelBeforeId = mNextCommandId;
+    const float deadline = CurrentTime() + mCancellationGracePeriod;
+    if (!mCancelDeadline || deadline < *mCancelDeadline) {
+        mCancelDeadline = deadline;
+    }
+}
+
+void ClientManager::Suspend() {
+    mSuspended = true;
+    CancelPendingCommands();
+}
+
+void ClientManager::Resume() {
+    mSuspended = false;
+    mCancelDeadline.reset();
+}
+
+void ClientManager::UpdateCancellation() {
+    if (!mCancelDeadline) {
+        return;
+    }
+    const uint64_t cancelBeforeId = mCancelBeforeId;
+    auto isOutstanding = [cancelBeforeId](const PendingCommand &command) {
+        return command.mId < cancelBeforeId;
+    };
+    if (CurrentTime() < *mCancelDeadline) {
+        // Nothing to do if everything finished within the grace period
+        if (mScheduler.FindItem(isOutstanding) == nullptr &&
+                mPipeline.FindItem(isOutstanding) == nullptr) {
+            mCancelDeadline.reset();
+        }
+        return;
+    }
+
+    mCancelDeadline.reset();
+    ++mLifecycleStats.cancellations;
+    for (auto &command : mScheduler.RemoveIf(isOutstanding)) {
+        CancelCommand(std::move(command));
+    }
+    for (auto &command : mPipeline.RemoveIf(isOutstanding)) {
+        mScheduler.OnComplete(command->mPriority);
+        CancelCommand(std::move(command));
+    }
+    if (mSuspended) {
+        // Speculative token requests keep Play Integrity busy too
+        mSpeculativeTokens.Clear(CurrentTime());
+    }
+}
+
+void ClientManager::CancelCommand(std::unique_ptr<PendingCommand> command) {
+    ALOGI("Cancelling command %" PRIu64, command->mId);
+    command->mResult = SERVER_OPERATION_CANCELLED;
+    mResult = SERVER_OPERATION_CANCELLED;
+    // Cancelled replays stay journaled for a later attempt
+    for (uint64_t journalId : command->mJournalIds) {
+        mJournal.ReturnEntry(journalId);
+    }
+    RecordResults(*command);
+    ++mLifecycleStats.cancelled;
+    // Destroying the command releases any outstanding token request
+}
+
+void ClientManager::AddPredictedCommand(const std::string &command) {
+    if (std::find(mPredictedCommands.begin(), mPredictedCommands.end(), command) ==
+            mPredictedCommands.end()) {
+        mPredictedCommands.push_back(command);
+    }
+}
+
+void ClientManager::ClearPredictedCommands() {
+    mPredictedCommands.clear();
+    mSpeculativeTokens.Clear(CurrentTime());
+}
+
+void ClientManager::StartSpeculativeRequests() {
+    if (!mInitialized) {
+        return;
+    }
+    const float currentTime = CurrentTime();
+    mSpeculativeTokens.Update(currentTime);
+    // Expired randoms would pass the pool check below and then fail to be
+    // taken after the quota had been spent
+    mRandomPool.DiscardExpired(currentTime);
+    for (const std::string &command : mPredictedCommands) {
+        if (!mSpeculativeTokens.CanSpeculate(command, currentTime)) {
+            continue;
+        }
+        // Only speculate with randoms we already have, the pool
+        // refill takes care of fetching more
+        if (mRandomPool.GetCount() == 0) {
+            break;
+        }
+        if (!mNetworkScheduler.CanSendDeferrable()) {
+            mNetworkScheduler.RecordDeferred();
+            break;
+        }
+        // Speculative requests share the Play Integrity quota with commands,
+        // only take from it once nothing else stops the request
+        if (!mRateLimiter.TryAcquire(INTEGRITY_TOKEN_ENDPOINT, currentTime, nullptr)) {
+            break;
+        }
+        auto pooledRandom = mRandomPool.TakeToken(currentTime);
+        if (!pooledRandom) {
+            break;
+        }
+        if (mSpeculativeTokens.StartSpeculation(
+                command, GenerateNonce(pooledRandom->mToken, command).GetCString(),
+                mRandomPool.GetExpireTime(pooledRandom->mIssueTime))) {
+            mNetworkScheduler.RecordDeferrableSend();
+            mNetworkScheduler.RecordActivity();
+        }
+    }
+}
+
+ClientManager::CommandPipeline::StageStatus ClientManager::RandomStage(
+        PendingCommand &command, float currentTime) {
+    if (command.HasToken()) {
+        return CommandPipeline::STAGE_STATUS_DONE;
+    }
+
+    // Speculative tokens are only ever generated for single commands
+    if (!command.IsBatch()) {
+        // A token generated ahead of time for this command lets us go
+        // straight to sending it, and one that is still being generated
+        // can be waited on just like a fresh request
+        mSpeculativeTokens.Update(currentTime);
+        auto speculativeToken = mSpeculativeTokens.TakeReadyToken(command.mCommand, currentTime);
+        if (speculativeToken) {
+            command.mToken = *speculativeToken;
+            return CommandPipeline::STAGE_STATUS_DONE;
+        }
+        if (mSpeculativeTokens.TakePendingRequest(command.mCommand, &command.mTokenRequest,
+                                                  &command.mTokenResponse,
+                                                  &command.mTokenExpireTime)) {
+            return CommandPipeline::STAGE_STATUS_DONE;
+        }
+    }
+
+    // A nonce session makes a random on the spot. Otherwise use a
+    // prefetched random if one is available, or request a fresh random.
+    auto sessionRandom = mUseNonceSession ? mNonceSession.NextRandom(currentTime) : std::nullopt;
+    if (sessionRandom) {
+        command.mRandom = sessionRandom->mRandom;
+        command.mNonceSessionId.Assign(mNonceSession.GetSessionId());
+        command.mNonceCounter = sessionRandom->mCounter;
+        command.mNonceTime = sessionRandom->mTime;
+    } else {
+        auto pooledRandom = mRandomPool.TakeToken(currentTime);
+        if (pooledRandom) {
+            command.mRandom = pooledRandom->mToken;
+        } else {
+            auto random = FetchRandom(&command.mResult);
+            if (!random) {
+                return CommandPipeline::STAGE_STATUS_FAILED;
+            }
+            command.mRandom = *random;
+        }
+    }
+    mCurrentRandom = command.mRandom;
+    mValidRandom = true;
+    return CommandPipeline::STAGE_STATUS_DONE;
+}
+
+ClientManager::CommandPipeline::StageStatus ClientManager::NonceStage(
+        PendingCommand &command, float /*currentTime*/) {
+    if (!command.mRandom.IsEmpty()) {
+        command.mNonce = command.IsBatch() ?
+                GenerateBatchNonce(command.mRandom, command.mBatchCommands) :
+                GenerateNonce(command.mRandom, command.mCommand);
+        mCurrentNonce = command.mNonce;
+    }
+    return CommandPipeline::STAGE_STATUS_DONE;
+}
+
+ClientManager::CommandPipeline::StageStatus ClientManager::TokenStage(
+        PendingCommand &command, float currentTime) {
+    if (command.HasToken()) {
+        return CommandPipeline::STAGE_STATUS_DONE;
+    }
+
+    if (command.mTokenRequest == nullptr) {
+        // The command was let through with a token to spare for this
+        mRateLimiter.Take(INTEGRITY_TOKEN_ENDPOINT, currentTime);
+        IntegrityTokenRequest_create(&command.mTokenRequest);
+        IntegrityTokenRequest_setNonce(command.mTokenRequest, command.mNonce.GetCString());
+        const IntegrityErrorCode errorCode = IntegrityManager_requestIntegrityToken(
+                command.mTokenRequest, &command.mTokenResponse);
         if (errorCode != INTEGRITY_NO_ERROR) {
             ALOGE("Play Integrity returned error: %d", errorCode);
-            CleanupRequest();
-            mStatus = CLIENT_MANAGER_IDLE;
-        } else if (responseStatus == INTEGRITY_RESPONSE_COMPLETED) {
-            std::string tokenString = IntegrityTokenResponse_getToken(mTokenResponse);
-            SendCommandToServer(tokenString);
-            CleanupRequest();
-            mStatus = CLIENT_MANAGER_RESPONSE_AVAILABLE;
+            command.CleanupRequest();
+            return CommandPipeline::STAGE_STATUS_FAILED;
         }
+        mNetworkScheduler.RecordActivity();
     }
-}
 
-void ClientManager::CleanupRequest() {
-    if (mTokenResponse != nullptr) {
-        IntegrityTokenResponse_destroy(mTokenResponse);
-        mTokenResponse = nullptr;
+    IntegrityResponseStatus responseStatus = INTEGRITY_RESPONSE_UNKNOWN;
+    const IntegrityErrorCode errorCode =
+            IntegrityTokenResponse_getStatus(command.mTokenResponse, &responseStatus);
+    if (errorCode != INTEGRITY_NO_ERROR) {
+        ALOGE("Play Integrity returned error: %d", errorCode);
+        command.CleanupRequest();
+        return CommandPipeline::STAGE_STATUS_FAILED;
     }
-    if (mTokenRequest != nullptr) {
-        IntegrityTokenRequest_destroy(mTokenRequest);
-        mTokenRequest = nullptr;
+    if (responseStatus != INTEGRITY_RESPONSE_COMPLETED) {
+        // The cache discarded pending requests once their random expired,
+        // an adopted one has to stop waiting at the same point
+        if (command.mTokenExpireTime > 0.0f && currentTime >= command.mTokenExpireTime) {
+            ALOGE("Adopted Play Integrity request outlived its random");
+            command.CleanupRequest();
+            command.mResult = SERVER_OPERATION_INVALID_RANDOM;
+            return CommandPipeline::STAGE_STATUS_FAILED;
+        }
+        return CommandPipeline::STAGE_STATUS_WAITING;
+    }
+    command.mToken = IntegrityTokenResponse_getToken(command.mTokenResponse);
+    command.CleanupRequest();
+    if (!IsValidIntegrityToken(command.mToken)) {
+        ALOGE("Play Integrity returned a malformed token");
+        command.mToken.clear();
+        return CommandPipeline::STAGE_STATUS_FAILED;
     }
+    return CommandPipeline::STAGE_STATUS_DONE;
 }
 
-void ClientManager::SendCommandToServer(const std::string &token) {
+ClientManager::CommandPipeline::StageStatus ClientManager::SendStage(
+        PendingCommand &command, float currentTime) {
     // Note that for simplicity, we are doing HTTP operations as
     // synchronous blocking instead of managing them from a
     // separate network thread
-    HTTPClient client;
     std::string errorString;
 
-    // Manually construct the json payload
-    std::string payloadString = COMMAND_JSON_PREFIX;
-    payloadString += TEST_COMMAND;
-    payloadString += COMMAND_JSON_TOKEN;
-    payloadString += token;
-    payloadString += COMMAND_JSON_SUFFIX;
+    // Ask for enough express tokens to fill the pool back up, the server
+    // only issues more than one in response to an integrity check
+    const size_t expressTokenCount =
+            Max(mExpressTokenPool.GetCapacity() - mExpressTokenPool.GetCount(), size_t(1));
+    // Randoms made from a nonce session need no server random
+    const bool requestNextRandom = mRandomPool.NeedsRefill() &&
+            !(mUseNonceSession && mNonceSession.IsActive(currentTime));
+    // Count the size of the payload first, so the buffer is sized once and
+    // the payload written straight into it
+    JsonWriter sizeCounter(nullptr);
+    WriteCommandPayload(sizeCounter, command, expressTokenCount, requestNextRandom);
+    mPayloadBuffer.clear();
+    mPayloadBuffer.reserve(sizeCounter.GetSize());
+    JsonWriter payloadWriter(&mPayloadBuffer);
+    WriteCommandPayload(payloadWriter, command, expressTokenCount, requestNextRandom);
 
-    auto result = client.Post(PERFORM_COMMAND_URL, payloadString, &errorString);
+    command.mSendTime = currentTime;
+    if (command.mPriority == COMMAND_PRIORITY_BACKGROUND) {
+        mNetworkScheduler.RecordDeferrableSend();
+    }
+    auto result = mContext.mTransport->Post(
+            command.IsBatch() ? PERFORM_COMMAND_BATCH_URL : PERFORM_COMMAND_URL,
+            mPayloadBuffer, &errorString);
+    mNetworkScheduler.RecordActivity();
     if (!result) {
         ALOGE("SendCommandToServer Curl reported error: %s", errorString.c_str());
-        mResult = SERVER_OPERATION_NETWORK_ERROR;
+        command.mResult = SERVER_OPERATION_NETWORK_ERROR;
+        return CommandPipeline::STAGE_STATUS_FAILED;
+    }
+    ALOGI("SendCommandToServer result: %s", (*result).c_str())
+    command.mResponseBody = std::move(*result);
+    return CommandPipeline::STAGE_STATUS_DONE;
+}
+
+void ClientManager::WriteCommandPayload(JsonWriter &writer, const PendingCommand &command,
+                                        size_t expressTokenCount,
+                                        bool requestNextRandom) const {
+    writer.BeginObject();
+    if (command.IsBatch()) {
+        writer.Key(COMMANDSTRINGS_KEY);
+        writer.BeginArray();
+        for (const std::string &batchCommand : command.mBatchCommands) {
+            writer.String(batchCommand);
+        }
+        writer.EndArray();
+        writer.Key(REQUESTIDS_KEY);
+        writer.BeginArray();
+        for (const RequestIdString &requestId : command.mBatchRequestIds) {
+            writer.String(requestId.GetView());
+        }
+        writer.EndArray();
     } else {
-        ALOGI("SendCommandToServer result: %s", (*result).c_str())
-        // Preset to success, ParseResult will set a failure result if the parsing
-        // errors.
-        mResult = SERVER_OPERATION_SUCCESS;
-        ParseResult(*result);
+        writer.Key(COMMANDSTRING_KEY);
+        writer.String(command.mCommand);
+        writer.Key(REQUESTID_KEY);
+        writer.String(command.mRequestId.GetView());
+    }
+    writer.Key(TOKENSTRING_KEY);
+    writer.String(command.GetToken());
+    writer.Key(EXPRESSTOKENCOUNT_KEY);
+    writer.Uint(expressTokenCount);
+    if (command.mNonceCounter != 0) {
+        writer.Key(SESSIONID_KEY);
+        writer.String(command.mNonceSessionId.GetView());
+        writer.Key(NONCECOUNTER_KEY);
+        writer.Uint(command.mNonceCounter);
+        writer.Key(NONCETIME_KEY);
+        writer.Int(command.mNonceTime);
+    }
+    writer.Key(REQUESTNEXTRANDOM_KEY);
+    writer.Bool(requestNextRandom);
+    writer.EndObject();
+}
+
+ClientManager::CommandPipeline::StageStatus ClientManager::ParseStage(
+        PendingCommand &command, float /*currentTime*/) {
+    // Preset to success, ParseResult will set a failure result if the parsing
+    // errors.
+    command.mResult = SERVER_OPERATION_SUCCESS;
+    ParseResult(command);
+    return CommandPipeline::STAGE_STATUS_DONE;
+}
+
+void ClientManager::CompleteCommand(std::unique_ptr<PendingCommand> command) {
+    mScheduler.OnComplete(command->mPriority);
+    ++mLifecycleStats.completed;
+    mResult = command->mResult;
+    if (command->mResult == SERVER_OPERATION_NETWORK_ERROR) {
+        mServerReachable = false;
+    } else if (!command->mResponseBody.empty()) {
+        mServerReachable = true;
+    }
+    UpdateJournal(*command);
+    if (!command->mSummary.empty()) {
+        mCurrentSummary = command->mSummary;
+        mCurrentExpressToken = command->mIssuedExpressToken;
+    }
+    RecordResults(*command);
+
+    // Feed the path policy, a network error tells us nothing about how
+    // long the path takes when it works, and a batch's round trip isn't
+    // comparable with a single command's
+    const PipelineTiming &timing = command->mTiming;
+    if (!command->IsBatch() && (command->mResult == SERVER_OPERATION_SUCCESS ||
+            command->mResult == SERVER_OPERATION_REJECTED_VERDICT)) {
+        mPathPolicy.RecordLatency(command->mPath, timing.mCompleteTime - timing.mSubmitTime);
+    }
+    if (command->mPath == CommandPathPolicy::COMMAND_PATH_INTEGRITY &&
+            command->mResult == SERVER_OPERATION_SUCCESS) {
+        mLastVerdictTime = timing.mCompleteTime;
+    }
+
+    // Log where the time went, per stage the command reached
+    ALOGI("Command %" PRIu64 " finished with result %d in %.3f s", command->mId,
+          command->mResult, timing.mCompleteTime - timing.mSubmitTime);
+    for (size_t i = 0; i < mPipeline.GetStageCount(); ++i) {
+        const PipelineTiming::StageTiming &stageTiming = timing.mStages[i];
+        if (stageTiming.mStarted) {
+            ALOGI("  %s: queued %.3f s, active %.3f s", mPipeline.GetStageName(i),
+                  stageTiming.mStartTime - stageTiming.mEnterTime,
+                  stageTiming.mExitTime - stageTiming.mStartTime);
+        }
+    }
+}
+
+void ClientManager::RecordResults(PendingCommand &command) {
+    // Commands that never got a response from the server still report a
+    // result for every command they carried
+    if (command.mResults.empty()) {
+        if (command.IsBatch()) {
+            for (const std::string &batchCommand : command.mBatchCommands) {
+                command.mResults.push_back({batchCommand, command.mResult, ""});
+            }
+        } else {
+            command.mResults.push_back({command.mCommand, command.mResult, ""});
+        }
+    }
+    for (size_t i = 0; i < command.mResults.size(); ++i) {
+        CommandResult &result = command.mResults[i];
+        result.mRequestCount = command.IsBatch() ?
+                command.mBatchRequestCounts[i] : command.mRequestCount;
+        if (mRecentResults.size() >= RECENT_RESULT_CAPACITY) {
+            mRecentResults.pop_front();
+        }
+        mRecentResults.push_back(std::move(result));
+    }
+}
+
+const Sha256HexDigest *ClientManager::FindCommandHash(const std::string &command) {
+    // Constant commands were hashed at compile time
+    for (const KnownCommandHash &knownCommand : KNOWN_COMMAND_HASHES) {
+        if (command == knownCommand.mCommand) {
+            return &knownCommand.mHashHex;
+        }
     }
+    // Then commands hashed recently
+    return mCommandHashCache.Find(command);
+}
+
+NonceCodec::NonceFormat ClientManager::GetNonceFormat() const {
+    if ((mServerNonceFormats & (1u << mPreferredNonceFormat)) != 0) {
+        return mPreferredNonceFormat;
+    }
+    return NonceCodec::NONCE_FORMAT_HEX;
+}
+
+void ClientManager::HashCommand(const std::string &command, char *hashHex) {
+    const Sha256HexDigest *knownHash = FindCommandHash(command);
+    if (knownHash != nullptr) {
+        memcpy(hashHex, knownHash->data(), SHA256_HEX_LENGTH);
+        return;
+    }
+
+    ComputeHash(command, hashHex);
+    Sha256HexDigest cachedHash = {};
+    memcpy(cachedHash.data(), hashHex, SHA256_HEX_LENGTH);
+    mCommandHashCache.Insert(command, cachedHash);
+}
+
+void ClientManager::ComputeHash(std::string_view data, char *hashHex) {
+    Sha256Digest digest;
+    Sha256Batch::Hash(&data, 1, &digest);
+    Encoding::HexEncode(digest.data(), digest.size(), hashHex);
 }
 
-void ClientManager::GenerateNonce() {
+NonceString ClientManager::GenerateNonce(const RandomString &random, const std::string &command) {
     // To generate the nonce we do the following:
     // 1. Generate a SHA-256 hash of the command string
     // 2. Convert the bytes of the hash into a hex string
-    // 3. Create the nonce string by taking the random string and appending the hash string to it
+    // 3. Create the nonce string by taking the random string and appending the hash string to
+    //    it, or for compact nonces, the base64url of the random and hash bytes
+    // Nothing here touches the heap
+    char hashHex[SHA256_HEX_LENGTH];
+    HashCommand(command, hashHex);
+    NonceString nonce;
+    NonceCodec::Encode(GetNonceFormat(), random, std::string_view(hashHex, sizeof(hashHex)),
+                       &nonce);
+    return nonce;
+}
 
-    // Generate the SHA-256 hash
-    unsigned char hashBuffer[SHA256_DIGEST_LENGTH];
-    char hashHexString[(SHA256_DIGEST_LENGTH * 2) + 1];
-    SHA256_CTX sha256Ctx;
-    SHA256_Init(&sha256Ctx);
-    SHA256_Update(&sha256Ctx, TEST_COMMAND, strlen(TEST_COMMAND));
-    SHA256_Final(hashBuffer, &sha256Ctx);
-    char *hexOut = hashHexString;
-    for (size_t i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
-        *hexOut++ = HEX_TABLE[((hashBuffer[i] >> 4) & 0xF)];
-        *hexOut++ = HEX_TABLE[(hashBuffer[i] & 0xF)];
+NonceString ClientManager::GenerateBatchNonce(const RandomString &random,
+                                              const std::vector<std::string> &commands) {
+    // A batch nonce has the same layout as a single command nonce, the
+    // hash covers the hex SHA-256 hashes of every command in order. The
+    // hashes are all the same length, so the order and the boundaries
+    // between commands are part of what is hashed.
+    std::string commandHashes(commands.size() * SHA256_HEX_LENGTH, '\0');
+    // Commands with a known hash are filled in straight away, the rest are
+    // hashed together so multi-buffer SHA-256 can work on them side by side
+    std::vector<size_t> missingIndices;
+    std::vector<std::string_view> missingCommands;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const Sha256HexDigest *knownHash = FindCommandHash(commands[i]);
+        if (knownHash != nullptr) {
+            memcpy(&commandHashes[i * SHA256_HEX_LENGTH], knownHash->data(), SHA256_HEX_LENGTH);
+        } else {
+            missingIndices.push_back(i);
+            missingCommands.push_back(commands[i]);
+        }
     }
-    // Terminate string
-    *hexOut = '\0';
-
-    mCurrentNonce = mCurrentRandom + hashHexString;
+    if (!missingCommands.empty()) {
+        std::vector<Sha256Digest> digests(missingCommands.size());
+        Sha256Batch::Hash(missingCommands.data(), missingCommands.size(), digests.data());
+        for (size_t i = 0; i < missingCommands.size(); ++i) {
+            char *hashHex = &commandHashes[missingIndices[i] * SHA256_HEX_LENGTH];
+            Encoding::HexEncode(digests[i].data(), digests[i].size(), hashHex);
+            Sha256HexDigest cachedHash = {};
+            memcpy(cachedHash.data(), hashHex, SHA256_HEX_LENGTH);
+            mCommandHashCache.Insert(missingCommands[i], cachedHash);
+        }
+    }
+    // The combined hashes are different for every batch, not worth caching
+    char batchHashHex[SHA256_HEX_LENGTH];
+    ComputeHash(commandHashes, batchHashHex);
+    NonceString nonce;
+    NonceCodec::Encode(GetNonceFormat(), random,
+                       std::string_view(batchHashHex, sizeof(batchHashHex)), &nonce);
+    return nonce;
 }
 
-void ClientManager::ParseResult(const std::string &resultJson) {
+void ClientManager::ParseResult(PendingCommand &command) {
+    const float sendTime = command.mSendTime;
     bool validJson = false;
     JsonLookup jsonLookup;
-    if (jsonLookup.ParseJson(resultJson)) {
-        // Look for all of our needed fields in the returned json
-        auto commandSuccess = jsonLookup.GetBoolValueForKey(COMMANDSUCCESS_KEY);
-        if (commandSuccess) {
-            auto diagnosticString = jsonLookup.GetStringValueForKey(DIAGNOSTICMESSAGE_KEY);
-            if (diagnosticString) {
-                auto expressString = jsonLookup.GetStringValueForKey(EXPRESSTOKEN_KEY);
-                if (expressString) {
-                    if (*commandSuccess) {
-                        // Express token only valid if the server reports the command succeeded
-                        mValidExpressToken = true;
-                    } else {
-                        mValidExpressToken = false;
-                        mResult = SERVER_OPERATION_REJECTED_VERDICT;
+    if (jsonLookup.ParseJson(command.mResponseBody)) {
+        if (command.IsBatch()) {
+            // Batch results hold one command result per command, in the
+            // order the commands were sent
+            auto commandResults = jsonLookup.GetObjectArrayForKey(COMMANDRESULTS_KEY);
+            if (commandResults && commandResults->size() == command.mBatchCommands.size()) {
+                validJson = true;
+                for (size_t i = 0; i < commandResults->size() && validJson; ++i) {
+                    CommandResult result = {command.mBatchCommands[i],
+                                            SERVER_OPERATION_SUCCESS, ""};
+                    ExpressTokenString expressToken;
+                    validJson = ParseCommandResult((*commandResults)[i], sendTime, result,
+                                                   expressToken);
+                    // Express tokens earned by the batch only come with one of its results
+                    if (!expressToken.IsEmpty()) {
+                        command.mIssuedExpressToken = expressToken;
                     }
-                    mCurrentSummary = *diagnosticString;
-                    mCurrentExpressToken = *expressString;
-                    validJson = true;
+                    command.mResults.push_back(std::move(result));
                 }
             }
+        } else {
+            CommandResult result = {command.mCommand, SERVER_OPERATION_SUCCESS, ""};
+            validJson = ParseCommandResult(jsonLookup, sendTime, result,
+                                           command.mIssuedExpressToken);
+            command.mResults.push_back(std::move(result));
         }
     }
     if (!validJson) {
-        mResult = SERVER_OPERATION_INVALID_RESULT;
+        command.mResult = SERVER_OPERATION_INVALID_RESULT;
+        command.mResults.clear();
+    } else {
+        // The last command's result stands for the whole request
+        command.mResult = command.mResults.back().mResult;
+        command.mSummary = command.mResults.back().mSummary;
+        // The server may hand back the random for our next integrity command,
+        // the server generated it after we sent the command, so stamping it
+        // with the send time errs on the side of expiring it early
+        auto nextRandom = jsonLookup.GetStringViewForKey(NEXTRANDOM_KEY);
+        if (nextRandom && IsValidRandom(*nextRandom)) {
+            mRandomPool.AddToken(*nextRandom, sendTime);
+        }
+    }
+}
+
+bool ClientManager::ParseCommandResult(const JsonLookup &jsonLookup, float sendTime,
+                                       CommandResult &result,
+                                       ExpressTokenString &expressToken) {
+    // Look for all of our needed fields in the returned json
+    auto commandSuccess = jsonLookup.GetBoolValueForKey(COMMANDSUCCESS_KEY);
+    if (commandSuccess) {
+        auto diagnosticString = jsonLookup.GetStringViewForKey(DIAGNOSTICMESSAGE_KEY);
+        if (diagnosticString) {
+            auto expressString = jsonLookup.GetStringViewForKey(EXPRESSTOKEN_KEY);
+            if (expressString) {
+                if (*commandSuccess) {
+                    // Express tokens only valid if the server reports the command succeeded
+                    if (IsValidExpressToken(*expressString)) {
+                        mExpressTokenPool.AddToken(*expressString, sendTime);
+                    }
+                    auto additionalTokens =
+                            jsonLookup.GetStringArrayForKey(ADDITIONALEXPRESSTOKENS_KEY);
+                    if (additionalTokens) {
+                        for (const std::string &additionalToken : *additionalTokens) {
+                            if (IsValidExpressToken(additionalToken)) {
+                                mExpressTokenPool.AddToken(additionalToken, sendTime);
+                            }
+                        }
+                    }
+                } else {
+                    result.mResult = SERVER_OPERATION_REJECTED_VERDICT;
+                }
+                result.mSummary = std::string(*diagnosticString);
+                expressToken.Assign(*expressString);
+                return true;
+            }
+        }
     }
+    return false;
 }
 
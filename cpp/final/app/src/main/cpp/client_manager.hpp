@@ -16,12 +16,36 @@
 
 #pragma once
 
+#include "client_context.hpp"
+#include "command_hash_cache.hpp"
+#include "command_journal.hpp"
+#include "command_path_policy.hpp"
+#include "command_scheduler.hpp"
+#include "json_writer.hpp"
+#include "network_scheduler.hpp"
+#include "nonce_codec.hpp"
+#include "nonce_session.hpp"
+#include "rate_limiter.hpp"
+#include "speculative_token_cache.hpp"
+#include "staged_pipeline.hpp"
+#include "token_pool.hpp"
+#include "token_strings.hpp"
 #include "util.hpp"
 #include "play/integrity.h"
 
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class JsonLookup;
+
 /*
  * Manages sending commands to the server and generating
- * Play Integrity tokens
+ * Play Integrity tokens. Everything it needs from outside comes from
+ * its ClientContext, and any number can exist at once.
  */
 class ClientManager {
 public:
@@ -40,55 +64,406 @@ public:
         SERVER_OPERATION_INVALID_RESULT = -3,
         // Server operation failed due server rejecting
         // from integrity check resulting in lack of positive verdict signals
-        SERVER_OPERATION_REJECTED_VERDICT = -4
+        SERVER_OPERATION_REJECTED_VERDICT = -4,
+        // Server operation was never sent because the outbound queue was full
+        SERVER_OPERATION_DROPPED = -5,
+        // Server operation was cancelled before it finished
+        SERVER_OPERATION_CANCELLED = -6
+    };
+
+    // Result of a single command, each command in a batch gets its own
+    struct CommandResult {
+        std::string mCommand;
+        ServerOperationResult mResult;
+        std::string mSummary;
+        // Number of identical requests that shared this result
+        uint32_t mRequestCount = 1;
+    };
+
+    struct LifecycleStats {
+        // Commands that ran to a result
+        uint64_t completed;
+        // Commands cancelled before they finished
+        uint64_t cancelled;
+        // Times outstanding commands were cancelled
+        uint64_t cancellations;
     };
 
-    ClientManager();
+    explicit ClientManager(const ClientContext &context);
+
+    ClientManager(const ClientManager &) = delete;
+
+    void operator=(const ClientManager &) = delete;
 
     ~ClientManager();
 
-    const std::string &GetCurrentExpressToken() const { return mCurrentExpressToken;}
+    std::string_view GetCurrentExpressToken() const { return mCurrentExpressToken; }
 
-    const std::string &GetCurrentRandomString() const { return mCurrentRandom; }
+    std::string_view GetCurrentRandomString() const { return mCurrentRandom; }
 
     const std::string &GetCurrentSummary() const { return mCurrentSummary; }
 
     void RequestRandom();
 
-    void StartCommandIntegrity();
+    // The StartCommand functions queue a command for sending. The result
+    // tells the caller whether the command was queued, and to slow down
+    // when the outbound queue is filling up. Commands that are dropped
+    // report SERVER_OPERATION_DROPPED through GetRecentResults. Commands
+    // started faster than the rate limits allow are refused with
+    // COMMAND_QUEUE_RATE_LIMITED, see GetRetryAfter.
+
+    CommandQueueResult StartCommandIntegrity();
+
+    CommandQueueResult StartCommandIntegrity(const std::string &command,
+                                             CommandPriority priority = COMMAND_PRIORITY_NORMAL);
+
+    CommandQueueResult StartCommandExpress();
+
+    // Rejects the command if no express token is available
+    CommandQueueResult StartCommandExpress(const std::string &command,
+                                           CommandPriority priority = COMMAND_PRIORITY_NORMAL);
+
+    // Sends the test command on whichever path the path policy picks
+    CommandQueueResult StartCommand(CommandPathPolicy::CommandSensitivity sensitivity);
+
+    // Sends command on whichever path the path policy picks
+    CommandQueueResult StartCommand(const std::string &command,
+                                    CommandPathPolicy::CommandSensitivity sensitivity,
+                                    CommandPriority priority = COMMAND_PRIORITY_NORMAL);
+
+    void SetPathPolicyConfig(const CommandPathPolicy::Config &config) {
+        mPathPolicy.SetConfig(config);
+    }
+
+    // Adds a command that integrity tokens are requested for ahead of time
+    void AddPredictedCommand(const std::string &command);
+
+    // Stops speculative token requests and discards any unused tokens
+    void ClearPredictedCommands();
+
+    // Integrity commands started within window seconds of the first one
+    // are sent together, covered by a single token. Zero sends each
+    // command on its own.
+    void SetBatchWindow(float window) { mBatchWindow = window; }
+
+    void SetSchedulerConfig(const CommandSchedulerConfig &config) {
+        mScheduler.SetConfig(config);
+    }
+
+    const CommandSchedulerStats &GetSchedulerStats() const {
+        return mScheduler.GetStats();
+    }
+
+    void SetRateLimiterConfig(const RateLimiter::Config &config) {
+        mRateLimiter.SetConfig(config);
+    }
+
+    const RateLimiter::Stats &GetRateLimiterStats() const { return mRateLimiter.GetStats(); }
+
+    // Seconds until the command most recently refused with
+    // COMMAND_QUEUE_RATE_LIMITED would have been accepted, measured from
+    // when it was refused
+    float GetRetryAfter() const { return mRetryAfter; }
 
-    void StartCommandExpress();
+    // Background commands, journal replays, random prefetches and
+    // speculative token requests wait for a wake window
+    void SetNetworkSchedulerConfig(const NetworkScheduler::Config &config) {
+        mNetworkScheduler.SetConfig(config);
+    }
+
+    const NetworkScheduler::Stats &GetNetworkSchedulerStats() const {
+        return mNetworkScheduler.GetStats();
+    }
+
+    // Number of commands of a priority class waiting for the scheduler to send them
+    size_t GetQueuedCommandCount(CommandPriority priority) const {
+        return mScheduler.GetQueuedCount(priority);
+    }
+
+    // When enabled, an integrity command identical to one that is already
+    // in flight (or waiting in the open batch) shares that command's result
+    // instead of being sent again
+    void SetCommandCoalescing(bool enabled) { mCoalesceCommands = enabled; }
+
+    // Number of commands that shared the result of an identical in-flight command
+    uint64_t GetCoalescedCommandCount() const { return mCoalescedCommandCount; }
+
+    const CommandHashCache::Stats &GetCommandHashCacheStats() const {
+        return mCommandHashCache.GetStats();
+    }
+
+    float GetCommandHashCacheHitRate() const { return mCommandHashCache.GetHitRate(); }
+
+    const CommandJournal::Stats &GetJournalStats() const { return mJournal.GetStats(); }
+
+    // Number of commands that failed to reach the server and are waiting to be replayed
+    size_t GetJournaledCommandCount() const { return mJournal.GetPendingCount(); }
+
+    // Seconds outstanding commands get to finish once cancellation is requested
+    void SetCancellationGracePeriod(float gracePeriod) {
+        mCancellationGracePeriod = gracePeriod;
+    }
+
+    // Cancels the commands outstanding right now that haven't finished by
+    // the end of the grace period. Commands started later aren't affected.
+    void CancelPendingCommands();
+
+    // Stops background work and holds new commands until Resume, and
+    // cancels outstanding commands after the grace period
+    void Suspend();
+
+    // Restarts work after Suspend, and calls off any pending cancellation
+    void Resume();
+
+    // True while a cancellation is waiting on its grace period, Update has
+    // to keep being called until then
+    bool HasPendingCancellation() const { return mCancelDeadline.has_value(); }
+
+    const LifecycleStats &GetLifecycleStats() const { return mLifecycleStats; }
+
+    // Results of the most recently finished commands, oldest first
+    const std::deque<CommandResult> &GetRecentResults() const { return mRecentResults; }
+
+    // Nonce format to use with servers that accept it. Servers that don't
+    // list the nonce formats they accept are only sent hex nonces.
+    void SetPreferredNonceFormat(NonceCodec::NonceFormat format) {
+        mPreferredNonceFormat = format;
+    }
+
+    // Format new nonces are generated in
+    NonceCodec::NonceFormat GetNonceFormat() const;
+
+    // When enabled, a nonce session is kept with the server and integrity
+    // commands make up their own randoms from it, instead of waiting on
+    // /getRandom. Commands fall back to server randoms while there is no
+    // session.
+    void SetNonceSessionEnabled(bool enabled) { mUseNonceSession = enabled; }
+
+    const NonceSession::Stats &GetNonceSessionStats() const { return mNonceSession.GetStats(); }
+
+    void SetSpeculationConfig(const SpeculativeTokenCache::Config &config) {
+        mSpeculativeTokens.SetConfig(config);
+    }
 
     ServerOperationResult GetOperationResult() const { return mResult; }
 
+    const TokenPoolStats &GetRandomPoolStats() const { return mRandomPool.GetStats(); }
+
+    const TokenPoolStats &GetExpressTokenPoolStats() const {
+        return mExpressTokenPool.GetStats();
+    }
+
+    size_t GetExpressTokenCount() const { return mExpressTokenPool.GetCount(); }
+
+    const CommandPathPolicy::Stats &GetPathPolicyStats() const { return mPathPolicy.GetStats(); }
+
+    const SpeculativeTokenCache::Stats &GetSpeculationStats() const {
+        return mSpeculativeTokens.GetStats();
+    }
+
+    // Number of commands somewhere between being started and their result
+    size_t GetCommandsInFlight() const {
+        return mScheduler.GetQueuedCount() + mPipeline.GetInFlightCount();
+    }
+
+    size_t GetPipelineStageCount() const { return mPipeline.GetStageCount(); }
+
+    const char *GetPipelineStageName(size_t stageIndex) const {
+        return mPipeline.GetStageName(stageIndex);
+    }
+
+    const PipelineStageStats &GetPipelineStageStats(size_t stageIndex) const {
+        return mPipeline.GetStageStats(stageIndex);
+    }
+
     void Update();
 
 private:
-    void CleanupRequest();
+    // A command on its way through the command pipeline
+    struct PendingCommand {
+        PendingCommand();
 
-    void SendCommandToServer(const std::string &token);
+        ~PendingCommand();
 
-    bool ParseRandom(const std::string &randomJson);
+        void CleanupRequest();
+
+        bool IsBatch() const { return !mBatchCommands.empty(); }
 
-    void GenerateNonce();
+        bool HasToken() const { return !mToken.empty() || !mExpressToken.IsEmpty(); }
 
-    void ParseResult(const std::string &resultJson);
+        // The integrity or express token the command is sent with
+        std::string_view GetToken() const {
+            return mExpressToken.IsEmpty() ? std::string_view(mToken) : mExpressToken.GetView();
+        }
 
-    enum ClientManagerStatus {
-        CLIENT_MANAGER_IDLE = 0,
-        CLIENT_MANAGER_REQUEST_TOKEN,
-        CLIENT_MANAGER_RESPONSE_AVAILABLE
+        uint64_t mId;
+        CommandPriority mPriority;
+        std::string mCommand;
+        // Commands sent together under one token, in order, empty unless batched
+        std::vector<std::string> mBatchCommands;
+        // Ids the server performs the command, or each batched command, once
+        // by, however many times it is sent. Kept with journaled commands so
+        // a replay of a command the server did perform isn't performed again.
+        RequestIdString mRequestId;
+        std::vector<RequestIdString> mBatchRequestIds;
+        // Number of requests waiting on the command, or on each batched command
+        uint32_t mRequestCount;
+        std::vector<uint32_t> mBatchRequestCounts;
+        CommandPathPolicy::CommandPath mPath;
+        RandomString mRandom;
+        // Nonce session, counter and time the random was made from, the
+        // counter is zero if the random came from the server
+        SessionIdString mNonceSessionId;
+        uint64_t mNonceCounter;
+        int64_t mNonceTime;
+        NonceString mNonce;
+        // Integrity token the command is sent with, the one value on the
+        // command's way out without a size limit
+        std::string mToken;
+        // Express token the command is sent with, and the time it was issued
+        ExpressTokenString mExpressToken;
+        float mExpressTokenIssueTime;
+        // Journal entries the command is a replay of, one per command (or
+        // batched command), empty if it isn't a replay
+        std::vector<uint64_t> mJournalIds;
+        IntegrityTokenRequest *mTokenRequest;
+        IntegrityTokenResponse *mTokenResponse;
+        // Time the random behind a token request adopted from the
+        // speculative cache expires, zero for requests the command made
+        float mTokenExpireTime;
+        std::string mResponseBody;
+        float mSendTime;
+        ServerOperationResult mResult;
+        std::string mSummary;
+        // Express token the server issued with the result
+        ExpressTokenString mIssuedExpressToken;
+        std::vector<CommandResult> mResults;
+        PipelineTiming mTiming;
     };
 
+    typedef StagedPipeline<PendingCommand> CommandPipeline;
+
+    typedef CommandScheduler<PendingCommand> CommandQueue;
+
+    float CurrentTime() const { return mContext.mClock(); }
+
+    void SetupPipeline();
+
+    // Returns whether the rate limits let a command through, the caller
+    // takes the tokens once the command is enqueued
+    bool CheckRateLimit(CommandPriority priority, uint32_t endpoints);
+
+    CommandQueueResult SubmitCommand(std::unique_ptr<PendingCommand> command);
+
+    void DispatchCommands();
+
+    bool CoalesceCommand(const std::string &command);
+
+    CommandQueueResult AddToBatch(const std::string &command, CommandPriority priority);
+
+    CommandQueueResult FlushBatch();
+
+    static void UnbatchSingleCommand(PendingCommand &command);
+
+    void UpdateJournal(PendingCommand &command);
+
+    void ReplayJournal();
+
+    void RecordResults(PendingCommand &command);
+
+    CommandPipeline::StageStatus RandomStage(PendingCommand &command, float currentTime);
+
+    CommandPipeline::StageStatus NonceStage(PendingCommand &command, float currentTime);
+
+    CommandPipeline::StageStatus TokenStage(PendingCommand &command, float currentTime);
+
+    CommandPipeline::StageStatus SendStage(PendingCommand &command, float currentTime);
+
+    void WriteCommandPayload(JsonWriter &writer, const PendingCommand &command,
+                             size_t expressTokenCount, bool requestNextRandom) const;
+
+    CommandPipeline::StageStatus ParseStage(PendingCommand &command, float currentTime);
+
+    void CompleteCommand(std::unique_ptr<PendingCommand> command);
+
+    void UpdateCancellation();
+
+    void CancelCommand(std::unique_ptr<PendingCommand> command);
+
+    bool ParseRandom(const std::string &randomJson);
+
+    std::optional<RandomString> FetchRandom(ServerOperationResult *errorResult);
+
+    void RefillRandomPool();
+
+    void RenewNonceSession();
+
+    void StartSpeculativeRequests();
+
+    // Hex SHA-256 of a command from the compile time table or the cache, or null
+    const Sha256HexDigest *FindCommandHash(const std::string &command);
+
+    // Writes the hex SHA-256 of a command, from the compile time table or
+    // the cache if possible, SHA256_HEX_LENGTH characters
+    void HashCommand(const std::string &command, char *hashHex);
+
+    static void ComputeHash(std::string_view data, char *hashHex);
+
+    NonceString GenerateNonce(const RandomString &random, const std::string &command);
+
+    NonceString GenerateBatchNonce(const RandomString &random,
+                                   const std::vector<std::string> &commands);
+
+    void ParseResult(PendingCommand &command);
+
+    bool ParseCommandResult(const JsonLookup &jsonLookup, float sendTime,
+                            CommandResult &result, ExpressTokenString &expressToken);
+
+    ClientContext mContext;
     ServerOperationResult mResult;
-    ClientManagerStatus mStatus;
-    std::string mCurrentExpressToken;
-    std::string mCurrentNonce;
-    std::string mCurrentRandom;
+    CommandQueue mScheduler;
+    CommandPipeline mPipeline;
+    RateLimiter mRateLimiter;
+    float mRetryAfter;
+    NetworkScheduler mNetworkScheduler;
+    uint64_t mNextCommandId;
+    float mBatchWindow;
+    std::unique_ptr<PendingCommand> mOpenBatch;
+    float mBatchOpenTime;
+    std::deque<CommandResult> mRecentResults;
+    CommandJournal mJournal;
+    CommandHashCache mCommandHashCache;
+    // False after a network error, until the server is heard from again
+    bool mServerReachable;
+    float mLastJournalReplay;
+    float mCancellationGracePeriod;
+    // Commands with an id below mCancelBeforeId are cancelled at mCancelDeadline
+    std::optional<float> mCancelDeadline;
+    uint64_t mCancelBeforeId;
+    bool mSuspended;
+    LifecycleStats mLifecycleStats;
+    bool mCoalesceCommands;
+    uint64_t mCoalescedCommandCount;
+    NonceCodec::NonceFormat mPreferredNonceFormat;
+    // Bit per nonce format the server accepts
+    uint32_t mServerNonceFormats;
+    NonceSession mNonceSession;
+    bool mUseNonceSession;
+    float mLastNonceSessionFetch;
+    TokenPool<RandomString> mRandomPool;
+    float mLastRandomPoolFetch;
+    TokenPool<ExpressTokenString> mExpressTokenPool;
+    SpeculativeTokenCache mSpeculativeTokens;
+    std::vector<std::string> mPredictedCommands;
+    CommandPathPolicy mPathPolicy;
+    std::optional<float> mLastVerdictTime;
+    ExpressTokenString mCurrentExpressToken;
+    NonceString mCurrentNonce;
+    RandomString mCurrentRandom;
     std::string mCurrentSummary;
+    // Holds the JSON of the command being sent, kept between commands so
+    // it only grows when a payload is bigger than any before it
+    std::string mPayloadBuffer;
     bool mInitialized;
     bool mValidRandom;
-    bool mValidExpressToken;
-    IntegrityTokenRequest *mTokenRequest;
-    IntegrityTokenResponse *mTokenResponse;
 };
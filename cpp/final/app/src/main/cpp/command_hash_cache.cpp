@@ -0,0 +1,167 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "command_hash_cache.hpp"
+
+#include <cstring>
+
+CommandHashCache::CommandHashCache() {
+    mStats = {};
+    Clear();
+}
+
+const Sha256HexDigest *CommandHashCache::Find(std::string_view command) {
+    const size_t slot = FindSlot(command, Fingerprint(command));
+    if (slot == INDEX_SIZE) {
+        ++mStats.misses;
+        return nullptr;
+    }
+    ++mStats.hits;
+    const uint16_t entryIndex = mIndex[slot];
+    if (entryIndex != mHead) {
+        Unlink(entryIndex);
+        PushFront(entryIndex);
+    }
+    return &mEntries[entryIndex].mHashHex;
+}
+
+void CommandHashCache::Insert(std::string_view command, const Sha256HexDigest &hashHex) {
+    if (command.size() > MAX_COMMAND_LENGTH) {
+        ++mStats.uncacheable;
+        return;
+    }
+    const uint64_t fingerprint = Fingerprint(command);
+    const size_t existingSlot = FindSlot(command, fingerprint);
+    if (existingSlot != INDEX_SIZE) {
+        const uint16_t entryIndex = mIndex[existingSlot];
+        mEntries[entryIndex].mHashHex = hashHex;
+        if (entryIndex != mHead) {
+            Unlink(entryIndex);
+            PushFront(entryIndex);
+        }
+        return;
+    }
+
+    uint16_t entryIndex = 0;
+    if (mCount == CAPACITY) {
+        entryIndex = mTail;
+        RemoveSlot(FindSlot(entryIndex));
+        Unlink(entryIndex);
+        ++mStats.evictions;
+    } else {
+        entryIndex = static_cast<uint16_t>(mCount++);
+    }
+    Entry &entry = mEntries[entryIndex];
+    entry.mFingerprint = fingerprint;
+    entry.mLength = static_cast<uint16_t>(command.size());
+    memcpy(entry.mCommand, command.data(), command.size());
+    entry.mHashHex = hashHex;
+    PushFront(entryIndex);
+
+    size_t slot = fingerprint & INDEX_MASK;
+    while (mIndex[slot] != NO_ENTRY) {
+        slot = (slot + 1) & INDEX_MASK;
+    }
+    mIndex[slot] = entryIndex;
+    ++mStats.insertions;
+}
+
+void CommandHashCache::Clear() {
+    for (uint16_t &slot : mIndex) {
+        slot = NO_ENTRY;
+    }
+    mHead = NO_ENTRY;
+    mTail = NO_ENTRY;
+    mCount = 0;
+}
+
+float CommandHashCache::GetHitRate() const {
+    const uint64_t lookups = mStats.hits + mStats.misses;
+    return lookups > 0 ? static_cast<float>(mStats.hits) / lookups : 0.0f;
+}
+
+uint64_t CommandHashCache::Fingerprint(std::string_view command) {
+    // FNV-1a, only used to pick index slots and skip most mismatches
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : command) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+size_t CommandHashCache::FindSlot(std::string_view command, uint64_t fingerprint) const {
+    size_t slot = fingerprint & INDEX_MASK;
+    while (mIndex[slot] != NO_ENTRY) {
+        const Entry &entry = mEntries[mIndex[slot]];
+        if (entry.mFingerprint == fingerprint && entry.mLength == command.size() &&
+                memcmp(entry.mCommand, command.data(), command.size()) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & INDEX_MASK;
+    }
+    return INDEX_SIZE;
+}
+
+size_t CommandHashCache::FindSlot(uint16_t entryIndex) const {
+    size_t slot = mEntries[entryIndex].mFingerprint & INDEX_MASK;
+    while (mIndex[slot] != entryIndex) {
+        slot = (slot + 1) & INDEX_MASK;
+    }
+    return slot;
+}
+
+void CommandHashCache::RemoveSlot(size_t slot) {
+    // Shift later entries of the probe sequence back into the hole, so
+    // lookups never stop early at an empty slot
+    size_t hole = slot;
+    size_t next = (slot + 1) & INDEX_MASK;
+    while (mIndex[next] != NO_ENTRY) {
+        const size_t home = mEntries[mIndex[next]].mFingerprint & INDEX_MASK;
+        if (((next - home) & INDEX_MASK) >= ((next - hole) & INDEX_MASK)) {
+            mIndex[hole] = mIndex[next];
+            hole = next;
+        }
+        next = (next + 1) & INDEX_MASK;
+    }
+    mIndex[hole] = NO_ENTRY;
+}
+
+void CommandHashCache::Unlink(uint16_t entryIndex) {
+    Entry &entry = mEntries[entryIndex];
+    if (entry.mPrev != NO_ENTRY) {
+        mEntries[entry.mPrev].mNext = entry.mNext;
+    } else {
+        mHead = entry.mNext;
+    }
+    if (entry.mNext != NO_ENTRY) {
+        mEntries[entry.mNext].mPrev = entry.mPrev;
+    } else {
+        mTail = entry.mPrev;
+    }
+}
+
+void CommandHashCache::PushFront(uint16_t entryIndex) {
+    Entry &entry = mEntries[entryIndex];
+    entry.mPrev = NO_ENTRY;
+    entry.mNext = mHead;
+    if (mHead != NO_ENTRY) {
+        mEntries[mHead].mPrev = entryIndex;
+    } else {
+        mTail = entryIndex;
+    }
+    mHead = entryIndex;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "constexpr_sha256.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Least recently used cache of command hex SHA-256 hashes, so a command
+ * that is sent again and again is only hashed once. All storage is part
+ * of the object: commands are copied into fixed size slots, and found
+ * through an open addressed index, so lookups and inserts never allocate.
+ * Commands longer than a slot are not cached.
+ */
+class CommandHashCache {
+public:
+    // Most commands cached at once
+    static constexpr size_t CAPACITY = 64;
+    // Longest command that is cached, in bytes
+    static constexpr size_t MAX_COMMAND_LENGTH = 256;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        // Commands added, and commands pushed out to make room for them
+        uint64_t insertions;
+        uint64_t evictions;
+        // Commands too long to be cached
+        uint64_t uncacheable;
+    };
+
+    CommandHashCache();
+
+    CommandHashCache(const CommandHashCache &) = delete;
+
+    void operator=(const CommandHashCache &) = delete;
+
+    // Returns the cached hash of command and marks it most recently used,
+    // or returns null
+    const Sha256HexDigest *Find(std::string_view command);
+
+    // Caches the hash of command, replacing the least recently used
+    // command if the cache is full
+    void Insert(std::string_view command, const Sha256HexDigest &hashHex);
+
+    void Clear();
+
+    size_t GetSize() const { return mCount; }
+
+    const Stats &GetStats() const { return mStats; }
+
+    // Fraction of lookups that were hits, zero before the first lookup
+    float GetHitRate() const;
+
+private:
+    // The index has twice as many slots as there are entries, to keep
+    // probe sequences short
+    static constexpr size_t INDEX_SIZE = CAPACITY * 2;
+    static constexpr size_t INDEX_MASK = INDEX_SIZE - 1;
+    static constexpr uint16_t NO_ENTRY = 0xFFFF;
+
+    static_assert((INDEX_SIZE & INDEX_MASK) == 0, "Index size must be a power of two");
+    static_assert(CAPACITY < NO_ENTRY, "Entries are referenced by 16 bit indices");
+
+    struct Entry {
+        uint64_t mFingerprint;
+        // Neighbours in the recently used list, towards the most and least recent
+        uint16_t mPrev;
+        uint16_t mNext;
+        uint16_t mLength;
+        char mCommand[MAX_COMMAND_LENGTH];
+        Sha256HexDigest mHashHex;
+    };
+
+    static uint64_t Fingerprint(std::string_view command);
+
+    // Returns the index slot referencing command, or INDEX_SIZE if it isn't cached
+    size_t FindSlot(std::string_view command, uint64_t fingerprint) const;
+
+    // Returns the index slot referencing an entry
+    size_t FindSlot(uint16_t entryIndex) const;
+
+    void RemoveSlot(size_t slot);
+
+    void Unlink(uint16_t entryIndex);
+
+    void PushFront(uint16_t entryIndex);
+
+    Entry mEntries[CAPACITY];
+    uint16_t mIndex[INDEX_SIZE];
+    // Most and least recently used entries
+    uint16_t mHead;
+    uint16_t mTail;
+    size_t mCount;
+    Stats mStats;
+};
@@ -0,0 +1,331 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "logging.hpp"
+#include "command_journal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // Identifies a journal file, and the version of its layout
+    constexpr uint32_t JOURNAL_MAGIC = 0x4a434950; // 'PICJ'
+    constexpr uint32_t JOURNAL_VERSION = 3;
+    // Written last, marks a record as completely written
+    constexpr uint32_t RECORD_MAGIC = 0x52434950; // 'PICR'
+    constexpr uint32_t RECORD_TYPE_COMMAND = 1;
+    constexpr uint32_t RECORD_TYPE_DONE = 2;
+    // Records start on an 8 byte boundary
+    constexpr size_t RECORD_ALIGNMENT = 8;
+
+    struct JournalHeader {
+        uint32_t mMagic;
+        uint32_t mVersion;
+        // Generation of the live region, flipped last when compacting
+        uint32_t mGeneration;
+        uint32_t mReserved;
+    };
+
+    struct RecordHeader {
+        uint32_t mMagic;
+        uint32_t mType;
+        uint64_t mId;
+        int64_t mExpressTokenIssueTime;
+        uint32_t mCommandLength;
+        uint32_t mExpressTokenLength;
+        // Records left over from older generations are not read
+        uint32_t mGeneration;
+        // The payload is the command, then the request id, then the
+        // express token
+        uint32_t mRequestIdLength;
+    };
+
+    size_t AlignRecordSize(size_t size) {
+        return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+    }
+}
+
+CommandJournal::CommandJournal() {
+    mFile = -1;
+    mData = nullptr;
+    mCapacity = 0;
+    mRegionSize = 0;
+    mGeneration = 0;
+    mWriteOffset = 0;
+    mRegionEnd = 0;
+    mNextId = 1;
+    mStats = {};
+}
+
+CommandJournal::~CommandJournal() {
+    Close();
+}
+
+bool CommandJournal::Open(const std::string &path, size_t capacity) {
+    Close();
+    const size_t regionSize = ((capacity - std::min(capacity, sizeof(JournalHeader))) / 2) &
+                              ~(RECORD_ALIGNMENT - 1);
+    if (regionSize <= sizeof(RecordHeader)) {
+        return false;
+    }
+
+    mFile = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (mFile < 0) {
+        ALOGE("Failed to open command journal %s", path.c_str());
+        return false;
+    }
+    // Size the file up front, appends only ever touch the mapping
+    struct stat fileStat;
+    if (fstat(mFile, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) != capacity) {
+        if (ftruncate(mFile, capacity) != 0) {
+            ALOGE("Failed to size command journal %s", path.c_str());
+            Close();
+            return false;
+        }
+    }
+    void *mapping = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0);
+    if (mapping == MAP_FAILED) {
+        ALOGE("Failed to map command journal %s", path.c_str());
+        Close();
+        return false;
+    }
+    mData = static_cast<uint8_t *>(mapping);
+    mCapacity = capacity;
+    mRegionSize = regionSize;
+
+    JournalHeader *header = reinterpret_cast<JournalHeader *>(mData);
+    if (header->mMagic != JOURNAL_MAGIC || header->mVersion != JOURNAL_VERSION) {
+        // New file, or one we don't understand, start over
+        memset(mData, 0, mCapacity);
+        header->mMagic = JOURNAL_MAGIC;
+        header->mVersion = JOURNAL_VERSION;
+        header->mGeneration = 0;
+        mGeneration = 0;
+        mWriteOffset = GetRegionStart(mGeneration);
+        mRegionEnd = mWriteOffset + mRegionSize;
+    } else {
+        mGeneration = header->mGeneration;
+        LoadRecords();
+    }
+    return true;
+}
+
+void CommandJournal::Close() {
+    if (mData != nullptr) {
+        msync(mData, mCapacity, MS_ASYNC);
+        munmap(mData, mCapacity);
+        mData = nullptr;
+    }
+    if (mFile >= 0) {
+        close(mFile);
+        mFile = -1;
+    }
+    mCapacity = 0;
+    mRegionSize = 0;
+    mGeneration = 0;
+    mWriteOffset = 0;
+    mRegionEnd = 0;
+    mEntries.clear();
+}
+
+std::optional<uint64_t> CommandJournal::Append(const std::string &command,
+                                               const std::string &requestId,
+                                               const std::string &expressToken,
+                                               int64_t expressTokenIssueTime) {
+    if (!IsOpen()) {
+        return std::nullopt;
+    }
+    Entry entry = {mNextId, command, requestId, expressToken, expressTokenIssueTime, false};
+    if (!WriteCommandRecord(entry)) {
+        // Finished entries take up space until the journal is compacted
+        if (!Compact() || !WriteCommandRecord(entry)) {
+            ++mStats.dropped;
+            return std::nullopt;
+        }
+    }
+    ++mNextId;
+    ++mStats.appended;
+    mEntries.push_back(std::move(entry));
+    return mEntries.back().mId;
+}
+
+void CommandJournal::MarkDone(uint64_t id) {
+    auto iter = std::find_if(mEntries.begin(), mEntries.end(),
+                             [id](const Entry &entry) { return entry.mId == id; });
+    if (iter == mEntries.end()) {
+        return;
+    }
+    mEntries.erase(iter);
+    ++mStats.completed;
+    // Compacting leaves the entry out, which is just as good
+    if (!WriteDoneRecord(id) && !Compact()) {
+        ALOGE("Command journal entry %" PRIu64 " couldn't be marked done, it will be replayed "
+              "after a restart", id);
+    }
+}
+
+std::vector<CommandJournal::Entry> CommandJournal::TakeReplayEntries(size_t maxCount) {
+    std::vector<Entry> replayEntries;
+    for (Entry &entry : mEntries) {
+        if (replayEntries.size() >= maxCount) {
+            break;
+        }
+        if (!entry.mReplaying) {
+            entry.mReplaying = true;
+            replayEntries.push_back(entry);
+            ++mStats.replayed;
+        }
+    }
+    return replayEntries;
+}
+
+void CommandJournal::ReturnEntry(uint64_t id) {
+    for (Entry &entry : mEntries) {
+        if (entry.mId == id) {
+            entry.mReplaying = false;
+            break;
+        }
+    }
+}
+
+size_t CommandJournal::GetReplayableCount() const {
+    return std::count_if(mEntries.begin(), mEntries.end(),
+                         [](const Entry &entry) { return !entry.mReplaying; });
+}
+
+bool CommandJournal::WriteCommandRecord(const Entry &entry) {
+    return WriteRecord(RECORD_TYPE_COMMAND, entry);
+}
+
+bool CommandJournal::WriteDoneRecord(uint64_t id) {
+    return WriteRecord(RECORD_TYPE_DONE, {id, "", "", "", 0, false});
+}
+
+bool CommandJournal::WriteRecord(uint32_t type, const Entry &entry) {
+    const std::string &command = entry.mCommand;
+    const std::string &requestId = entry.mRequestId;
+    const std::string &expressToken = entry.mExpressToken;
+    const size_t recordSize = AlignRecordSize(
+            sizeof(RecordHeader) + command.size() + requestId.size() + expressToken.size());
+    if (mWriteOffset + recordSize > mRegionEnd) {
+        return false;
+    }
+
+    uint8_t *recordData = mData + mWriteOffset;
+    RecordHeader *header = reinterpret_cast<RecordHeader *>(recordData);
+    header->mMagic = 0;
+    header->mType = type;
+    header->mId = entry.mId;
+    header->mExpressTokenIssueTime = entry.mExpressTokenIssueTime;
+    header->mCommandLength = static_cast<uint32_t>(command.size());
+    header->mExpressTokenLength = static_cast<uint32_t>(expressToken.size());
+    header->mGeneration = mGeneration;
+    header->mRequestIdLength = static_cast<uint32_t>(requestId.size());
+    uint8_t *payload = recordData + sizeof(RecordHeader);
+    memcpy(payload, command.data(), command.size());
+    payload += command.size();
+    memcpy(payload, requestId.data(), requestId.size());
+    payload += requestId.size();
+    memcpy(payload, expressToken.data(), expressToken.size());
+    // Records of an older generation may follow this one, everything past
+    // the write offset is free, so clear the next header to be sure
+    // loading stops here
+    const size_t nextOffset = mWriteOffset + recordSize;
+    if (nextOffset + sizeof(RecordHeader) <= mRegionEnd) {
+        memset(mData + nextOffset, 0, sizeof(RecordHeader));
+    }
+    // The magic goes in last, so a record cut short by the app dying is
+    // never mistaken for a complete one
+    __atomic_store_n(&header->mMagic, RECORD_MAGIC, __ATOMIC_RELEASE);
+    mWriteOffset = nextOffset;
+    return true;
+}
+
+size_t CommandJournal::GetRegionStart(uint32_t generation) const {
+    return sizeof(JournalHeader) + (generation % 2) * mRegionSize;
+}
+
+void CommandJournal::LoadRecords() {
+    mEntries.clear();
+    size_t offset = GetRegionStart(mGeneration);
+    mRegionEnd = offset + mRegionSize;
+    while (offset + sizeof(RecordHeader) <= mRegionEnd) {
+        const RecordHeader *header = reinterpret_cast<const RecordHeader *>(mData + offset);
+        if (header->mMagic != RECORD_MAGIC || header->mGeneration != mGeneration) {
+            break;
+        }
+        const size_t payloadSize = size_t(header->mCommandLength) + header->mRequestIdLength +
+                                   header->mExpressTokenLength;
+        const size_t recordSize = AlignRecordSize(sizeof(RecordHeader) + payloadSize);
+        if (offset + recordSize > mRegionEnd) {
+            break;
+        }
+        const char *payload = reinterpret_cast<const char *>(mData + offset + sizeof(RecordHeader));
+        if (header->mType == RECORD_TYPE_COMMAND) {
+            mEntries.push_back({header->mId,
+                                std::string(payload, header->mCommandLength),
+                                std::string(payload + header->mCommandLength,
+                                            header->mRequestIdLength),
+                                std::string(payload + header->mCommandLength +
+                                            header->mRequestIdLength,
+                                            header->mExpressTokenLength),
+                                header->mExpressTokenIssueTime,
+                                false});
+        } else if (header->mType == RECORD_TYPE_DONE) {
+            const uint64_t doneId = header->mId;
+            mEntries.erase(std::remove_if(mEntries.begin(), mEntries.end(),
+                                          [doneId](const Entry &entry) {
+                                              return entry.mId == doneId;
+                                          }),
+                           mEntries.end());
+        }
+        mNextId = std::max(mNextId, header->mId + 1);
+        offset += recordSize;
+    }
+    mWriteOffset = offset;
+    ALOGI("Command journal loaded with %zu unfinished commands", mEntries.size());
+}
+
+bool CommandJournal::Compact() {
+    // Copy the unfinished entries into the other region as the next
+    // generation. The file header still names the live region until the
+    // copy is complete, so dying part way through loses nothing.
+    const uint32_t liveGeneration = mGeneration;
+    const size_t liveWriteOffset = mWriteOffset;
+    const size_t liveRegionEnd = mRegionEnd;
+    mGeneration = liveGeneration + 1;
+    mWriteOffset = GetRegionStart(mGeneration);
+    mRegionEnd = mWriteOffset + mRegionSize;
+    memset(mData + mWriteOffset, 0, sizeof(RecordHeader));
+    for (const Entry &entry : mEntries) {
+        if (!WriteCommandRecord(entry)) {
+            ALOGE("Command journal entries don't fit in a region, not compacting");
+            mGeneration = liveGeneration;
+            mWriteOffset = liveWriteOffset;
+            mRegionEnd = liveRegionEnd;
+            return false;
+        }
+    }
+    JournalHeader *header = reinterpret_cast<JournalHeader *>(mData);
+    __atomic_store_n(&header->mGeneration, mGeneration, __ATOMIC_RELEASE);
+    ++mStats.compactions;
+    return true;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+ * Append-only journal of commands that couldn't reach the server, kept in
+ * a memory-mapped file so they survive the app being closed. Appending is
+ * a copy into the mapping, the kernel writes it back to the file in its
+ * own time. Finished entries are marked with a small done record.
+ *
+ * The file holds two regions, only one of them live. When the live one
+ * fills up, the unfinished entries are copied into the other one and the
+ * generation in the file header is flipped to make it live. The live
+ * region is never written over, so the app dying while compacting loses
+ * nothing, the copy is just ignored.
+ */
+class CommandJournal {
+public:
+    struct Entry {
+        uint64_t mId;
+        std::string mCommand;
+        // Id the server knows the command by, it performs a command only
+        // once however many times it is sent
+        std::string mRequestId;
+        // Express token the command was sent with, empty for integrity commands
+        std::string mExpressToken;
+        // Wall clock time (seconds since the epoch) the express token was issued
+        int64_t mExpressTokenIssueTime;
+        // Entry has been handed out for replay and hasn't come back yet
+        bool mReplaying;
+    };
+
+    struct Stats {
+        // Entries written to the journal
+        uint64_t appended;
+        // Entries marked done
+        uint64_t completed;
+        // Entries handed out for replay
+        uint64_t replayed;
+        // Entries that didn't fit in the journal, even after compacting
+        uint64_t dropped;
+        uint64_t compactions;
+    };
+
+    CommandJournal();
+
+    ~CommandJournal();
+
+    CommandJournal(const CommandJournal &) = delete;
+
+    void operator=(const CommandJournal &) = delete;
+
+    /**
+     * Opens or creates the journal file and loads its unfinished entries.
+     *
+     * @param path Path of the journal file.
+     * @param capacity Size of the journal file in bytes.
+     * @return true if the journal can be used.
+     */
+    bool Open(const std::string &path, size_t capacity);
+
+    void Close();
+
+    bool IsOpen() const { return mData != nullptr; }
+
+    // Records a command, returns its entry id or nothing if it wasn't recorded
+    std::optional<uint64_t> Append(const std::string &command, const std::string &requestId,
+                                   const std::string &expressToken,
+                                   int64_t expressTokenIssueTime);
+
+    // Records that an entry no longer needs to be replayed
+    void MarkDone(uint64_t id);
+
+    // Hands out up to maxCount unfinished entries, oldest first, for replay
+    std::vector<Entry> TakeReplayEntries(size_t maxCount);
+
+    // Makes an entry handed out for replay available for replay again
+    void ReturnEntry(uint64_t id);
+
+    // Number of unfinished entries not currently handed out for replay
+    size_t GetReplayableCount() const;
+
+    size_t GetPendingCount() const { return mEntries.size(); }
+
+    const Stats &GetStats() const { return mStats; }
+
+private:
+    bool WriteCommandRecord(const Entry &entry);
+
+    bool WriteDoneRecord(uint64_t id);
+
+    bool WriteRecord(uint32_t type, const Entry &entry);
+
+    size_t GetRegionStart(uint32_t generation) const;
+
+    void LoadRecords();
+
+    // Returns false, leaving the live region as it was, if the unfinished
+    // entries don't fit in the other region
+    bool Compact();
+
+    int mFile;
+    uint8_t *mData;
+    size_t mCapacity;
+    size_t mRegionSize;
+    // The generation being written, its parity picks the region
+    uint32_t mGeneration;
+    size_t mWriteOffset;
+    size_t mRegionEnd;
+    uint64_t mNextId;
+    std::vector<Entry> mEntries;
+    Stats mStats;
+};
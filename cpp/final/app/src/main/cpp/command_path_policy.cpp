@@ -0,0 +1,69 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "command_path_policy.hpp"
+
+CommandPathPolicy::CommandPathPolicy(const Config &config) {
+    mConfig = config;
+    mStats = {};
+}
+
+CommandPathPolicy::CommandPath CommandPathPolicy::SelectPath(CommandSensitivity sensitivity,
+                                                             std::optional<float> expressTokenAge,
+                                                             std::optional<float> verdictAge,
+                                                             bool integrityTokenReady) {
+    if (!expressTokenAge) {
+        return Decide(sensitivity, COMMAND_PATH_INTEGRITY, DECISION_NO_EXPRESS_TOKEN);
+    }
+    if (*expressTokenAge > mConfig.maxExpressTokenAge[sensitivity]) {
+        return Decide(sensitivity, COMMAND_PATH_INTEGRITY, DECISION_EXPRESS_TOKEN_TOO_OLD);
+    }
+    if (!verdictAge || *verdictAge > mConfig.maxVerdictAge[sensitivity]) {
+        return Decide(sensitivity, COMMAND_PATH_INTEGRITY, DECISION_VERDICT_TOO_OLD);
+    }
+
+    // Both paths are acceptable, compare their expected cost. A ready integrity
+    // token leaves only the command round trip, the same work as the express
+    // path. Ties go to the integrity path since it refreshes the verdict.
+    if (!integrityTokenReady && mStats.latency[COMMAND_PATH_INTEGRITY] <= 0.0f) {
+        // Choosing express now would mean integrity is never measured
+        return Decide(sensitivity, COMMAND_PATH_INTEGRITY, DECISION_INTEGRITY_UNMEASURED);
+    }
+    const float expressLatency = mStats.latency[COMMAND_PATH_EXPRESS];
+    const float integrityLatency = integrityTokenReady ?
+            expressLatency : mStats.latency[COMMAND_PATH_INTEGRITY];
+    if (integrityLatency <= expressLatency) {
+        return Decide(sensitivity, COMMAND_PATH_INTEGRITY, DECISION_INTEGRITY_FASTER);
+    }
+    return Decide(sensitivity, COMMAND_PATH_EXPRESS, DECISION_EXPRESS_FASTER);
+}
+
+void CommandPathPolicy::RecordLatency(CommandPath path, float latency) {
+    float &averageLatency = mStats.latency[path];
+    if (averageLatency <= 0.0f) {
+        averageLatency = latency;
+    } else {
+        averageLatency += mConfig.latencySmoothing * (latency - averageLatency);
+    }
+}
+
+CommandPathPolicy::CommandPath CommandPathPolicy::Decide(CommandSensitivity sensitivity,
+                                                         CommandPath path,
+                                                         DecisionReason reason) {
+    ++mStats.decisions[sensitivity][path];
+    ++mStats.reasons[reason];
+    return path;
+}
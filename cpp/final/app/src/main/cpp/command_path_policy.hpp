@@ -0,0 +1,110 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+/*
+ * Picks whether a command is sent with a full Play Integrity check or
+ * with an express token. Express is only acceptable while the token and
+ * the verdict that earned it are recent enough for the command's
+ * sensitivity, and is then chosen if it is expected to be faster.
+ */
+class CommandPathPolicy {
+public:
+    enum CommandSensitivity {
+        // Commands where a verdict from a while ago is good enough
+        COMMAND_SENSITIVITY_LOW = 0,
+        // Commands that want a reasonably recent verdict
+        COMMAND_SENSITIVITY_NORMAL,
+        // Commands that always require a fresh integrity check
+        COMMAND_SENSITIVITY_HIGH,
+        COMMAND_SENSITIVITY_COUNT
+    };
+
+    enum CommandPath {
+        COMMAND_PATH_INTEGRITY = 0,
+        COMMAND_PATH_EXPRESS,
+        COMMAND_PATH_COUNT
+    };
+
+    enum DecisionReason {
+        // Express token was acceptable and expected to be faster
+        DECISION_EXPRESS_FASTER = 0,
+        // Integrity path expected to be at least as fast as express
+        DECISION_INTEGRITY_FASTER,
+        // No express token was available
+        DECISION_NO_EXPRESS_TOKEN,
+        // Express token too old for the command's sensitivity
+        DECISION_EXPRESS_TOKEN_TOO_OLD,
+        // Last integrity verdict too old for the command's sensitivity
+        DECISION_VERDICT_TOO_OLD,
+        // Integrity path latency not measured yet, so it can't be compared
+        DECISION_INTEGRITY_UNMEASURED,
+        DECISION_REASON_COUNT
+    };
+
+    struct Config {
+        // Oldest express token accepted, in seconds, per sensitivity class
+        float maxExpressTokenAge[COMMAND_SENSITIVITY_COUNT];
+        // Oldest verdict accepted for the express path, in seconds, per sensitivity class
+        float maxVerdictAge[COMMAND_SENSITIVITY_COUNT];
+        // Weight of the newest sample in the latency moving averages
+        float latencySmoothing;
+    };
+
+    struct Stats {
+        // Decisions made for each path, per sensitivity class
+        uint64_t decisions[COMMAND_SENSITIVITY_COUNT][COMMAND_PATH_COUNT];
+        // Number of decisions made for each reason
+        uint64_t reasons[DECISION_REASON_COUNT];
+        // Smoothed observed latency of each path in seconds, zero until measured
+        float latency[COMMAND_PATH_COUNT];
+    };
+
+    explicit CommandPathPolicy(const Config &config);
+
+    void SetConfig(const Config &config) { mConfig = config; }
+
+    const Config &GetConfig() const { return mConfig; }
+
+    const Stats &GetStats() const { return mStats; }
+
+    /**
+     * Selects the path for a command.
+     *
+     * @param sensitivity The sensitivity class of the command.
+     * @param expressTokenAge Age of the express token that would be used, if any.
+     * @param verdictAge Time since the last successful integrity verdict, if any.
+     * @param integrityTokenReady True if an integrity token for the command is
+     * already available, so the integrity path only costs the command round trip.
+     */
+    CommandPath SelectPath(CommandSensitivity sensitivity,
+                           std::optional<float> expressTokenAge,
+                           std::optional<float> verdictAge,
+                           bool integrityTokenReady);
+
+    // Records how long a command sent on path took from start to result
+    void RecordLatency(CommandPath path, float latency);
+
+private:
+    CommandPath Decide(CommandSensitivity sensitivity, CommandPath path, DecisionReason reason);
+
+    Config mConfig;
+    Stats mStats;
+};
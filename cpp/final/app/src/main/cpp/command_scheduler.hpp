@@ -0,0 +1,322 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ring_buffer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum CommandPriority {
+    // Commands the user is waiting on, like a button press
+    COMMAND_PRIORITY_INTERACTIVE = 0,
+    // Game commands nobody is actively waiting on
+    COMMAND_PRIORITY_NORMAL,
+    // Telemetry and other work that can wait
+    COMMAND_PRIORITY_BACKGROUND,
+    COMMAND_PRIORITY_COUNT
+};
+
+// What happens to a command submitted while its class's queue is full
+enum CommandQueuePolicy {
+    // The oldest queued command of the class is dropped to make room
+    COMMAND_QUEUE_POLICY_DROP_OLDEST = 0,
+    // The submitted command is dropped
+    COMMAND_QUEUE_POLICY_DROP_NEWEST,
+    // The submitted command is handed back to the caller
+    COMMAND_QUEUE_POLICY_REJECT
+};
+
+enum CommandQueueResult {
+    // The command was queued
+    COMMAND_QUEUE_ACCEPTED = 0,
+    // The command was queued, but its class's queue is filling up and the
+    // caller should slow down
+    COMMAND_QUEUE_NEAR_FULL,
+    // The command was queued in place of the oldest queued command of its class
+    COMMAND_QUEUE_DROPPED_OLDEST,
+    // The queue was full and the command was dropped
+    COMMAND_QUEUE_DROPPED,
+    // The queue was full and the command was not accepted
+    COMMAND_QUEUE_REJECTED,
+    // Commands were started too quickly and the command was not accepted
+    COMMAND_QUEUE_RATE_LIMITED
+};
+
+struct CommandSchedulerConfig {
+    // Relative share of dispatches for each class while several have work queued
+    float weight[COMMAND_PRIORITY_COUNT];
+    // Most commands of each class dispatched and not yet completed
+    size_t maxActive[COMMAND_PRIORITY_COUNT];
+    // Queue wait in seconds after which a class's oldest command jumps
+    // the weighted order, zero or less disables starvation protection
+    float maxWait[COMMAND_PRIORITY_COUNT];
+    // Most commands of each class waiting to be dispatched. Changes take
+    // effect the next time the class's queue is empty.
+    size_t queueCapacity[COMMAND_PRIORITY_COUNT];
+    // What to do with commands submitted while a class's queue is full
+    CommandQueuePolicy queuePolicy[COMMAND_PRIORITY_COUNT];
+    // Fraction of a queue's capacity at which submitters are told to slow down
+    float pressureThreshold;
+};
+
+struct CommandSchedulerStats {
+    // Commands dispatched from each class
+    uint64_t dispatched[COMMAND_PRIORITY_COUNT];
+    // Dispatches that jumped the weighted order because of starvation protection
+    uint64_t starvationDispatches[COMMAND_PRIORITY_COUNT];
+    // Total and worst time commands of each class spent queued
+    float totalWait[COMMAND_PRIORITY_COUNT];
+    float maxWait[COMMAND_PRIORITY_COUNT];
+    // Most commands of each class that were queued at once
+    size_t maxQueued[COMMAND_PRIORITY_COUNT];
+    // Commands of each class dropped or rejected because the queue was full
+    uint64_t dropped[COMMAND_PRIORITY_COUNT];
+    uint64_t rejected[COMMAND_PRIORITY_COUNT];
+};
+
+/*
+ * Decides the order commands are let into the command pipeline. Each
+ * priority class has its own queue, and classes with queued work share
+ * dispatches in proportion to their weights (start-time fair queuing),
+ * so background work makes progress without getting in the way of
+ * interactive commands. Each class is limited to a number of dispatched
+ * commands that haven't completed yet, and a command that has waited
+ * longer than its class allows is dispatched ahead of its turn.
+ *
+ * Each class's queue has a fixed capacity, allocated up front, and a
+ * policy for what to do with commands that don't fit.
+ */
+template<typename Item>
+class CommandScheduler {
+public:
+    typedef CommandSchedulerConfig Config;
+
+    typedef CommandSchedulerStats Stats;
+
+    explicit CommandScheduler(const Config &config) {
+        mConfig = config;
+        mStats = {};
+        for (size_t i = 0; i < COMMAND_PRIORITY_COUNT; ++i) {
+            mActive[i] = 0;
+            mHeld[i] = false;
+            mVirtualTime[i] = 0.0f;
+            mQueues[i].Reset(config.queueCapacity[i]);
+        }
+        mGlobalVirtualTime = 0.0f;
+    }
+
+    CommandScheduler(const CommandScheduler &) = delete;
+
+    void operator=(const CommandScheduler &) = delete;
+
+    void SetConfig(const Config &config) { mConfig = config; }
+
+    const Config &GetConfig() const { return mConfig; }
+
+    const Stats &GetStats() const { return mStats; }
+
+    /**
+     * Queues a command, subject to its class's queue capacity and policy.
+     *
+     * @param priority The priority class of the command.
+     * @param item The command. The scheduler takes it if it is queued, and
+     * hands back the dropped command in its place if the oldest one was
+     * dropped. A dropped or rejected command is left with the caller.
+     * @param currentTime Current time in seconds.
+     */
+    CommandQueueResult Enqueue(CommandPriority priority, std::unique_ptr<Item> &item,
+                               float currentTime) {
+        RingBuffer<QueuedItem> &queue = mQueues[priority];
+        if (queue.IsEmpty()) {
+            if (queue.GetCapacity() != mConfig.queueCapacity[priority]) {
+                queue.Reset(mConfig.queueCapacity[priority]);
+            }
+            // A class that had nothing queued starts from the current virtual
+            // time, it doesn't get to bank its idle time as credit
+            if (mVirtualTime[priority] < mGlobalVirtualTime) {
+                mVirtualTime[priority] = mGlobalVirtualTime;
+            }
+        }
+
+        CommandQueueResult result = COMMAND_QUEUE_ACCEPTED;
+        std::unique_ptr<Item> droppedItem;
+        if (queue.IsFull()) {
+            const CommandQueuePolicy policy = mConfig.queuePolicy[priority];
+            if (policy == COMMAND_QUEUE_POLICY_REJECT) {
+                ++mStats.rejected[priority];
+                return COMMAND_QUEUE_REJECTED;
+            }
+            ++mStats.dropped[priority];
+            if (policy == COMMAND_QUEUE_POLICY_DROP_NEWEST || queue.IsEmpty()) {
+                return COMMAND_QUEUE_DROPPED;
+            }
+            droppedItem = std::move(queue.PopFront().mItem);
+            result = COMMAND_QUEUE_DROPPED_OLDEST;
+        }
+        queue.PushBack({std::move(item), currentTime});
+        item = std::move(droppedItem);
+
+        const size_t queued = queue.GetSize();
+        if (queued > mStats.maxQueued[priority]) {
+            mStats.maxQueued[priority] = queued;
+        }
+        if (result == COMMAND_QUEUE_ACCEPTED &&
+                queued >= mConfig.pressureThreshold * queue.GetCapacity()) {
+            result = COMMAND_QUEUE_NEAR_FULL;
+        }
+        return result;
+    }
+
+    /**
+     * Takes the next command to send, if any class is allowed to send one.
+     * The caller must call OnComplete with the command's priority once the
+     * command is finished.
+     *
+     * @param currentTime Current time in seconds.
+     * @param priority Receives the priority class of the returned command.
+     * @return The command, or nullptr if nothing can be dispatched right now.
+     */
+    std::unique_ptr<Item> Dispatch(float currentTime, CommandPriority *priority) {
+        int selected = -1;
+        bool starved = false;
+        // Starved commands go first, oldest first
+        for (int i = 0; i < COMMAND_PRIORITY_COUNT; ++i) {
+            if (!CanDispatch(i) || mConfig.maxWait[i] <= 0.0f) {
+                continue;
+            }
+            const float enqueueTime = mQueues[i].Front().mEnqueueTime;
+            if ((currentTime - enqueueTime) >= mConfig.maxWait[i] &&
+                    (selected < 0 || enqueueTime < mQueues[selected].Front().mEnqueueTime)) {
+                selected = i;
+                starved = true;
+            }
+        }
+        // Otherwise the class furthest behind on its share, ties go to
+        // the more urgent class
+        if (selected < 0) {
+            for (int i = 0; i < COMMAND_PRIORITY_COUNT; ++i) {
+                if (CanDispatch(i) &&
+                        (selected < 0 || mVirtualTime[i] < mVirtualTime[selected])) {
+                    selected = i;
+                }
+            }
+        }
+        if (selected < 0) {
+            return nullptr;
+        }
+
+        QueuedItem queued = mQueues[selected].PopFront();
+        ++mActive[selected];
+        mGlobalVirtualTime = mVirtualTime[selected];
+        mVirtualTime[selected] += 1.0f / mConfig.weight[selected];
+
+        const float waitTime = currentTime - queued.mEnqueueTime;
+        ++mStats.dispatched[selected];
+        if (starved) {
+            ++mStats.starvationDispatches[selected];
+        }
+        mStats.totalWait[selected] += waitTime;
+        if (waitTime > mStats.maxWait[selected]) {
+            mStats.maxWait[selected] = waitTime;
+        }
+        *priority = static_cast<CommandPriority>(selected);
+        return std::move(queued.mItem);
+    }
+
+    // Holds back a class, its commands stay queued until it is released
+    void SetHeld(CommandPriority priority, bool held) { mHeld[priority] = held; }
+
+    // Frees the concurrency slot of a dispatched command
+    void OnComplete(CommandPriority priority) {
+        if (mActive[priority] > 0) {
+            --mActive[priority];
+        }
+    }
+
+    // Returns the first queued command that predicate accepts, or null
+    template<typename Predicate>
+    Item *FindItem(Predicate predicate) {
+        for (RingBuffer<QueuedItem> &queue : mQueues) {
+            for (size_t i = 0; i < queue.GetSize(); ++i) {
+                if (predicate(*queue[i].mItem)) {
+                    return queue[i].mItem.get();
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // Takes every queued command that predicate accepts out of the queues
+    template<typename Predicate>
+    std::vector<std::unique_ptr<Item>> RemoveIf(Predicate predicate) {
+        std::vector<std::unique_ptr<Item>> removed;
+        for (RingBuffer<QueuedItem> &queue : mQueues) {
+            // Cycle through the queue once, putting back what stays
+            const size_t count = queue.GetSize();
+            for (size_t i = 0; i < count; ++i) {
+                QueuedItem queued = queue.PopFront();
+                if (predicate(*queued.mItem)) {
+                    removed.push_back(std::move(queued.mItem));
+                } else {
+                    queue.PushBack(std::move(queued));
+                }
+            }
+        }
+        return removed;
+    }
+
+    // Drops every queued command, dispatched commands keep their slots
+    void Clear() {
+        for (RingBuffer<QueuedItem> &queue : mQueues) {
+            queue.Clear();
+        }
+    }
+
+    size_t GetQueuedCount(CommandPriority priority) const { return mQueues[priority].GetSize(); }
+
+    size_t GetQueuedCount() const {
+        size_t count = 0;
+        for (const RingBuffer<QueuedItem> &queue : mQueues) {
+            count += queue.GetSize();
+        }
+        return count;
+    }
+
+    size_t GetActiveCount(CommandPriority priority) const { return mActive[priority]; }
+
+private:
+    struct QueuedItem {
+        std::unique_ptr<Item> mItem;
+        float mEnqueueTime;
+    };
+
+    bool CanDispatch(int priority) const {
+        return !mHeld[priority] && !mQueues[priority].IsEmpty() &&
+                mActive[priority] < mConfig.maxActive[priority];
+    }
+
+    Config mConfig;
+    Stats mStats;
+    RingBuffer<QueuedItem> mQueues[COMMAND_PRIORITY_COUNT];
+    size_t mActive[COMMAND_PRIORITY_COUNT];
+    bool mHeld[COMMAND_PRIORITY_COUNT];
+    // Virtual time of each class, advanced by 1 / weight per dispatch
+    float mVirtualTime[COMMAND_PRIORITY_COUNT];
+    float mGlobalVirtualTime;
+};
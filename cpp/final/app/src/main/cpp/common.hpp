@@ -16,7 +16,6 @@
 
 #pragma once
 
-#include <android/log.h>
 #include <android/sensor.h>
 #include <errno.h>
 #include <cstring>
@@ -26,17 +25,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include "game-activity/native_app_glue/android_native_app_glue.h"
-
-#define LOG_TAG "PlayIntegritySample"
-
-#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);
-#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__);
-#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);
-#ifdef NDEBUG
-#define ALOGV(...)
-#else
-#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__);
-#endif
+#include "logging.hpp"
 
 #define ABORT_GAME { ALOGE("*** GAME ABORTING."); *((volatile char*)0) = 'a'; }
 #define DEBUG_BLIP ALOGI("[ BLIP ]: %s:%d", __FILE__, __LINE__)
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Size of a SHA-256 digest in bytes, and as a hex string
+constexpr size_t SHA256_DIGEST_SIZE = 32;
+constexpr size_t SHA256_HEX_LENGTH = SHA256_DIGEST_SIZE * 2;
+
+typedef std::array<uint8_t, SHA256_DIGEST_SIZE> Sha256Digest;
+
+// Lower case hex digest followed by a null, so data() is a C string
+typedef std::array<char, SHA256_HEX_LENGTH + 1> Sha256HexDigest;
+
+/*
+ * SHA-256 that can run at compile time, so the hash of a constant string
+ * costs nothing at run time. It is a plain implementation of FIPS 180-4,
+ * much slower than the accelerated run time code, so hash strings only
+ * known at run time with Sha256Batch. The constants are shared with it.
+ */
+class ConstexprSha256 {
+public:
+    // Size of the blocks the message is processed in, in bytes
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    static constexpr uint32_t INITIAL_STATE[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    static constexpr uint32_t ROUND_CONSTANTS[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+            0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+            0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+            0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+            0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+            0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+            0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+            0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+            0xc67178f2
+    };
+
+    static constexpr Sha256Digest Hash(std::string_view data) {
+        uint32_t state[8] = {};
+        for (size_t i = 0; i < 8; ++i) {
+            state[i] = INITIAL_STATE[i];
+        }
+        uint8_t block[BLOCK_SIZE] = {};
+        size_t offset = 0;
+        for (; offset + BLOCK_SIZE <= data.size(); offset += BLOCK_SIZE) {
+            for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+                block[i] = static_cast<uint8_t>(data[offset + i]);
+            }
+            Compress(state, block);
+        }
+
+        // Pad the rest with a 1 bit, then zeros up to the length in bits
+        // at the end of the last block
+        const size_t remaining = data.size() - offset;
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+            block[i] = i < remaining ? static_cast<uint8_t>(data[offset + i]) : 0;
+        }
+        block[remaining] = 0x80;
+        if (remaining >= BLOCK_SIZE - sizeof(uint64_t)) {
+            Compress(state, block);
+            for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+                block[i] = 0;
+            }
+        }
+        const uint64_t bitLength = static_cast<uint64_t>(data.size()) * 8;
+        for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+            block[BLOCK_SIZE - 1 - i] = static_cast<uint8_t>(bitLength >> (8 * i));
+        }
+        Compress(state, block);
+
+        Sha256Digest digest = {};
+        for (size_t i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+            digest[i] = static_cast<uint8_t>(state[i / 4] >> (24 - 8 * (i % 4)));
+        }
+        return digest;
+    }
+
+    static constexpr Sha256HexDigest ToHex(const Sha256Digest &digest) {
+        constexpr char hexTable[] = "0123456789abcdef";
+        Sha256HexDigest hex = {};
+        for (size_t i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+            hex[i * 2] = hexTable[(digest[i] >> 4) & 0xF];
+            hex[i * 2 + 1] = hexTable[digest[i] & 0xF];
+        }
+        hex[SHA256_HEX_LENGTH] = '\0';
+        return hex;
+    }
+
+    static constexpr Sha256HexDigest HashHex(std::string_view data) {
+        return ToHex(Hash(data));
+    }
+
+    // True if hex holds the digest written as expected
+    static constexpr bool HexEquals(const Sha256HexDigest &hex, std::string_view expected) {
+        return std::string_view(hex.data(), SHA256_HEX_LENGTH) == expected;
+    }
+
+private:
+
+    static constexpr uint32_t RotateRight(uint32_t value, int bits) {
+        return (value >> bits) | (value << (32 - bits));
+    }
+
+    static constexpr void Compress(uint32_t *state, const uint8_t *block) {
+        uint32_t schedule[64] = {};
+        for (size_t i = 0; i < 16; ++i) {
+            schedule[i] = (static_cast<uint32_t>(block[i * 4]) << 24) |
+                          (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+                          (static_cast<uint32_t>(block[i * 4 + 2]) << 8) |
+                          static_cast<uint32_t>(block[i * 4 + 3]);
+        }
+        for (size_t i = 16; i < 64; ++i) {
+            const uint32_t s0 = RotateRight(schedule[i - 15], 7) ^
+                                RotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+            const uint32_t s1 = RotateRight(schedule[i - 2], 17) ^
+                                RotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+            schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (size_t i = 0; i < 64; ++i) {
+            const uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+            const uint32_t choose = (e & f) ^ (~e & g);
+            const uint32_t temp1 = h + s1 + choose + ROUND_CONSTANTS[i] + schedule[i];
+            const uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+            const uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            const uint32_t temp2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+};
+
+// Known answers, as produced by OpenSSL, covering an empty input, a short
+// one, and the padding spilling into an extra block
+static_assert(ConstexprSha256::HexEquals(
+        ConstexprSha256::HashHex(""),
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+static_assert(ConstexprSha256::HexEquals(
+        ConstexprSha256::HashHex("abc"),
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+static_assert(ConstexprSha256::HexEquals(
+        ConstexprSha256::HashHex("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"),
+        "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a"));
+static_assert(ConstexprSha256::HexEquals(
+        ConstexprSha256::HashHex(
+                "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"),
+        "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb"));
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "cpu_features.hpp"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+#include <sys/auxv.h>
+#endif
+
+namespace {
+    CpuFeatures DetectCpuFeatures() {
+        CpuFeatures features = {};
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        bool osAvx = false;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            features.mSsse3 = (ecx & (1u << 9)) != 0;
+            features.mSse41 = (ecx & (1u << 19)) != 0;
+            // AVX registers are only usable if the OS saves them (OSXSAVE
+            // and AVX, then XCR0 bits for the SSE and AVX state)
+            if ((ecx & (1u << 27)) != 0 && (ecx & (1u << 28)) != 0) {
+                uint32_t xcr0Low = 0, xcr0High = 0;
+                __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+                osAvx = (xcr0Low & 0x6) == 0x6;
+            }
+        }
+        if (__get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            features.mAvx2 = osAvx && (ebx & (1u << 5)) != 0;
+            features.mShaNi = (ebx & (1u << 29)) != 0;
+        }
+#elif defined(__aarch64__)
+        // HWCAP_ASIMD and HWCAP_SHA2
+        const unsigned long hwcap = getauxval(AT_HWCAP);
+        features.mNeon = (hwcap & (1ul << 1)) != 0;
+        features.mArmv8Sha2 = (hwcap & (1ul << 6)) != 0;
+#elif defined(__arm__)
+        // HWCAP_NEON
+        features.mNeon = (getauxval(AT_HWCAP) & (1ul << 12)) != 0;
+#endif
+        return features;
+    }
+}
+
+const CpuFeatures &GetCpuFeatures() {
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
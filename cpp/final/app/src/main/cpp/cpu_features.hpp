@@ -0,0 +1,33 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+// Instruction set extensions the SIMD code can use, detected once at run
+// time. Extensions of other architectures are always false.
+struct CpuFeatures {
+    // x86
+    bool mSsse3;
+    bool mSse41;
+    bool mAvx2;
+    bool mShaNi;
+    // ARM
+    bool mNeon;
+    bool mArmv8Sha2;
+};
+
+const CpuFeatures &GetCpuFeatures();
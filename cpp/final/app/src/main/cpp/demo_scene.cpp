@@ -167,6 +167,11 @@ void DemoScene::OnInstall() {
 }
 
 void DemoScene::OnUninstall() {
+    // Work started by this scene isn't wanted once the scene is gone
+    ClientManager *clientManager = NativeEngine::GetInstance()->GetClientManager();
+    if (clientManager != NULL) {
+        clientManager->CancelPendingCommands();
+    }
 }
 
 void DemoScene::GenerateUI() {
@@ -180,6 +185,7 @@ void DemoScene::GenerateUI() {
 
     GenerateCommandIntegrity();
     GenerateCommandExpress();
+    GenerateCommandAutomatic();
     ShowSummary();
 }
 
@@ -194,16 +200,26 @@ void DemoScene::GenerateCommandIntegrity() {
 }
 
 void DemoScene::GenerateCommandExpress() {
-    const auto commandResult =
-            NativeEngine::GetInstance()->GetClientManager()->GetOperationResult();
+    ClientManager *clientManager = NativeEngine::GetInstance()->GetClientManager();
+    const auto commandResult = clientManager->GetOperationResult();
     if (commandResult != ClientManager::SERVER_OPERATION_PENDING &&
-            !mExpressToken.empty()) {
+            clientManager->GetExpressTokenCount() > 0) {
         if (ImGui::Button("Call server with express token")) {
             DoCommandExpress();
         }
     }
 }
 
+void DemoScene::GenerateCommandAutomatic() {
+    const auto commandResult =
+            NativeEngine::GetInstance()->GetClientManager()->GetOperationResult();
+    if (commandResult != ClientManager::SERVER_OPERATION_PENDING) {
+        if (ImGui::Button("Call server with automatic path selection")) {
+            DoCommandAutomatic();
+        }
+    }
+}
+
 void DemoScene::ShowSummary() {
     ClientManager *clientManager = NativeEngine::GetInstance()->GetClientManager();
     const auto commandResult = clientManager->GetOperationResult();
@@ -237,3 +253,9 @@ void DemoScene::DoCommandExpress() {
     mServerRandom = mExpressToken;
 }
 
+void DemoScene::DoCommandAutomatic() {
+    ClientManager *clientManager = NativeEngine::GetInstance()->GetClientManager();
+    clientManager->StartCommand(CommandPathPolicy::COMMAND_SENSITIVITY_NORMAL);
+    mServerRandom = clientManager->GetCurrentRandomString();
+}
+
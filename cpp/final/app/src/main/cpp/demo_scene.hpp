@@ -82,6 +82,8 @@ protected:
 
     void GenerateCommandExpress();
 
+    void GenerateCommandAutomatic();
+
     void ShowSummary();
 
     void DoRequestRandom();
@@ -90,6 +92,8 @@ protected:
 
     void DoCommandExpress();
 
+    void DoCommandAutomatic();
+
     void DisplaySummary();
 public:
     DemoScene();
@@ -0,0 +1,310 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "encoding.hpp"
+#include "cpu_features.hpp"
+#include "encoding_kernels.hpp"
+
+#include <array>
+#include <atomic>
+
+namespace {
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    constexpr char BASE64URL_ALPHABET[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    // Marks characters outside an alphabet in the decoding tables
+    constexpr uint8_t INVALID_VALUE = 0xFF;
+
+    typedef std::array<uint8_t, 256> DecodingTable;
+
+    constexpr DecodingTable MakeHexDecodingTable() {
+        DecodingTable table = {};
+        for (uint8_t &value : table) {
+            value = INVALID_VALUE;
+        }
+        for (uint8_t i = 0; i < 16; ++i) {
+            table[static_cast<uint8_t>(HEX_DIGITS[i])] = i;
+        }
+        for (uint8_t i = 10; i < 16; ++i) {
+            table['A' + i - 10] = i;
+        }
+        return table;
+    }
+
+    constexpr DecodingTable MakeBase64UrlDecodingTable() {
+        DecodingTable table = {};
+        for (uint8_t &value : table) {
+            value = INVALID_VALUE;
+        }
+        for (uint8_t i = 0; i < 64; ++i) {
+            table[static_cast<uint8_t>(BASE64URL_ALPHABET[i])] = i;
+        }
+        return table;
+    }
+
+    constexpr DecodingTable HEX_VALUES = MakeHexDecodingTable();
+    constexpr DecodingTable BASE64URL_VALUES = MakeBase64UrlDecodingTable();
+
+    // Kernels for the bulk of the input, null for scalar code only
+    struct Kernels {
+        size_t (*mHexEncode)(const uint8_t *data, size_t size, char *out);
+        size_t (*mHexDecode)(const char *hex, size_t length, uint8_t *out);
+        size_t (*mHexValidate)(const char *hex, size_t length);
+        size_t (*mBase64UrlEncode)(const uint8_t *data, size_t size, char *out);
+        size_t (*mBase64UrlDecode)(const char *text, size_t length, uint8_t *out);
+        size_t (*mBase64UrlValidate)(const char *text, size_t length);
+        size_t (*mJsonEscapeScan)(const char *text, size_t length);
+    };
+
+    constexpr Kernels KERNELS[Encoding::ENCODING_IMPLEMENTATION_COUNT] = {
+            {},
+#if ENCODING_KERNELS_X86
+            {HexEncodeSsse3, HexDecodeSsse3, HexValidateSsse3,
+             Base64UrlEncodeSsse3, Base64UrlDecodeSsse3, Base64UrlValidateSsse3,
+             JsonEscapeScanSsse3},
+            {HexEncodeAvx2, HexDecodeAvx2, HexValidateAvx2,
+             Base64UrlEncodeAvx2, Base64UrlDecodeAvx2, Base64UrlValidateAvx2,
+             JsonEscapeScanAvx2},
+#else
+            {},
+            {},
+#endif
+#if ENCODING_KERNELS_NEON
+            {HexEncodeNeon, HexDecodeNeon, HexValidateNeon,
+             Base64UrlEncodeNeon, Base64UrlDecodeNeon, Base64UrlValidateNeon,
+             JsonEscapeScanNeon},
+#else
+            {},
+#endif
+    };
+
+    Encoding::Implementation DetectImplementation() {
+        static const Encoding::Implementation PREFERENCE[] = {
+                Encoding::ENCODING_IMPLEMENTATION_AVX2,
+                Encoding::ENCODING_IMPLEMENTATION_SSSE3,
+                Encoding::ENCODING_IMPLEMENTATION_NEON
+        };
+        for (Encoding::Implementation implementation : PREFERENCE) {
+            if (Encoding::IsSupported(implementation)) {
+                return implementation;
+            }
+        }
+        return Encoding::ENCODING_IMPLEMENTATION_SCALAR;
+    }
+
+    std::atomic<Encoding::Implementation> &GetImplementationSetting() {
+        static std::atomic<Encoding::Implementation> implementation(DetectImplementation());
+        return implementation;
+    }
+
+    const Kernels &GetKernels() {
+        return KERNELS[GetImplementationSetting().load(std::memory_order_relaxed)];
+    }
+
+    bool IsValidBase64UrlLength(size_t length) {
+        // A single character left over can't hold a whole byte
+        return (length % 4) != 1;
+    }
+}
+
+void Encoding::HexEncode(const uint8_t *data, size_t size, char *out) {
+    const Kernels &kernels = GetKernels();
+    size_t i = kernels.mHexEncode != nullptr ? kernels.mHexEncode(data, size, out) : 0;
+    for (; i < size; ++i) {
+        out[i * 2] = HEX_DIGITS[data[i] >> 4];
+        out[i * 2 + 1] = HEX_DIGITS[data[i] & 0x0F];
+    }
+}
+
+std::string Encoding::HexEncode(const uint8_t *data, size_t size) {
+    std::string hex(GetHexEncodedLength(size), '\0');
+    HexEncode(data, size, &hex[0]);
+    return hex;
+}
+
+bool Encoding::HexDecode(std::string_view hex, uint8_t *out) {
+    if ((hex.size() % 2) != 0) {
+        return false;
+    }
+    const Kernels &kernels = GetKernels();
+    size_t i = kernels.mHexDecode != nullptr ? kernels.mHexDecode(hex.data(), hex.size(), out) : 0;
+    for (; i < hex.size(); i += 2) {
+        const uint8_t high = HEX_VALUES[static_cast<uint8_t>(hex[i])];
+        const uint8_t low = HEX_VALUES[static_cast<uint8_t>(hex[i + 1])];
+        if (high == INVALID_VALUE || low == INVALID_VALUE) {
+            return false;
+        }
+        out[i / 2] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+bool Encoding::IsHex(std::string_view text) {
+    if ((text.size() % 2) != 0) {
+        return false;
+    }
+    const Kernels &kernels = GetKernels();
+    size_t i = kernels.mHexValidate != nullptr ?
+            kernels.mHexValidate(text.data(), text.size()) : 0;
+    for (; i < text.size(); ++i) {
+        if (HEX_VALUES[static_cast<uint8_t>(text[i])] == INVALID_VALUE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t Encoding::Base64UrlEncode(const uint8_t *data, size_t size, char *out) {
+    const Kernels &kernels = GetKernels();
+    size_t i = kernels.mBase64UrlEncode != nullptr ? kernels.mBase64UrlEncode(data, size, out) : 0;
+    char *next = out + i / 3 * 4;
+    for (; i + 3 <= size; i += 3) {
+        const uint32_t group = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) |
+                               data[i + 2];
+        *next++ = BASE64URL_ALPHABET[(group >> 18) & 0x3F];
+        *next++ = BASE64URL_ALPHABET[(group >> 12) & 0x3F];
+        *next++ = BASE64URL_ALPHABET[(group >> 6) & 0x3F];
+        *next++ = BASE64URL_ALPHABET[group & 0x3F];
+    }
+    // One or two bytes left over become two or three characters
+    if (i < size) {
+        const uint32_t group = (uint32_t(data[i]) << 16) |
+                               (i + 1 < size ? uint32_t(data[i + 1]) << 8 : 0);
+        *next++ = BASE64URL_ALPHABET[(group >> 18) & 0x3F];
+        *next++ = BASE64URL_ALPHABET[(group >> 12) & 0x3F];
+        if (i + 1 < size) {
+            *next++ = BASE64URL_ALPHABET[(group >> 6) & 0x3F];
+        }
+    }
+    return next - out;
+}
+
+std::string Encoding::Base64UrlEncode(const uint8_t *data, size_t size) {
+    std::string text(GetBase64UrlEncodedLength(size), '\0');
+    Base64UrlEncode(data, size, &text[0]);
+    return text;
+}
+
+bool Encoding::Base64UrlDecode(std::string_view text, uint8_t *out) {
+    if (!IsValidBase64UrlLength(text.size())) {
+        return false;
+    }
+    const Kernels &kernels = GetKernels();
+    size_t i = kernels.mBase64UrlDecode != nullptr ?
+            kernels.mBase64UrlDecode(text.data(), text.size(), out) : 0;
+    uint8_t *next = out + i / 4 * 3;
+    uint32_t group = 0;
+    size_t groupLength = 0;
+    for (; i < text.size(); ++i) {
+        const uint8_t value = BASE64URL_VALUES[static_cast<uint8_t>(text[i])];
+        if (value == INVALID_VALUE) {
+            return false;
+        }
+        group = (group << 6) | value;
+        if (++groupLength == 4) {
+            *next++ = static_cast<uint8_t>(group >> 16);
+            *next++ = static_cast<uint8_t>(group >> 8);
+            *next++ = static_cast<uint8_t>(group);
+            group = 0;
+            groupLength = 0;
+        }
+    }
+    // Two or three characters left over hold one or two bytes
+    if (groupLength >= 2) {
+        group <<= 6 * (4 - groupLength);
+        *next++ = static_cast<uint8_t>(group >> 16);
+        if (groupLength == 3) {
+            *next++ = static_cast<uint8_t>(group >> 8);
+        }
+    }
+    return true;
+}
+
+bool Encoding::IsBase64Url(std::string_view text) {
+    if (!IsValidBase64UrlLength(text.size())) {
+        return false;
+    }
+    const Kernels &kernels = GetKernels();
+    size_t i = kernels.mBase64UrlValidate != nullptr ?
+            kernels.mBase64UrlValidate(text.data(), text.size()) : 0;
+    for (; i < text.size(); ++i) {
+        if (BASE64URL_VALUES[static_cast<uint8_t>(text[i])] == INVALID_VALUE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t Encoding::FindJsonEscape(std::string_view text) {
+    const Kernels &kernels = GetKernels();
+    size_t i = kernels.mJsonEscapeScan != nullptr ?
+            kernels.mJsonEscapeScan(text.data(), text.size()) : 0;
+    for (; i < text.size(); ++i) {
+        const uint8_t c = static_cast<uint8_t>(text[i]);
+        if (c < 0x20 || c == '"' || c == '\\') {
+            break;
+        }
+    }
+    return i;
+}
+
+Encoding::Implementation Encoding::GetImplementation() {
+    return GetImplementationSetting().load(std::memory_order_relaxed);
+}
+
+bool Encoding::SetImplementation(Implementation implementation) {
+    if (!IsSupported(implementation)) {
+        return false;
+    }
+    GetImplementationSetting().store(implementation, std::memory_order_relaxed);
+    return true;
+}
+
+bool Encoding::IsSupported(Implementation implementation) {
+    const CpuFeatures &features = GetCpuFeatures();
+    switch (implementation) {
+        case ENCODING_IMPLEMENTATION_SCALAR:
+            return true;
+#if ENCODING_KERNELS_X86
+        case ENCODING_IMPLEMENTATION_SSSE3:
+            return features.mSsse3;
+        case ENCODING_IMPLEMENTATION_AVX2:
+            return features.mAvx2;
+#endif
+#if ENCODING_KERNELS_NEON
+        case ENCODING_IMPLEMENTATION_NEON:
+            return features.mNeon;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char *Encoding::GetImplementationName(Implementation implementation) {
+    switch (implementation) {
+        case ENCODING_IMPLEMENTATION_SCALAR:
+            return "scalar";
+        case ENCODING_IMPLEMENTATION_SSSE3:
+            return "ssse3";
+        case ENCODING_IMPLEMENTATION_AVX2:
+            return "avx2";
+        case ENCODING_IMPLEMENTATION_NEON:
+            return "neon";
+        default:
+            return "unknown";
+    }
+}
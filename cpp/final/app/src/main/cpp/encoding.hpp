@@ -0,0 +1,103 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * Hex and base64url (RFC 4648 section 5, without padding) encoding,
+ * decoding and validation, and the scan for characters a JSON string has
+ * to escape. Long inputs go through SIMD kernels for the
+ * CPU (AVX2 or SSSE3 on x86, NEON on ARM), picked the first time they are
+ * needed. Short inputs, and what is left at the end of long ones, go
+ * through lookup tables.
+ */
+class Encoding {
+public:
+    enum Implementation {
+        // Lookup tables only
+        ENCODING_IMPLEMENTATION_SCALAR = 0,
+        ENCODING_IMPLEMENTATION_SSSE3,
+        ENCODING_IMPLEMENTATION_AVX2,
+        ENCODING_IMPLEMENTATION_NEON,
+        ENCODING_IMPLEMENTATION_COUNT
+    };
+
+    static constexpr size_t GetHexEncodedLength(size_t size) { return size * 2; }
+
+    static constexpr size_t GetBase64UrlEncodedLength(size_t size) { return (size * 4 + 2) / 3; }
+
+    // Size of the data a base64url string of the given length decodes to
+    static constexpr size_t GetBase64UrlDecodedSize(size_t length) { return length * 3 / 4; }
+
+    // Writes the lower case hex of data, GetHexEncodedLength(size) characters
+    static void HexEncode(const uint8_t *data, size_t size, char *out);
+
+    static std::string HexEncode(const uint8_t *data, size_t size);
+
+    /**
+     * Decodes hex digits of either case.
+     *
+     * @param hex The hex string.
+     * @param out Receives hex.size() / 2 bytes, its contents are undefined
+     * if the string isn't valid.
+     * @return false if hex has an odd length or a character that isn't a hex digit.
+     */
+    static bool HexDecode(std::string_view hex, uint8_t *out);
+
+    // true if text is an even number of hex digits of either case
+    static bool IsHex(std::string_view text);
+
+    // Writes the base64url of data, returns the number of characters written
+    static size_t Base64UrlEncode(const uint8_t *data, size_t size, char *out);
+
+    static std::string Base64UrlEncode(const uint8_t *data, size_t size);
+
+    /**
+     * Decodes unpadded base64url.
+     *
+     * @param text The base64url string.
+     * @param out Receives GetBase64UrlDecodedSize(text.size()) bytes, its
+     * contents are undefined if the string isn't valid.
+     * @return false if text has a character outside the alphabet, or a
+     * length no encoding has.
+     */
+    static bool Base64UrlDecode(std::string_view text, uint8_t *out);
+
+    // true if text is unpadded base64url
+    static bool IsBase64Url(std::string_view text);
+
+    // Position of the first quote, backslash or control character in text,
+    // the characters a JSON string has to escape, or text.size() if it has none
+    static size_t FindJsonEscape(std::string_view text);
+
+    // The implementation in use, the fastest one the CPU supports unless
+    // SetImplementation chose another
+    static Implementation GetImplementation();
+
+    // Switches implementation, for comparing them. Returns false, and
+    // changes nothing, if the CPU doesn't support it.
+    static bool SetImplementation(Implementation implementation);
+
+    static bool IsSupported(Implementation implementation);
+
+    static const char *GetImplementationName(Implementation implementation);
+};
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * SIMD kernels for Encoding, each only built for the architectures it
+ * runs on, and only called once the CPU is known to support it.
+ *
+ * Kernels work on whole blocks and return how much of the input they
+ * handled, leaving the rest to the scalar code. Encoders handle a
+ * multiple of 3 bytes for base64url. Decoders and validators stop at the
+ * first block holding a character outside the alphabet, and handle a
+ * multiple of 2 (hex) or 4 (base64url) characters. Decoders are given
+ * the whole input and never write past its decoded length. JSON escape
+ * scans stop at the first block holding a character a JSON string has to
+ * escape.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ENCODING_KERNELS_X86 1
+
+size_t HexEncodeSsse3(const uint8_t *data, size_t size, char *out);
+
+size_t HexDecodeSsse3(const char *hex, size_t length, uint8_t *out);
+
+size_t HexValidateSsse3(const char *hex, size_t length);
+
+size_t Base64UrlEncodeSsse3(const uint8_t *data, size_t size, char *out);
+
+size_t Base64UrlDecodeSsse3(const char *text, size_t length, uint8_t *out);
+
+size_t Base64UrlValidateSsse3(const char *text, size_t length);
+
+size_t JsonEscapeScanSsse3(const char *text, size_t length);
+
+size_t HexEncodeAvx2(const uint8_t *data, size_t size, char *out);
+
+size_t HexDecodeAvx2(const char *hex, size_t length, uint8_t *out);
+
+size_t HexValidateAvx2(const char *hex, size_t length);
+
+size_t Base64UrlEncodeAvx2(const uint8_t *data, size_t size, char *out);
+
+size_t Base64UrlDecodeAvx2(const char *text, size_t length, uint8_t *out);
+
+size_t Base64UrlValidateAvx2(const char *text, size_t length);
+
+size_t JsonEscapeScanAvx2(const char *text, size_t length);
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ENCODING_KERNELS_NEON 1
+
+size_t HexEncodeNeon(const uint8_t *data, size_t size, char *out);
+
+size_t HexDecodeNeon(const char *hex, size_t length, uint8_t *out);
+
+size_t HexValidateNeon(const char *hex, size_t length);
+
+size_t Base64UrlEncodeNeon(const uint8_t *data, size_t size, char *out);
+
+size_t Base64UrlDecodeNeon(const char *text, size_t length, uint8_t *out);
+
+size_t Base64UrlValidateNeon(const char *text, size_t length);
+
+size_t JsonEscapeScanNeon(const char *text, size_t length);
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "encoding_kernels.hpp"
+
+#if ENCODING_KERNELS_NEON
+
+#include <arm_neon.h>
+
+namespace {
+    // Looks up 16 indices (0-15) in a 16 byte table
+    inline uint8x16_t Lookup(uint8x16_t table, uint8x16_t indices) {
+#if defined(__aarch64__)
+        return vqtbl1q_u8(table, indices);
+#else
+        const uint8x8x2_t table2 = {{vget_low_u8(table), vget_high_u8(table)}};
+        return vcombine_u8(vtbl2_u8(table2, vget_low_u8(indices)),
+                           vtbl2_u8(table2, vget_high_u8(indices)));
+#endif
+    }
+
+    inline bool AllSet(uint8x16_t mask) {
+#if defined(__aarch64__)
+        return vminvq_u8(mask) == 0xFF;
+#else
+        const uint32x2_t folded = vreinterpret_u32_u8(vand_u8(vget_low_u8(mask),
+                                                              vget_high_u8(mask)));
+        return (vget_lane_u32(folded, 0) & vget_lane_u32(folded, 1)) == 0xFFFFFFFF;
+#endif
+    }
+
+    // Set in the bytes JSON strings have to escape: quotes, backslashes and
+    // control characters
+    inline uint8x16_t JsonEscapes(uint8x16_t chars) {
+        return vorrq_u8(vorrq_u8(vceqq_u8(chars, vdupq_n_u8('"')),
+                                 vceqq_u8(chars, vdupq_n_u8('\\'))),
+                        vcltq_u8(chars, vdupq_n_u8(0x20)));
+    }
+
+    inline bool AnySet(uint8x16_t mask) {
+#if defined(__aarch64__)
+        return vmaxvq_u8(mask) != 0;
+#else
+        const uint32x2_t folded = vreinterpret_u32_u8(vorr_u8(vget_low_u8(mask),
+                                                              vget_high_u8(mask)));
+        return (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0;
+#endif
+    }
+
+    // Values of hex digits, valid is set in the bytes that held one.
+    // Subtracting the start of a range wraps everything below it around
+    // to large values, so one unsigned compare checks both ends.
+    inline uint8x16_t HexValues(uint8x16_t chars, uint8x16_t &valid) {
+        const uint8x16_t digit = vsubq_u8(chars, vdupq_n_u8('0'));
+        const uint8x16_t letter = vsubq_u8(vorrq_u8(chars, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+        const uint8x16_t isDigit = vcltq_u8(digit, vdupq_n_u8(10));
+        const uint8x16_t isLetter = vcltq_u8(letter, vdupq_n_u8(6));
+        valid = vorrq_u8(isDigit, isLetter);
+        return vbslq_u8(isDigit, digit, vaddq_u8(letter, vdupq_n_u8(10)));
+    }
+
+    // Values of base64url characters, valid is set in the bytes that held one
+    inline uint8x16_t Base64UrlValues(uint8x16_t chars, uint8x16_t &valid) {
+        const uint8x16_t upper = vsubq_u8(chars, vdupq_n_u8('A'));
+        const uint8x16_t lower = vsubq_u8(chars, vdupq_n_u8('a'));
+        const uint8x16_t digit = vsubq_u8(chars, vdupq_n_u8('0'));
+        const uint8x16_t isUpper = vcltq_u8(upper, vdupq_n_u8(26));
+        const uint8x16_t isLower = vcltq_u8(lower, vdupq_n_u8(26));
+        const uint8x16_t isDigit = vcltq_u8(digit, vdupq_n_u8(10));
+        const uint8x16_t isDash = vceqq_u8(chars, vdupq_n_u8('-'));
+        const uint8x16_t isUnderscore = vceqq_u8(chars, vdupq_n_u8('_'));
+        valid = vorrq_u8(vorrq_u8(vorrq_u8(isUpper, isLower), isDigit),
+                         vorrq_u8(isDash, isUnderscore));
+        uint8x16_t values = vandq_u8(isUnderscore, vdupq_n_u8(63));
+        values = vbslq_u8(isDash, vdupq_n_u8(62), values);
+        values = vbslq_u8(isDigit, vaddq_u8(digit, vdupq_n_u8(52)), values);
+        values = vbslq_u8(isLower, vaddq_u8(lower, vdupq_n_u8(26)), values);
+        return vbslq_u8(isUpper, upper, values);
+    }
+
+    // Adds the offset for each index range, the ranges start at 0 ('A'),
+    // 26 ('a'), 52 ('0'), 62 ('-') and 63 ('_')
+    inline uint8x16_t Base64UrlChars(uint8x16_t indices) {
+        uint8x16_t chars = vaddq_u8(indices, vdupq_n_u8('A'));
+        chars = vaddq_u8(chars, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(26)),
+                                         vdupq_n_u8('a' - 26 - 'A')));
+        chars = vaddq_u8(chars, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(52)),
+                                         vdupq_n_u8(static_cast<uint8_t>('0' - 52 - ('a' - 26)))));
+        chars = vaddq_u8(chars, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(62)),
+                                         vdupq_n_u8(static_cast<uint8_t>('-' - 62 - ('0' - 52)))));
+        return vaddq_u8(chars, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(63)),
+                                        vdupq_n_u8('_' - 63 - ('-' - 62))));
+    }
+}
+
+size_t HexEncodeNeon(const uint8_t *data, size_t size, char *out) {
+    const uint8x16_t digits = vld1q_u8(reinterpret_cast<const uint8_t *>("0123456789abcdef"));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const uint8x16_t bytes = vld1q_u8(data + i);
+        uint8x16x2_t chars;
+        chars.val[0] = Lookup(digits, vshrq_n_u8(bytes, 4));
+        chars.val[1] = Lookup(digits, vandq_u8(bytes, vdupq_n_u8(0x0f)));
+        // Interleaves the high and low digits as it stores them
+        vst2q_u8(reinterpret_cast<uint8_t *>(out + i * 2), chars);
+    }
+    return i;
+}
+
+size_t HexDecodeNeon(const char *hex, size_t length, uint8_t *out) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        // Splits the high and low digits as it loads them
+        const uint8x16x2_t chars = vld2q_u8(reinterpret_cast<const uint8_t *>(hex + i));
+        uint8x16_t highValid, lowValid;
+        const uint8x16_t high = HexValues(chars.val[0], highValid);
+        const uint8x16_t low = HexValues(chars.val[1], lowValid);
+        if (!AllSet(vandq_u8(highValid, lowValid))) {
+            break;
+        }
+        vst1q_u8(out + i / 2, vorrq_u8(vshlq_n_u8(high, 4), low));
+    }
+    return i;
+}
+
+size_t HexValidateNeon(const char *hex, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t valid;
+        HexValues(vld1q_u8(reinterpret_cast<const uint8_t *>(hex + i)), valid);
+        if (!AllSet(valid)) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t Base64UrlEncodeNeon(const uint8_t *data, size_t size, char *out) {
+    const uint8x16_t sixBits = vdupq_n_u8(0x3f);
+    size_t i = 0;
+    for (; i + 48 <= size; i += 48) {
+        // Splits the bytes of each 3 byte group as it loads them
+        const uint8x16x3_t bytes = vld3q_u8(data + i);
+        uint8x16x4_t chars;
+        chars.val[0] = Base64UrlChars(vshrq_n_u8(bytes.val[0], 2));
+        chars.val[1] = Base64UrlChars(vandq_u8(
+                vorrq_u8(vshlq_n_u8(bytes.val[0], 4), vshrq_n_u8(bytes.val[1], 4)), sixBits));
+        chars.val[2] = Base64UrlChars(vandq_u8(
+                vorrq_u8(vshlq_n_u8(bytes.val[1], 2), vshrq_n_u8(bytes.val[2], 6)), sixBits));
+        chars.val[3] = Base64UrlChars(vandq_u8(bytes.val[2], sixBits));
+        vst4q_u8(reinterpret_cast<uint8_t *>(out + i / 3 * 4), chars);
+    }
+    return i;
+}
+
+size_t Base64UrlDecodeNeon(const char *text, size_t length, uint8_t *out) {
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        // Splits the characters of each 4 character group as it loads them
+        const uint8x16x4_t chars = vld4q_u8(reinterpret_cast<const uint8_t *>(text + i));
+        uint8x16_t valid[4];
+        uint8x16_t values[4];
+        for (int j = 0; j < 4; ++j) {
+            values[j] = Base64UrlValues(chars.val[j], valid[j]);
+        }
+        if (!AllSet(vandq_u8(vandq_u8(valid[0], valid[1]), vandq_u8(valid[2], valid[3])))) {
+            break;
+        }
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(values[0], 2), vshrq_n_u8(values[1], 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(values[1], 4), vshrq_n_u8(values[2], 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(values[2], 6), values[3]);
+        vst3q_u8(out + i / 4 * 3, bytes);
+    }
+    return i;
+}
+
+size_t Base64UrlValidateNeon(const char *text, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t valid;
+        Base64UrlValues(vld1q_u8(reinterpret_cast<const uint8_t *>(text + i)), valid);
+        if (!AllSet(valid)) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t JsonEscapeScanNeon(const char *text, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        if (AnySet(JsonEscapes(vld1q_u8(reinterpret_cast<const uint8_t *>(text + i))))) {
+            break;
+        }
+    }
+    return i;
+}
+
+#endif
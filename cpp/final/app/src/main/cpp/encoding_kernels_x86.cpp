@@ -0,0 +1,420 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "encoding_kernels.hpp"
+
+#if ENCODING_KERNELS_X86
+
+#include <immintrin.h>
+
+namespace {
+    __attribute__((target("ssse3")))
+    inline __m128i Load128(const void *data) {
+        return _mm_loadu_si128(static_cast<const __m128i *>(data));
+    }
+
+    __attribute__((target("ssse3")))
+    inline void Store128(void *out, __m128i value) {
+        _mm_storeu_si128(static_cast<__m128i *>(out), value);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i Load256(const void *data) {
+        return _mm256_loadu_si256(static_cast<const __m256i *>(data));
+    }
+
+    __attribute__((target("avx2")))
+    inline void Store256(void *out, __m256i value) {
+        _mm256_storeu_si256(static_cast<__m256i *>(out), value);
+    }
+
+    // Characters are compared as signed bytes, so anything outside ASCII
+    // is below every range
+    __attribute__((target("ssse3")))
+    inline __m128i InRange(__m128i chars, char first, char last) {
+        return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(first - 1)),
+                             _mm_cmpgt_epi8(_mm_set1_epi8(last + 1), chars));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i InRange(__m256i chars, char first, char last) {
+        return _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8(first - 1)),
+                                _mm256_cmpgt_epi8(_mm256_set1_epi8(last + 1), chars));
+    }
+
+    // Set in the bytes JSON strings have to escape: quotes, backslashes and
+    // control characters. Control characters are the bytes whose unsigned
+    // maximum with 0x1f is 0x1f.
+    __attribute__((target("ssse3")))
+    inline __m128i JsonEscapes(__m128i chars) {
+        const __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chars, _mm_set1_epi8(0x1f)),
+                                               _mm_set1_epi8(0x1f));
+        return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')),
+                                         _mm_cmpeq_epi8(chars, _mm_set1_epi8('\\'))),
+                            control);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i JsonEscapes(__m256i chars) {
+        const __m256i control = _mm256_cmpeq_epi8(
+                _mm256_max_epu8(chars, _mm256_set1_epi8(0x1f)), _mm256_set1_epi8(0x1f));
+        return _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('"')),
+                                _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\\'))),
+                control);
+    }
+
+    // Values of hex digits, valid is set in the bytes that held one
+    __attribute__((target("ssse3")))
+    inline __m128i HexValues(__m128i chars, __m128i &valid) {
+        const __m128i lowerCase = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+        const __m128i isDigit = InRange(chars, '0', '9');
+        const __m128i isLetter = InRange(lowerCase, 'a', 'f');
+        valid = _mm_or_si128(isDigit, isLetter);
+        return _mm_or_si128(
+                _mm_and_si128(isDigit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+                _mm_and_si128(isLetter, _mm_sub_epi8(lowerCase, _mm_set1_epi8('a' - 10))));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i HexValues(__m256i chars, __m256i &valid) {
+        const __m256i lowerCase = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+        const __m256i isDigit = InRange(chars, '0', '9');
+        const __m256i isLetter = InRange(lowerCase, 'a', 'f');
+        valid = _mm256_or_si256(isDigit, isLetter);
+        return _mm256_or_si256(
+                _mm256_and_si256(isDigit, _mm256_sub_epi8(chars, _mm256_set1_epi8('0'))),
+                _mm256_and_si256(isLetter, _mm256_sub_epi8(lowerCase, _mm256_set1_epi8('a' - 10))));
+    }
+
+    // Values of base64url characters, valid is set in the bytes that held one
+    __attribute__((target("ssse3")))
+    inline __m128i Base64UrlValues(__m128i chars, __m128i &valid) {
+        const __m128i isUpper = InRange(chars, 'A', 'Z');
+        const __m128i isLower = InRange(chars, 'a', 'z');
+        const __m128i isDigit = InRange(chars, '0', '9');
+        const __m128i isDash = _mm_cmpeq_epi8(chars, _mm_set1_epi8('-'));
+        const __m128i isUnderscore = _mm_cmpeq_epi8(chars, _mm_set1_epi8('_'));
+        valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(isUpper, isLower), isDigit),
+                             _mm_or_si128(isDash, isUnderscore));
+        const __m128i shift = _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(isUpper, _mm_set1_epi8(-'A')),
+                             _mm_and_si128(isLower, _mm_set1_epi8(26 - 'a'))),
+                _mm_or_si128(_mm_and_si128(isDigit, _mm_set1_epi8(52 - '0')),
+                             _mm_or_si128(_mm_and_si128(isDash, _mm_set1_epi8(62 - '-')),
+                                          _mm_and_si128(isUnderscore, _mm_set1_epi8(63 - '_')))));
+        return _mm_add_epi8(chars, shift);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i Base64UrlValues(__m256i chars, __m256i &valid) {
+        const __m256i isUpper = InRange(chars, 'A', 'Z');
+        const __m256i isLower = InRange(chars, 'a', 'z');
+        const __m256i isDigit = InRange(chars, '0', '9');
+        const __m256i isDash = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('-'));
+        const __m256i isUnderscore = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_'));
+        valid = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(isUpper, isLower), isDigit),
+                                _mm256_or_si256(isDash, isUnderscore));
+        const __m256i shift = _mm256_or_si256(
+                _mm256_or_si256(_mm256_and_si256(isUpper, _mm256_set1_epi8(-'A')),
+                                _mm256_and_si256(isLower, _mm256_set1_epi8(26 - 'a'))),
+                _mm256_or_si256(_mm256_and_si256(isDigit, _mm256_set1_epi8(52 - '0')),
+                                _mm256_or_si256(
+                                        _mm256_and_si256(isDash, _mm256_set1_epi8(62 - '-')),
+                                        _mm256_and_si256(isUnderscore,
+                                                         _mm256_set1_epi8(63 - '_')))));
+        return _mm256_add_epi8(chars, shift);
+    }
+
+    // Splits 12 bytes, arranged by the caller's shuffle, into 16 six bit
+    // indices (one per byte)
+    __attribute__((target("ssse3")))
+    inline __m128i Base64UrlIndices(__m128i shuffled) {
+        const __m128i first = _mm_mulhi_epu16(_mm_and_si128(shuffled, _mm_set1_epi32(0x0fc0fc00)),
+                                              _mm_set1_epi32(0x04000040));
+        const __m128i second = _mm_mullo_epi16(_mm_and_si128(shuffled, _mm_set1_epi32(0x003f03f0)),
+                                               _mm_set1_epi32(0x01000010));
+        return _mm_or_si128(first, second);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i Base64UrlIndices(__m256i shuffled) {
+        const __m256i first = _mm256_mulhi_epu16(
+                _mm256_and_si256(shuffled, _mm256_set1_epi32(0x0fc0fc00)),
+                _mm256_set1_epi32(0x04000040));
+        const __m256i second = _mm256_mullo_epi16(
+                _mm256_and_si256(shuffled, _mm256_set1_epi32(0x003f03f0)),
+                _mm256_set1_epi32(0x01000010));
+        return _mm256_or_si256(first, second);
+    }
+
+    // Turns indices into characters by adding an offset per index range,
+    // the range picked by squashing the index into 0-13
+    __attribute__((target("ssse3")))
+    inline __m128i Base64UrlChars(__m128i indices) {
+        const __m128i offsets = _mm_setr_epi8(
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+        __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices),
+                                                  _mm_set1_epi8(13)));
+        return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i Base64UrlChars(__m256i indices) {
+        const __m256i offsets = _mm256_setr_epi8(
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0,
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range,
+                                _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+                                                 _mm256_set1_epi8(13)));
+        return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+    }
+
+    // Packs groups of 4 six bit values into 3 bytes, at the start of each
+    // 128-bit lane
+    __attribute__((target("ssse3")))
+    inline __m128i PackBase64Url(__m128i values) {
+        const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        const __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        return _mm_shuffle_epi8(groups, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                                      -1, -1, -1, -1));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i PackBase64Url(__m256i values) {
+        const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        const __m256i groups = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        return _mm256_shuffle_epi8(groups, _mm256_setr_epi8(
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    }
+}
+
+__attribute__((target("ssse3")))
+size_t HexEncodeSsse3(const uint8_t *data, size_t size, char *out) {
+    const __m128i digits = Load128("0123456789abcdef");
+    const __m128i lowNibbles = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i bytes = Load128(data + i);
+        const __m128i high = _mm_shuffle_epi8(
+                digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), lowNibbles));
+        const __m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, lowNibbles));
+        Store128(out + i * 2, _mm_unpacklo_epi8(high, low));
+        Store128(out + i * 2 + 16, _mm_unpackhi_epi8(high, low));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t HexDecodeSsse3(const char *hex, size_t length, uint8_t *out) {
+    // High nibble times 16 plus low nibble
+    const __m128i nibbleWeights = _mm_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m128i valid0, valid1;
+        const __m128i values0 = HexValues(Load128(hex + i), valid0);
+        const __m128i values1 = HexValues(Load128(hex + i + 16), valid1);
+        if (_mm_movemask_epi8(_mm_and_si128(valid0, valid1)) != 0xFFFF) {
+            break;
+        }
+        Store128(out + i / 2, _mm_packus_epi16(_mm_maddubs_epi16(values0, nibbleWeights),
+                                               _mm_maddubs_epi16(values1, nibbleWeights)));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t HexValidateSsse3(const char *hex, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i valid;
+        HexValues(Load128(hex + i), valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t Base64UrlEncodeSsse3(const uint8_t *data, size_t size, char *out) {
+    // Each group of 3 bytes is spread over a 32-bit word so the six bit
+    // indices can be shifted into place
+    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    size_t i = 0;
+    // Loads 16 bytes to use 12
+    for (; i + 16 <= size; i += 12) {
+        const __m128i indices = Base64UrlIndices(_mm_shuffle_epi8(Load128(data + i), spread));
+        Store128(out + i / 3 * 4, Base64UrlChars(indices));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t Base64UrlDecodeSsse3(const char *text, size_t length, uint8_t *out) {
+    size_t i = 0;
+    // Stores 16 bytes to write 12, so stop while there is still room
+    for (; i + 24 <= length; i += 16) {
+        __m128i valid;
+        const __m128i values = Base64UrlValues(Load128(text + i), valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
+        }
+        Store128(out + i / 4 * 3, PackBase64Url(values));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t Base64UrlValidateSsse3(const char *text, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i valid;
+        Base64UrlValues(Load128(text + i), valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t JsonEscapeScanSsse3(const char *text, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        if (_mm_movemask_epi8(JsonEscapes(Load128(text + i))) != 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t HexEncodeAvx2(const uint8_t *data, size_t size, char *out) {
+    const __m256i digits = _mm256_broadcastsi128_si256(Load128("0123456789abcdef"));
+    const __m256i lowNibbles = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i bytes = Load256(data + i);
+        const __m256i high = _mm256_shuffle_epi8(
+                digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), lowNibbles));
+        const __m256i low = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, lowNibbles));
+        // Unpacking works within 128-bit lanes, put the halves back in order
+        const __m256i first = _mm256_unpacklo_epi8(high, low);
+        const __m256i second = _mm256_unpackhi_epi8(high, low);
+        Store256(out + i * 2, _mm256_permute2x128_si256(first, second, 0x20));
+        Store256(out + i * 2 + 32, _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    // AVX2 CPUs have SSSE3, which takes what is left
+    return i + HexEncodeSsse3(data + i, size - i, out + i * 2);
+}
+
+__attribute__((target("avx2")))
+size_t HexDecodeAvx2(const char *hex, size_t length, uint8_t *out) {
+    const __m256i nibbleWeights = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m256i valid0, valid1;
+        const __m256i values0 = HexValues(Load256(hex + i), valid0);
+        const __m256i values1 = HexValues(Load256(hex + i + 32), valid1);
+        if (_mm256_movemask_epi8(_mm256_and_si256(valid0, valid1)) != -1) {
+            break;
+        }
+        // Packing works within 128-bit lanes, put the quarters back in order
+        const __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(values0, nibbleWeights),
+                                                   _mm256_maddubs_epi16(values1, nibbleWeights));
+        Store256(out + i / 2, _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    return i + HexDecodeSsse3(hex + i, length - i, out + i / 2);
+}
+
+__attribute__((target("avx2")))
+size_t HexValidateAvx2(const char *hex, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i valid;
+        HexValues(Load256(hex + i), valid);
+        if (_mm256_movemask_epi8(valid) != -1) {
+            break;
+        }
+    }
+    return i + HexValidateSsse3(hex + i, length - i);
+}
+
+__attribute__((target("avx2")))
+size_t Base64UrlEncodeAvx2(const uint8_t *data, size_t size, char *out) {
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    size_t i = 0;
+    // Each 128-bit lane loads 16 bytes to use 12
+    for (; i + 28 <= size; i += 24) {
+        const __m256i bytes = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(Load128(data + i)), Load128(data + i + 12), 1);
+        const __m256i indices = Base64UrlIndices(_mm256_shuffle_epi8(bytes, spread));
+        Store256(out + i / 3 * 4, Base64UrlChars(indices));
+    }
+    return i + Base64UrlEncodeSsse3(data + i, size - i, out + i / 3 * 4);
+}
+
+__attribute__((target("avx2")))
+size_t Base64UrlDecodeAvx2(const char *text, size_t length, uint8_t *out) {
+    // Gathers the 12 bytes at the start of each lane
+    const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0;
+    // Stores 32 bytes to write 24, so stop while there is still room
+    for (; i + 48 <= length; i += 32) {
+        __m256i valid;
+        const __m256i values = Base64UrlValues(Load256(text + i), valid);
+        if (_mm256_movemask_epi8(valid) != -1) {
+            break;
+        }
+        Store256(out + i / 4 * 3, _mm256_permutevar8x32_epi32(PackBase64Url(values), gather));
+    }
+    return i + Base64UrlDecodeSsse3(text + i, length - i, out + i / 4 * 3);
+}
+
+__attribute__((target("avx2")))
+size_t Base64UrlValidateAvx2(const char *text, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i valid;
+        Base64UrlValues(Load256(text + i), valid);
+        if (_mm256_movemask_epi8(valid) != -1) {
+            break;
+        }
+    }
+    return i + Base64UrlValidateSsse3(text + i, length - i);
+}
+
+__attribute__((target("avx2")))
+size_t JsonEscapeScanAvx2(const char *text, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        if (_mm256_movemask_epi8(JsonEscapes(Load256(text + i))) != 0) {
+            break;
+        }
+    }
+    return i + JsonEscapeScanSsse3(text + i, length - i);
+}
+
+#endif
@@ -0,0 +1,390 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fake_integrity.hpp"
+#include "encoding.hpp"
+#include "nonce_codec.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    typedef std::chrono::steady_clock FakeClock;
+
+    // Nonce limits enforced by Play Integrity
+    constexpr size_t MIN_NONCE_LENGTH = 16;
+    constexpr size_t MAX_NONCE_LENGTH = 500;
+
+    struct ResponseState {
+        IntegrityResponseStatus mStatus;
+        IntegrityErrorCode mError;
+        std::string mToken;
+        FakeClock::time_point mCompleteTime;
+        bool mCompleteOnPoll;
+        bool mDestroyed;
+    };
+
+    struct FakeState {
+        FakeState() {
+            mInitialized = false;
+            mConfig = FakeIntegrity::GetDefaultConfig();
+            mStats = {};
+            mRandom.seed(mConfig.seed);
+            mStopWorker = false;
+        }
+
+        // The state is a static, so this runs at exit. A worker still
+        // running then would use the members as they are destroyed.
+        ~FakeState() {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopWorker = true;
+            }
+            mWakeWorker.notify_all();
+            if (mWorker.joinable()) {
+                mWorker.join();
+            }
+        }
+
+        // Guards everything here and every ResponseState
+        std::mutex mMutex;
+        bool mInitialized;
+        FakeIntegrity::Config mConfig;
+        FakeIntegrity::Stats mStats;
+        std::mt19937 mRandom;
+        std::thread mWorker;
+        std::condition_variable mWakeWorker;
+        bool mStopWorker;
+        // Responses waiting for the worker to complete them
+        std::vector<std::shared_ptr<ResponseState>> mWorkerQueue;
+    };
+
+    FakeState &GetState() {
+        static FakeState state;
+        return state;
+    }
+
+    bool IsBase64UrlNonce(const std::string &nonce) {
+        return std::all_of(nonce.begin(), nonce.end(), [](char c) {
+            return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                    c == '-' || c == '_' || c == '=';
+        });
+    }
+
+    float SampleLatency(FakeState &state) {
+        const FakeIntegrity::Config &config = state.mConfig;
+        switch (config.latencyDistribution) {
+            case FakeIntegrity::FAKE_LATENCY_UNIFORM: {
+                std::uniform_real_distribution<float> distribution(
+                        config.latencyMin, std::max(config.latencyMin, config.latencyMax));
+                return distribution(state.mRandom);
+            }
+            case FakeIntegrity::FAKE_LATENCY_LOG_NORMAL: {
+                std::lognormal_distribution<float> distribution(
+                        std::log(std::max(config.latencyMin, 0.0001f)), config.latencyMax);
+                return distribution(state.mRandom);
+            }
+            case FakeIntegrity::FAKE_LATENCY_FIXED:
+            default:
+                return config.latencyMin;
+        }
+    }
+
+    bool InjectError(FakeState &state, float rate) {
+        if (rate <= 0.0f) {
+            return false;
+        }
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+        return distribution(state.mRandom) < rate;
+    }
+
+    std::string GenerateToken(FakeState &state) {
+        const FakeIntegrity::Config &config = state.mConfig;
+        std::uniform_int_distribution<size_t> lengthDistribution(
+                config.minTokenLength, std::max(config.minTokenLength, config.maxTokenLength));
+        // Tokens are the base64url of random bytes, like real ones. Base64url
+        // can't produce a length of 1 mod 4, so those tokens come out one
+        // character shorter than requested.
+        std::vector<uint8_t> bytes(
+                Encoding::GetBase64UrlDecodedSize(lengthDistribution(state.mRandom)));
+        std::uniform_int_distribution<int> byteDistribution(0, 255);
+        for (uint8_t &byte : bytes) {
+            byte = static_cast<uint8_t>(byteDistribution(state.mRandom));
+        }
+        return Encoding::Base64UrlEncode(bytes.data(), bytes.size());
+    }
+
+    void CompleteResponse(FakeState &state, ResponseState &response) {
+        if (response.mStatus != INTEGRITY_RESPONSE_WAITING || response.mDestroyed) {
+            return;
+        }
+        response.mStatus = INTEGRITY_RESPONSE_COMPLETED;
+        if (response.mError == INTEGRITY_NO_ERROR) {
+            ++state.mStats.completed;
+        } else {
+            ++state.mStats.failed;
+        }
+    }
+
+    void RunWorker() {
+        FakeState &state = GetState();
+        std::unique_lock<std::mutex> lock(state.mMutex);
+        while (!state.mStopWorker) {
+            if (state.mWorkerQueue.empty()) {
+                state.mWakeWorker.wait(lock);
+                continue;
+            }
+            auto next = std::min_element(
+                    state.mWorkerQueue.begin(), state.mWorkerQueue.end(),
+                    [](const std::shared_ptr<ResponseState> &a,
+                       const std::shared_ptr<ResponseState> &b) {
+                        return a->mCompleteTime < b->mCompleteTime;
+                    });
+            if ((*next)->mCompleteTime > FakeClock::now()) {
+                state.mWakeWorker.wait_until(lock, (*next)->mCompleteTime);
+                continue;
+            }
+            CompleteResponse(state, **next);
+            state.mWorkerQueue.erase(next);
+        }
+    }
+
+    void StopWorker(std::unique_lock<std::mutex> &lock) {
+        FakeState &state = GetState();
+        if (!state.mWorker.joinable()) {
+            return;
+        }
+        state.mStopWorker = true;
+        state.mWakeWorker.notify_all();
+        lock.unlock();
+        state.mWorker.join();
+        lock.lock();
+        state.mStopWorker = false;
+        state.mWorkerQueue.clear();
+    }
+}
+
+struct IntegrityTokenRequest {
+    std::string mNonce;
+    int64_t mCloudProjectNumber;
+};
+
+struct IntegrityTokenResponse {
+    // Shared with the worker, which may still hold it after the response
+    // is destroyed
+    std::shared_ptr<ResponseState> mState;
+};
+
+FakeIntegrity::Config FakeIntegrity::GetDefaultConfig() {
+    Config config = {};
+    config.minTokenLength = 1200;
+    config.maxTokenLength = 1600;
+    config.latencyDistribution = FAKE_LATENCY_LOG_NORMAL;
+    config.latencyMin = 0.4f;
+    config.latencyMax = 0.5f;
+    config.completionMode = FAKE_COMPLETION_ON_POLL;
+    config.requestErrorRate = 0.0f;
+    config.requestError = INTEGRITY_NETWORK_ERROR;
+    config.responseErrorRate = 0.0f;
+    config.responseError = INTEGRITY_TOO_MANY_REQUESTS;
+    config.requireAppNonce = false;
+    config.seed = 1;
+    return config;
+}
+
+void FakeIntegrity::SetConfig(const Config &config) {
+    FakeState &state = GetState();
+    std::lock_guard<std::mutex> lock(state.mMutex);
+    state.mConfig = config;
+    state.mRandom.seed(config.seed);
+}
+
+FakeIntegrity::Stats FakeIntegrity::GetStats() {
+    FakeState &state = GetState();
+    std::lock_guard<std::mutex> lock(state.mMutex);
+    return state.mStats;
+}
+
+void FakeIntegrity::ResetStats() {
+    FakeState &state = GetState();
+    std::lock_guard<std::mutex> lock(state.mMutex);
+    state.mStats = {};
+}
+
+IntegrityErrorCode IntegrityManager_init(JavaVM * /*jvm*/, jobject /*android_context*/) {
+    FakeState &state = GetState();
+    std::lock_guard<std::mutex> lock(state.mMutex);
+    state.mInitialized = true;
+    return INTEGRITY_NO_ERROR;
+}
+
+void IntegrityManager_destroy() {
+    FakeState &state = GetState();
+    std::unique_lock<std::mutex> lock(state.mMutex);
+    state.mInitialized = false;
+    StopWorker(lock);
+}
+
+IntegrityErrorCode IntegrityTokenRequest_create(IntegrityTokenRequest **request) {
+    if (request == nullptr) {
+        return INTEGRITY_INVALID_ARGUMENT;
+    }
+    *request = new IntegrityTokenRequest();
+    (*request)->mCloudProjectNumber = 0;
+    return INTEGRITY_NO_ERROR;
+}
+
+void IntegrityTokenRequest_setNonce(IntegrityTokenRequest *request, const char *nonce) {
+    if (request != nullptr && nonce != nullptr) {
+        request->mNonce = nonce;
+    }
+}
+
+void IntegrityTokenRequest_setCloudProjectNumber(IntegrityTokenRequest *request,
+                                                 int64_t cloud_project_number) {
+    if (request != nullptr) {
+        request->mCloudProjectNumber = cloud_project_number;
+    }
+}
+
+void IntegrityTokenRequest_destroy(IntegrityTokenRequest *request) {
+    delete request;
+}
+
+IntegrityErrorCode IntegrityManager_requestIntegrityToken(IntegrityTokenRequest *request,
+                                                          IntegrityTokenResponse **response) {
+    if (request == nullptr || response == nullptr) {
+        return INTEGRITY_INVALID_ARGUMENT;
+    }
+    FakeState &state = GetState();
+    std::lock_guard<std::mutex> lock(state.mMutex);
+    if (!state.mInitialized) {
+        return INTEGRITY_INITIALIZATION_NEEDED;
+    }
+    ++state.mStats.requested;
+
+    NonceCodec::NonceParts nonceParts;
+    const auto nonceFormat = NonceCodec::Decode(request->mNonce, &nonceParts);
+    if (nonceFormat) {
+        ++state.mStats.nonceFormats[*nonceFormat];
+    } else {
+        ++state.mStats.unknownNonces;
+    }
+
+    IntegrityErrorCode requestError = INTEGRITY_NO_ERROR;
+    if (request->mNonce.size() < MIN_NONCE_LENGTH) {
+        requestError = INTEGRITY_NONCE_TOO_SHORT;
+    } else if (request->mNonce.size() > MAX_NONCE_LENGTH) {
+        requestError = INTEGRITY_NONCE_TOO_LONG;
+    } else if (!IsBase64UrlNonce(request->mNonce)) {
+        requestError = INTEGRITY_NONCE_IS_NOT_BASE64;
+    } else if (!nonceFormat && state.mConfig.requireAppNonce) {
+        requestError = INTEGRITY_INVALID_ARGUMENT;
+    } else if (InjectError(state, state.mConfig.requestErrorRate)) {
+        requestError = state.mConfig.requestError;
+    }
+    if (requestError != INTEGRITY_NO_ERROR) {
+        ++state.mStats.rejected;
+        return requestError;
+    }
+
+    auto responseState = std::make_shared<ResponseState>();
+    responseState->mStatus = INTEGRITY_RESPONSE_WAITING;
+    responseState->mDestroyed = false;
+    if (InjectError(state, state.mConfig.responseErrorRate)) {
+        responseState->mError = state.mConfig.responseError;
+    } else {
+        responseState->mError = INTEGRITY_NO_ERROR;
+        responseState->mToken = GenerateToken(state);
+    }
+    const std::chrono::duration<float> latency(SampleLatency(state));
+    responseState->mCompleteTime =
+            FakeClock::now() + std::chrono::duration_cast<FakeClock::duration>(latency);
+    responseState->mCompleteOnPoll =
+            state.mConfig.completionMode == FakeIntegrity::FAKE_COMPLETION_ON_POLL;
+    if (!responseState->mCompleteOnPoll) {
+        if (!state.mWorker.joinable()) {
+            state.mWorker = std::thread(RunWorker);
+        }
+        state.mWorkerQueue.push_back(responseState);
+        state.mWakeWorker.notify_all();
+    }
+    *response = new IntegrityTokenResponse{responseState};
+    return INTEGRITY_NO_ERROR;
+}
+
+IntegrityErrorCode IntegrityTokenResponse_getStatus(IntegrityTokenResponse *response,
+                                                    IntegrityResponseStatus *status) {
+    if (response == nullptr || status == nullptr) {
+        return INTEGRITY_INVALID_ARGUMENT;
+    }
+    FakeState &state = GetState();
+    std::lock_guard<std::mutex> lock(state.mMutex);
+    ResponseState &responseState = *response->mState;
+    if (responseState.mCompleteOnPoll && FakeClock::now() >= responseState.mCompleteTime) {
+        CompleteResponse(state, responseState);
+    }
+    *status = responseState.mStatus;
+    // Like Play Integrity, a failed request reports its error once complete
+    return responseState.mStatus == INTEGRITY_RESPONSE_COMPLETED ?
+            responseState.mError : INTEGRITY_NO_ERROR;
+}
+
+IntegrityErrorCode IntegrityTokenResponse_getError(IntegrityTokenResponse *response) {
+    if (response == nullptr) {
+        return INTEGRITY_INVALID_ARGUMENT;
+    }
+    std::lock_guard<std::mutex> lock(GetState().mMutex);
+    return response->mState->mError;
+}
+
+const char *IntegrityTokenResponse_getToken(IntegrityTokenResponse *response) {
+    if (response == nullptr) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(GetState().mMutex);
+    const ResponseState &responseState = *response->mState;
+    if (responseState.mStatus != INTEGRITY_RESPONSE_COMPLETED ||
+            responseState.mError != INTEGRITY_NO_ERROR) {
+        return nullptr;
+    }
+    // The token is only written before completion, so it can be read
+    // without the lock for as long as the response lives
+    return responseState.mToken.c_str();
+}
+
+void IntegrityTokenResponse_destroy(IntegrityTokenResponse *response) {
+    if (response == nullptr) {
+        return;
+    }
+    FakeState &state = GetState();
+    {
+        std::lock_guard<std::mutex> lock(state.mMutex);
+        if (response->mState->mStatus == INTEGRITY_RESPONSE_WAITING) {
+            ++state.mStats.abandoned;
+        }
+        response->mState->mDestroyed = true;
+    }
+    delete response;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "nonce_codec.hpp"
+#include "play/integrity.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * In-process fake of the Play Integrity native API. Building the app with
+ * USE_FAKE_INTEGRITY links fake_integrity.cpp in place of the Play Core
+ * library, so the integrity path runs without Play services,
+ * for example to profile the command pipeline on an emulator. The host
+ * tests in src/test/cpp build the fake on its own. Tokens are random
+ * strings the server can't decode, pair it with a server that doesn't
+ * check them.
+ *
+ * Requests are checked the way Play Integrity checks them (initialization,
+ * nonce length and alphabet), then complete after a latency drawn from a
+ * configurable distribution, possibly with an injected error. Nonces are
+ * also decoded as the app's hex or compact nonces and counted by format,
+ * and can be required to be one or the other.
+ */
+class FakeIntegrity {
+public:
+    enum LatencyDistribution {
+        // Every request takes latencyMin seconds
+        FAKE_LATENCY_FIXED = 0,
+        // Latency is uniform between latencyMin and latencyMax seconds
+        FAKE_LATENCY_UNIFORM,
+        // Latency is log-normal with a median of latencyMin seconds and a
+        // shape of latencyMax, for a long tail like real token requests
+        FAKE_LATENCY_LOG_NORMAL
+    };
+
+    enum CompletionMode {
+        // A response completes the first time its status is checked after
+        // its latency has passed, nothing runs in the background
+        FAKE_COMPLETION_ON_POLL = 0,
+        // A worker thread completes each response once its latency has
+        // passed, like Play services calling back into the app
+        FAKE_COMPLETION_ON_THREAD
+    };
+
+    struct Config {
+        // Length of the tokens handed out, picked uniformly in between
+        size_t minTokenLength;
+        size_t maxTokenLength;
+        LatencyDistribution latencyDistribution;
+        float latencyMin;
+        float latencyMax;
+        CompletionMode completionMode;
+        // Chance that IntegrityManager_requestIntegrityToken fails right away
+        float requestErrorRate;
+        IntegrityErrorCode requestError;
+        // Chance that a request completes with an error instead of a token
+        float responseErrorRate;
+        IntegrityErrorCode responseError;
+        // Reject requests whose nonce isn't a hex or compact app nonce with
+        // INTEGRITY_INVALID_ARGUMENT, Play Integrity itself takes any nonce
+        bool requireAppNonce;
+        // Seed for token contents, latencies and errors, the same seed and
+        // calls give the same results in FAKE_COMPLETION_ON_POLL mode
+        uint32_t seed;
+    };
+
+    struct Stats {
+        uint64_t requested;
+        // Requests that failed right away, injected or not
+        uint64_t rejected;
+        uint64_t completed;
+        // Requests that completed with an injected error
+        uint64_t failed;
+        // Responses destroyed before they completed
+        uint64_t abandoned;
+        // Requests by the format of their nonce, and requests whose nonce
+        // wasn't an app nonce in either format
+        uint64_t nonceFormats[NonceCodec::NONCE_FORMAT_COUNT];
+        uint64_t unknownNonces;
+    };
+
+    // Default configuration, tokens and latencies in the range of real
+    // classic requests and no errors
+    static Config GetDefaultConfig();
+
+    // Takes effect for requests made from now on, reseeds the generator
+    static void SetConfig(const Config &config);
+
+    static Stats GetStats();
+
+    static void ResetStats();
+};
@@ -173,4 +173,15 @@ std::optional<std::string> HTTPClient::Post(const std::string &url, const std::s
     }
 
     return buffer;
+}
+
+std::optional<std::string> HTTPTransport::Get(const std::string &url, std::string *error) {
+    HTTPClient client;
+    return client.Get(url, error);
+}
+
+std::optional<std::string> HTTPTransport::Post(const std::string &url, const std::string &body,
+                                               std::string *error) {
+    HTTPClient client;
+    return client.Post(url, body, error);
 }
\ No newline at end of file
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include "client_context.hpp"
+
 #include <optional>
 #include <string>
 
@@ -67,3 +69,14 @@ public:
 private:
     static std::string cacert_path;
 };
+
+/**
+ * A ClientTransport that sends each request with its own HTTPClient.
+ */
+class HTTPTransport : public ClientTransport {
+public:
+    std::optional<std::string> Get(const std::string &url, std::string *error) override;
+
+    std::optional<std::string> Post(const std::string &url, const std::string &body,
+                                    std::string *error) override;
+};
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/*
+ * String of at most Capacity characters, stored inline and always null
+ * terminated, so building, copying and passing one around never
+ * allocates. For values whose size has a known bound, like randoms and
+ * nonces. Operations that would go past the capacity fail and leave the
+ * string unchanged.
+ */
+template<size_t Capacity>
+class InlineString {
+public:
+    InlineString() {
+        mSize = 0;
+        mData[0] = '\0';
+    }
+
+    // Sets the string to text, or empty if text doesn't fit
+    explicit InlineString(std::string_view text) : InlineString() { Assign(text); }
+
+    // Returns false, and leaves the string unchanged, if text doesn't fit
+    bool Assign(std::string_view text) {
+        if (text.size() > Capacity) {
+            return false;
+        }
+        memcpy(mData, text.data(), text.size());
+        mSize = text.size();
+        mData[mSize] = '\0';
+        return true;
+    }
+
+    // Returns false, and leaves the string unchanged, if text doesn't fit
+    bool Append(std::string_view text) {
+        char *out = Extend(text.size());
+        if (out == nullptr) {
+            return false;
+        }
+        memcpy(out, text.data(), text.size());
+        return true;
+    }
+
+    // Grows the string by count characters and returns where they go, for
+    // writing in place, or null if they don't fit
+    char *Extend(size_t count) {
+        if (count > Capacity - mSize) {
+            return nullptr;
+        }
+        char *out = mData + mSize;
+        mSize += count;
+        mData[mSize] = '\0';
+        return out;
+    }
+
+    void Clear() {
+        mSize = 0;
+        mData[0] = '\0';
+    }
+
+    bool IsEmpty() const { return mSize == 0; }
+
+    size_t GetSize() const { return mSize; }
+
+    static constexpr size_t GetCapacity() { return Capacity; }
+
+    const char *GetCString() const { return mData; }
+
+    std::string_view GetView() const { return std::string_view(mData, mSize); }
+
+    std::string ToString() const { return std::string(mData, mSize); }
+
+    operator std::string_view() const { return GetView(); }
+
+    bool operator==(std::string_view other) const { return GetView() == other; }
+
+    bool operator!=(std::string_view other) const { return GetView() != other; }
+
+private:
+    size_t mSize;
+    char mData[Capacity + 1];
+};
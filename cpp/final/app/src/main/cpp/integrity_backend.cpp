@@ -0,0 +1,56 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "logging.hpp"
+#include "integrity_backend.hpp"
+#include "play/integrity.h"
+
+std::mutex IntegrityBackend::sMutex;
+size_t IntegrityBackend::sReferenceCount = 0;
+JavaVM *IntegrityBackend::sVm = nullptr;
+
+bool IntegrityBackend::Acquire(JavaVM *vm, jobject activity) {
+    std::lock_guard<std::mutex> lock(sMutex);
+    if (sReferenceCount == 0) {
+        const IntegrityErrorCode errorCode = IntegrityManager_init(vm, activity);
+        if (errorCode != INTEGRITY_NO_ERROR) {
+            ALOGE("Play Integrity returned error: %d", errorCode);
+            return false;
+        }
+        sVm = vm;
+    } else if (vm != sVm) {
+        ALOGE("Play Integrity is already initialized with a different Java VM");
+        return false;
+    }
+    ++sReferenceCount;
+    return true;
+}
+
+void IntegrityBackend::Release() {
+    std::lock_guard<std::mutex> lock(sMutex);
+    if (sReferenceCount == 0) {
+        return;
+    }
+    if (--sReferenceCount == 0) {
+        IntegrityManager_destroy();
+        sVm = nullptr;
+    }
+}
+
+size_t IntegrityBackend::GetReferenceCount() {
+    std::lock_guard<std::mutex> lock(sMutex);
+    return sReferenceCount;
+}
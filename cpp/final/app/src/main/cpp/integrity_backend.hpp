@@ -0,0 +1,50 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <jni.h>
+#include <mutex>
+
+/*
+ * Play Integrity has one IntegrityManager per process. Clients share it
+ * through a reference count: the first Acquire initializes it and the
+ * last Release destroys it. Safe to call from any thread.
+ */
+class IntegrityBackend {
+public:
+    /**
+     * Takes a reference to Play Integrity, initializing it if this is the
+     * first one.
+     *
+     * @param vm The Java VM to initialize Play Integrity with.
+     * @param activity The activity to initialize Play Integrity with.
+     * @return true if Play Integrity can be used, every successful call
+     * must be matched by a call to Release.
+     */
+    static bool Acquire(JavaVM *vm, jobject activity);
+
+    // Gives back a reference, destroying Play Integrity after the last one
+    static void Release();
+
+    static size_t GetReferenceCount();
+
+private:
+    static std::mutex sMutex;
+    static size_t sReferenceCount;
+    static JavaVM *sVm;
+};
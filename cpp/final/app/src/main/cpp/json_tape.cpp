@@ -0,0 +1,351 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "json_tape.hpp"
+#include "encoding.hpp"
+
+#include <limits>
+
+namespace {
+    // Surrogates, which only make a character as a high-low pair
+    constexpr uint32_t HIGH_SURROGATE_FIRST = 0xD800;
+    constexpr uint32_t LOW_SURROGATE_FIRST = 0xDC00;
+    constexpr uint32_t LOW_SURROGATE_LAST = 0xDFFF;
+    // Hex digits of a \u escape
+    constexpr size_t UNICODE_ESCAPE_LENGTH = 4;
+
+    bool IsDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    // Reads the hex digits of a \u escape off the front of text
+    bool ReadUnicodeEscape(std::string_view &text, uint32_t *code) {
+        uint8_t bytes[UNICODE_ESCAPE_LENGTH / 2];
+        if (text.size() < UNICODE_ESCAPE_LENGTH ||
+                !Encoding::HexDecode(text.substr(0, UNICODE_ESCAPE_LENGTH), bytes)) {
+            return false;
+        }
+        *code = (uint32_t(bytes[0]) << 8) | bytes[1];
+        text.remove_prefix(UNICODE_ESCAPE_LENGTH);
+        return true;
+    }
+
+    void AppendUtf8(uint32_t code, std::string &out) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+}
+
+JsonTape::JsonTape() {
+    mPosition = 0;
+}
+
+bool JsonTape::Parse(std::string_view text) {
+    Clear();
+    // Entries hold 32-bit offsets
+    if (text.size() > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    mText = text;
+    bool valid = ParseValue(0);
+    if (valid) {
+        SkipWhitespace();
+        valid = mPosition == mText.size();
+    }
+    if (!valid) {
+        Clear();
+    }
+    return valid;
+}
+
+void JsonTape::Clear() {
+    // Keeps the capacity of the entries and unescaped text for the next parse
+    mText = std::string_view();
+    mPosition = 0;
+    mEntries.clear();
+    mUnescaped.clear();
+}
+
+std::string_view JsonTape::GetText(size_t index) const {
+    const Entry &entry = mEntries[index];
+    switch (entry.mType) {
+        case JSON_TYPE_BOOL:
+        case JSON_TYPE_NUMBER:
+        case JSON_TYPE_STRING: {
+            const std::string_view source =
+                    entry.mIsUnescaped ? std::string_view(mUnescaped) : mText;
+            return source.substr(entry.mOffset, entry.mLength);
+        }
+        default:
+            return std::string_view();
+    }
+}
+
+bool JsonTape::GetBool(size_t index) const {
+    return GetType(index) == JSON_TYPE_BOOL && GetText(index) == "true";
+}
+
+size_t JsonTape::GetCount(size_t index) const {
+    const Entry &entry = mEntries[index];
+    return (entry.mType == JSON_TYPE_ARRAY || entry.mType == JSON_TYPE_OBJECT) ?
+            entry.mLength : 0;
+}
+
+bool JsonTape::ParseValue(size_t depth) {
+    SkipWhitespace();
+    if (mPosition >= mText.size()) {
+        return false;
+    }
+    switch (mText[mPosition]) {
+        case '{':
+            return ParseContainer(JSON_TYPE_OBJECT, depth);
+        case '[':
+            return ParseContainer(JSON_TYPE_ARRAY, depth);
+        case '"':
+            return ParseString();
+        case 't':
+            return ParseLiteral("true", JSON_TYPE_BOOL);
+        case 'f':
+            return ParseLiteral("false", JSON_TYPE_BOOL);
+        case 'n':
+            return ParseLiteral("null", JSON_TYPE_NULL);
+        default:
+            return ParseNumber();
+    }
+}
+
+bool JsonTape::ParseContainer(ValueType type, size_t depth) {
+    if (depth >= MAX_DEPTH) {
+        return false;
+    }
+    const size_t index = AddEntry(type, mPosition, 0);
+    const char close = type == JSON_TYPE_OBJECT ? '}' : ']';
+    ++mPosition;
+    SkipWhitespace();
+    size_t count = 0;
+    if (mPosition < mText.size() && mText[mPosition] == close) {
+        ++mPosition;
+    } else {
+        while (true) {
+            if (type == JSON_TYPE_OBJECT) {
+                SkipWhitespace();
+                if (mPosition >= mText.size() || mText[mPosition] != '"' || !ParseString()) {
+                    return false;
+                }
+                SkipWhitespace();
+                if (mPosition >= mText.size() || mText[mPosition] != ':') {
+                    return false;
+                }
+                ++mPosition;
+            }
+            if (!ParseValue(depth + 1)) {
+                return false;
+            }
+            ++count;
+            SkipWhitespace();
+            if (mPosition >= mText.size()) {
+                return false;
+            }
+            const char separator = mText[mPosition++];
+            if (separator == close) {
+                break;
+            }
+            if (separator != ',') {
+                return false;
+            }
+        }
+    }
+    mEntries[index].mLength = static_cast<uint32_t>(count);
+    mEntries[index].mNext = static_cast<uint32_t>(mEntries.size());
+    return true;
+}
+
+bool JsonTape::ParseString() {
+    const size_t start = ++mPosition;
+    bool hasEscapes = false;
+    // Skip from one quote, backslash or control character to the next,
+    // until the closing quote
+    while (true) {
+        mPosition += Encoding::FindJsonEscape(mText.substr(mPosition));
+        if (mPosition >= mText.size()) {
+            return false;
+        }
+        const char c = mText[mPosition];
+        if (c == '"') {
+            break;
+        }
+        // Control characters have to be escaped, and an escape needs
+        // something to escape
+        if (c != '\\' || mPosition + 1 >= mText.size()) {
+            return false;
+        }
+        hasEscapes = true;
+        mPosition += 2;
+    }
+    const std::string_view contents = mText.substr(start, mPosition - start);
+    ++mPosition;
+
+    if (!hasEscapes) {
+        AddEntry(JSON_TYPE_STRING, start, contents.size());
+        return true;
+    }
+    const size_t offset = mUnescaped.size();
+    if (!Unescape(contents)) {
+        return false;
+    }
+    const size_t index = AddEntry(JSON_TYPE_STRING, offset, mUnescaped.size() - offset);
+    mEntries[index].mIsUnescaped = true;
+    return true;
+}
+
+bool JsonTape::ParseNumber() {
+    const size_t start = mPosition;
+    if (mText[mPosition] == '-') {
+        ++mPosition;
+    }
+    // No leading zeros, a number starting with one is just the zero
+    if (mPosition < mText.size() && mText[mPosition] == '0') {
+        ++mPosition;
+    } else if (SkipDigits() == 0) {
+        return false;
+    }
+    if (mPosition < mText.size() && mText[mPosition] == '.') {
+        ++mPosition;
+        if (SkipDigits() == 0) {
+            return false;
+        }
+    }
+    if (mPosition < mText.size() && (mText[mPosition] == 'e' || mText[mPosition] == 'E')) {
+        ++mPosition;
+        if (mPosition < mText.size() && (mText[mPosition] == '+' || mText[mPosition] == '-')) {
+            ++mPosition;
+        }
+        if (SkipDigits() == 0) {
+            return false;
+        }
+    }
+    AddEntry(JSON_TYPE_NUMBER, start, mPosition - start);
+    return true;
+}
+
+size_t JsonTape::SkipDigits() {
+    const size_t start = mPosition;
+    while (mPosition < mText.size() && IsDigit(mText[mPosition])) {
+        ++mPosition;
+    }
+    return mPosition - start;
+}
+
+bool JsonTape::ParseLiteral(std::string_view literal, ValueType type) {
+    if (mText.compare(mPosition, literal.size(), literal) != 0) {
+        return false;
+    }
+    AddEntry(type, mPosition, literal.size());
+    mPosition += literal.size();
+    return true;
+}
+
+bool JsonTape::Unescape(std::string_view text) {
+    while (!text.empty()) {
+        // ParseString made sure every backslash has a character after it
+        const size_t runLength = Encoding::FindJsonEscape(text);
+        mUnescaped.append(text.data(), runLength);
+        if (runLength == text.size()) {
+            break;
+        }
+        const char escaped = text[runLength + 1];
+        text.remove_prefix(runLength + 2);
+        switch (escaped) {
+            case '"':
+            case '\\':
+            case '/':
+                mUnescaped += escaped;
+                break;
+            case 'b':
+                mUnescaped += '\b';
+                break;
+            case 'f':
+                mUnescaped += '\f';
+                break;
+            case 'n':
+                mUnescaped += '\n';
+                break;
+            case 'r':
+                mUnescaped += '\r';
+                break;
+            case 't':
+                mUnescaped += '\t';
+                break;
+            case 'u': {
+                uint32_t code;
+                if (!ReadUnicodeEscape(text, &code) ||
+                        (code >= LOW_SURROGATE_FIRST && code <= LOW_SURROGATE_LAST)) {
+                    return false;
+                }
+                if (code >= HIGH_SURROGATE_FIRST && code < LOW_SURROGATE_FIRST) {
+                    // Characters outside the basic plane are escaped as a
+                    // pair of surrogates
+                    uint32_t lowCode;
+                    if (text.size() < 2 || text[0] != '\\' || text[1] != 'u') {
+                        return false;
+                    }
+                    text.remove_prefix(2);
+                    if (!ReadUnicodeEscape(text, &lowCode) || lowCode < LOW_SURROGATE_FIRST ||
+                            lowCode > LOW_SURROGATE_LAST) {
+                        return false;
+                    }
+                    code = 0x10000 + ((code - HIGH_SURROGATE_FIRST) << 10) +
+                            (lowCode - LOW_SURROGATE_FIRST);
+                }
+                AppendUtf8(code, mUnescaped);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+void JsonTape::SkipWhitespace() {
+    while (mPosition < mText.size()) {
+        const char c = mText[mPosition];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+        ++mPosition;
+    }
+}
+
+size_t JsonTape::AddEntry(ValueType type, size_t offset, size_t length) {
+    const size_t index = mEntries.size();
+    mEntries.push_back({static_cast<uint8_t>(type), false, static_cast<uint32_t>(offset),
+                        static_cast<uint32_t>(length), static_cast<uint32_t>(index + 1)});
+    return index;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Parses JSON into a tape, one small entry per value in document order.
+ * Entries point into the JSON text instead of copying out of it, so the
+ * text has to outlive the tape. Only strings holding escapes are copied,
+ * unescaped, into storage of the tape's own. Arrays and objects record
+ * where their contents end, so a reader can step over a value without
+ * looking inside it. An object's contents are its keys, each followed by
+ * its value.
+ *
+ * String contents are scanned with Encoding::FindJsonEscape, which finds
+ * the closing quote, or an escape, a block of characters at a time.
+ */
+class JsonTape {
+public:
+    enum ValueType {
+        JSON_TYPE_NULL = 0,
+        JSON_TYPE_BOOL,
+        JSON_TYPE_NUMBER,
+        JSON_TYPE_STRING,
+        JSON_TYPE_ARRAY,
+        JSON_TYPE_OBJECT
+    };
+
+    // Deepest nesting of arrays and objects parsed, deeper JSON is rejected
+    static constexpr size_t MAX_DEPTH = 64;
+
+    // Index of the value the JSON consists of
+    static constexpr size_t ROOT_INDEX = 0;
+
+    JsonTape();
+
+    JsonTape(const JsonTape &) = delete;
+
+    void operator=(const JsonTape &) = delete;
+
+    /**
+     * Parses a JSON value, replacing what the tape held.
+     *
+     * @param text The JSON, which has to outlive the tape.
+     * @return false if text isn't a single JSON value, optionally
+     * surrounded by whitespace, the tape is empty then.
+     */
+    bool Parse(std::string_view text);
+
+    void Clear();
+
+    bool IsEmpty() const { return mEntries.empty(); }
+
+    ValueType GetType(size_t index) const { return static_cast<ValueType>(mEntries[index].mType); }
+
+    // The unescaped contents of a string, or the text of a number or bool,
+    // as it appears in the JSON. Empty for other values.
+    std::string_view GetText(size_t index) const;
+
+    bool GetBool(size_t index) const;
+
+    // Number of values in an array, or members in an object
+    size_t GetCount(size_t index) const;
+
+    // Index of the first value in an array, or the first key in an object
+    size_t GetFirstChild(size_t index) const { return index + 1; }
+
+    // Index of the value after this one, stepping over its contents
+    size_t GetNext(size_t index) const { return mEntries[index].mNext; }
+
+private:
+    struct Entry {
+        uint8_t mType;
+        // Text is in mUnescaped instead of the JSON
+        bool mIsUnescaped;
+        uint32_t mOffset;
+        // Length of the text, or the count of an array or object
+        uint32_t mLength;
+        uint32_t mNext;
+    };
+
+    bool ParseValue(size_t depth);
+
+    bool ParseContainer(ValueType type, size_t depth);
+
+    bool ParseString();
+
+    bool ParseNumber();
+
+    // Steps over a run of digits, returns how many there were
+    size_t SkipDigits();
+
+    bool ParseLiteral(std::string_view literal, ValueType type);
+
+    bool Unescape(std::string_view text);
+
+    void SkipWhitespace();
+
+    size_t AddEntry(ValueType type, size_t offset, size_t length);
+
+    std::string_view mText;
+    // Position of the parser in mText
+    size_t mPosition;
+    std::vector<Entry> mEntries;
+    std::string mUnescaped;
+};
@@ -15,131 +15,133 @@
  */
 
 #include "json_util.hpp"
-#include "json/json.h"
+
 #include <algorithm>
+#include <cctype>
+
+namespace {
+    bool IsBool(JsonTape::ValueType type) {
+        return type == JsonTape::JSON_TYPE_BOOL;
+    }
+
+    bool IsString(JsonTape::ValueType type) {
+        return type == JsonTape::JSON_TYPE_STRING;
+    }
+
+    bool IsArray(JsonTape::ValueType type) {
+        return type == JsonTape::JSON_TYPE_ARRAY;
+    }
+
+    bool IsScalar(JsonTape::ValueType type) {
+        return type != JsonTape::JSON_TYPE_ARRAY && type != JsonTape::JSON_TYPE_OBJECT;
+    }
+}
 
 JsonLookup::JsonLookup() {
+    mObjectIndex = JsonTape::ROOT_INDEX;
     mIsValid = false;
-    mReader = std::unique_ptr<Json::Reader>(new Json::Reader());
-    mValue = std::unique_ptr<Json::Value>(new Json::Value());
 }
 
 JsonLookup::~JsonLookup() {
 }
 
-bool JsonLookup::CompareInsensitive(const std::string &a, const std::string &b) {
-    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char a, char b) {
-        return tolower(a) == tolower(b);
+JsonLookup::JsonLookup(JsonLookup &&other) = default;
+
+bool JsonLookup::CompareInsensitive(std::string_view a, std::string_view b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char left, char right) {
+        return tolower(left) == tolower(right);
     });
 }
 
 bool JsonLookup::ParseJson(const std::string &jsonString) {
-    mIsValid = mReader.get()->parse(jsonString, *mValue.get());
+    // Reuse the tape's storage, unless lookups made from it still need it
+    if (!mTape || mTape.use_count() > 1) {
+        mTape = std::make_shared<JsonTape>();
+    }
+    mObjectIndex = JsonTape::ROOT_INDEX;
+    mIsValid = mTape->Parse(jsonString);
     return mIsValid;
 }
 
-const Json::Value &JsonLookup::GetObjectForKey(const std::string &keyString,
-                                               bool &foundObject) const {
-    const Json::Value &jsonObject = *mValue.get();
-    return JsonLookup::GetObjectForKeyFromObject(keyString, foundObject, jsonObject);
-}
-
 std::optional<bool> JsonLookup::GetBoolValueForKey(const std::string &keyString) const {
-    if (mIsValid) {
-        const Json::Value &jsonObject = *mValue.get();
-        if (jsonObject.type() == Json::objectValue) {
-            auto keys = jsonObject.getMemberNames();
-            for (size_t i = 0; i < keys.size(); ++i) {
-                const std::string &key = keys[i];
-                if (JsonLookup::CompareInsensitive(key, keyString)) {
-                    const Json::Value value = jsonObject[key];
-                    const Json::ValueType valueType = value.type();
-                    if (valueType == Json::booleanValue) {
-                        return value.asBool();
-                    }
-                }
-            }
-        }
+    auto valueIndex = FindValueForKey(keyString, IsBool);
+    if (valueIndex) {
+        return mTape->GetBool(*valueIndex);
     }
     return std::nullopt;
 }
 
 std::optional<std::string> JsonLookup::GetStringValueForKey(const std::string &keyString) const {
-    if (mIsValid) {
-        return JsonLookup::GetValueForKeyFromObject(keyString, *mValue.get());
+    auto valueIndex = FindValueForKey(keyString, IsScalar);
+    if (valueIndex) {
+        return std::string(mTape->GetText(*valueIndex));
     }
     return std::nullopt;
 }
 
-std::optional<std::string> JsonLookup::GetValueForKeyFromObject(const std::string &keyString,
-                                                                const Json::Value &jsonObject) {
-    if (jsonObject.type() == Json::objectValue) {
-        auto keys = jsonObject.getMemberNames();
-        for (size_t i = 0; i < keys.size(); ++i) {
-            const std::string &key = keys[i];
-            if (JsonLookup::CompareInsensitive(key, keyString)) {
-                const Json::Value value = jsonObject[key];
-                const Json::ValueType valueType = value.type();
-                if (!(valueType == Json::arrayValue || valueType == Json::objectValue)) {
-                    return value.asString();
-                }
-            }
-        }
+std::optional<std::string_view> JsonLookup::GetStringViewForKey(
+        const std::string &keyString) const {
+    auto valueIndex = FindValueForKey(keyString, IsString);
+    if (valueIndex) {
+        return mTape->GetText(*valueIndex);
     }
     return std::nullopt;
 }
 
-const Json::Value &JsonLookup::GetArrayForKeyFromObject(const std::string &keyString,
-                                                        bool &foundObject,
-                                                        const Json::Value &jsonObject) {
-    return JsonLookup::GetTypeForKeyFromObject(keyString, foundObject, jsonObject,
-                                               Json::arrayValue);
-}
-
-const Json::Value &JsonLookup::GetObjectForKeyFromObject(const std::string &keyString,
-                                                         bool &foundObject,
-                                                         const Json::Value &jsonObject) {
-    return JsonLookup::GetTypeForKeyFromObject(keyString, foundObject, jsonObject,
-                                               Json::objectValue);
+std::optional<std::vector<std::string>> JsonLookup::GetStringArrayForKey(
+        const std::string &keyString) const {
+    auto arrayIndex = FindValueForKey(keyString, IsArray);
+    if (arrayIndex) {
+        const JsonTape &tape = *mTape;
+        std::vector<std::string> arrayStrings;
+        size_t index = tape.GetFirstChild(*arrayIndex);
+        for (size_t i = 0; i < tape.GetCount(*arrayIndex); ++i) {
+            if (tape.GetType(index) == JsonTape::JSON_TYPE_STRING) {
+                arrayStrings.emplace_back(tape.GetText(index));
+            }
+            index = tape.GetNext(index);
+        }
+        return arrayStrings;
+    }
+    return std::nullopt;
 }
 
-const Json::Value &JsonLookup::GetTypeForKeyFromObject(const std::string &keyString,
-                                                       bool &foundObject,
-                                                       const Json::Value &jsonObject,
-                                                       const int valueType) {
-    if (jsonObject.type() == Json::objectValue) {
-        auto keys = jsonObject.getMemberNames();
-        for (size_t i = 0; i < keys.size(); ++i) {
-            const std::string &key = keys[i];
-            if (JsonLookup::CompareInsensitive(key, keyString)) {
-                const Json::Value &value = jsonObject[key];
-                if (valueType == value.type()) {
-                    foundObject = true;
-                    return value;
-                }
+std::optional<std::vector<JsonLookup>> JsonLookup::GetObjectArrayForKey(
+        const std::string &keyString) const {
+    auto arrayIndex = FindValueForKey(keyString, IsArray);
+    if (arrayIndex) {
+        const JsonTape &tape = *mTape;
+        std::vector<JsonLookup> arrayLookups;
+        size_t index = tape.GetFirstChild(*arrayIndex);
+        for (size_t i = 0; i < tape.GetCount(*arrayIndex); ++i) {
+            if (tape.GetType(index) == JsonTape::JSON_TYPE_OBJECT) {
+                JsonLookup elementLookup;
+                elementLookup.mTape = mTape;
+                elementLookup.mObjectIndex = index;
+                elementLookup.mIsValid = true;
+                arrayLookups.push_back(std::move(elementLookup));
             }
+            index = tape.GetNext(index);
         }
+        return arrayLookups;
     }
-
-    // Return the root object if there is no match
-    foundObject = false;
-    return jsonObject;
+    return std::nullopt;
 }
 
-bool JsonLookup::FindMatchingStringValueInArray(const std::string &valueString,
-                                                const Json::Value &jsonObject) {
-    bool foundMatch = false;
-    if (jsonObject.type() == Json::arrayValue) {
-        for (Json::Value::ArrayIndex i = 0; i != jsonObject.size(); i++) {
-            const Json::Value &arrayValue = jsonObject[i];
-            if (arrayValue.type() == Json::stringValue) {
-                const std::string &arrayString = arrayValue.asString();
-                if (arrayString == valueString) {
-                    foundMatch = true;
-                    break;
-                }
-            }
+std::optional<size_t> JsonLookup::FindValueForKey(
+        const std::string &keyString, bool (*accept)(JsonTape::ValueType type)) const {
+    if (!mIsValid || mTape->GetType(mObjectIndex) != JsonTape::JSON_TYPE_OBJECT) {
+        return std::nullopt;
+    }
+    const JsonTape &tape = *mTape;
+    size_t keyIndex = tape.GetFirstChild(mObjectIndex);
+    for (size_t i = 0; i < tape.GetCount(mObjectIndex); ++i) {
+        const size_t valueIndex = tape.GetNext(keyIndex);
+        if (CompareInsensitive(tape.GetText(keyIndex), keyString) &&
+                accept(tape.GetType(valueIndex))) {
+            return valueIndex;
         }
+        keyIndex = tape.GetNext(valueIndex);
     }
-    return foundMatch;
-}
\ No newline at end of file
+    return std::nullopt;
+}
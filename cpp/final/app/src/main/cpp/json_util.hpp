@@ -16,29 +16,64 @@
 
 #pragma once
 
-#include <string>
+#if !JSON_LOOKUP_JSONCPP
+#include "json_tape.hpp"
+#endif
+
+#include <memory>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#if JSON_LOOKUP_JSONCPP
 namespace Json {
     class Reader;
     class Value;
 }
+#endif
 
-// Minimal utility class for parsing a JSON object with JsonCpp
+/*
+ * Minimal utility class for parsing a JSON object. Keys are matched
+ * ignoring case.
+ *
+ * Parsing is done by JsonTape, which indexes the JSON where it is instead
+ * of building a tree of copies of it, so the string given to ParseJson
+ * has to outlive the lookup and the lookups made from it. Building with
+ * JSON_LOOKUP_JSONCPP (the USE_JSONCPP CMake option) parses with JsonCpp
+ * instead, for comparing the two.
+ */
 class JsonLookup {
 public:
     JsonLookup();
 
     ~JsonLookup();
 
-    bool ParseJson(const std::string &jsonString);
+    JsonLookup(JsonLookup &&other);
 
-    const Json::Value &GetObjectForKey(const std::string &keyString, bool &foundObject) const;
+    bool ParseJson(const std::string &jsonString);
 
     std::optional<bool> GetBoolValueForKey(const std::string &keyString) const;
 
+    // Returns the text of any value that isn't an array or object
     std::optional<std::string> GetStringValueForKey(const std::string &keyString) const;
 
+    // Returns a string value without copying it, the view is good for as
+    // long as the lookup is
+    std::optional<std::string_view> GetStringViewForKey(const std::string &keyString) const;
+
+    std::optional<std::vector<std::string>> GetStringArrayForKey(
+            const std::string &keyString) const;
+
+    // Returns a lookup for each object in the array, other array values are skipped
+    std::optional<std::vector<JsonLookup>> GetObjectArrayForKey(
+            const std::string &keyString) const;
+
+    static bool CompareInsensitive(std::string_view a, std::string_view b);
+
+#if JSON_LOOKUP_JSONCPP
+    const Json::Value &GetObjectForKey(const std::string &keyString, bool &foundObject) const;
+
     static const Json::Value &GetArrayForKeyFromObject(const std::string &keyString,
                                                        bool &foundObject,
                                                        const Json::Value &jsonObject);
@@ -57,11 +92,22 @@ public:
 
     static bool FindMatchingStringValueInArray(const std::string &valueString,
                                                const Json::Value &jsonObject);
-
-    static bool CompareInsensitive(const std::string &a, const std::string &b);
+#endif
 
 private:
+#if JSON_LOOKUP_JSONCPP
     std::unique_ptr<Json::Reader> mReader;
     std::unique_ptr<Json::Value> mValue;
+#else
+    // Tape index of the value of the first member named keyString whose
+    // type accept takes
+    std::optional<size_t> FindValueForKey(const std::string &keyString,
+                                          bool (*accept)(JsonTape::ValueType type)) const;
+
+    // Shared with the lookups made for objects in arrays
+    std::shared_ptr<JsonTape> mTape;
+    // Index on the tape of the object this lookup looks in
+    size_t mObjectIndex;
+#endif
     bool mIsValid;
-};
\ No newline at end of file
+};
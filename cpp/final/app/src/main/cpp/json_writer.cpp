@@ -0,0 +1,202 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "json_writer.hpp"
+#include "encoding.hpp"
+
+namespace {
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    // Longest text of a 64-bit integer, sign included
+    constexpr size_t MAX_INTEGER_LENGTH = 20;
+
+    // Short escape for a character, or 0 if it needs the \u form
+    char GetShortEscape(char c) {
+        switch (c) {
+            case '"':
+                return '"';
+            case '\\':
+                return '\\';
+            case '\b':
+                return 'b';
+            case '\f':
+                return 'f';
+            case '\n':
+                return 'n';
+            case '\r':
+                return 'r';
+            case '\t':
+                return 't';
+            default:
+                return 0;
+        }
+    }
+
+    // Writes the digits of value backwards from end, returns where they start
+    char *FormatDigits(uint64_t value, char *end) {
+        do {
+            *--end = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        return end;
+    }
+}
+
+JsonWriter::JsonWriter(std::string *buffer) {
+    mBuffer = buffer;
+    mSize = 0;
+    mDepth = 0;
+    mHasValue = 0;
+    mAfterKey = false;
+    mValid = true;
+}
+
+void JsonWriter::BeginObject() {
+    BeginValue();
+    if (Push()) {
+        Write('{');
+    }
+}
+
+void JsonWriter::EndObject() {
+    if (Pop()) {
+        Write('}');
+    }
+}
+
+void JsonWriter::BeginArray() {
+    BeginValue();
+    if (Push()) {
+        Write('[');
+    }
+}
+
+void JsonWriter::EndArray() {
+    if (Pop()) {
+        Write(']');
+    }
+}
+
+void JsonWriter::Key(std::string_view key) {
+    BeginValue();
+    Write('"');
+    WriteEscaped(key);
+    Write("\":", 2);
+    mAfterKey = true;
+}
+
+void JsonWriter::String(std::string_view value) {
+    BeginValue();
+    Write('"');
+    WriteEscaped(value);
+    Write('"');
+}
+
+void JsonWriter::Uint(uint64_t value) {
+    BeginValue();
+    char digits[MAX_INTEGER_LENGTH];
+    char *end = digits + MAX_INTEGER_LENGTH;
+    char *start = FormatDigits(value, end);
+    Write(start, end - start);
+}
+
+void JsonWriter::Int(int64_t value) {
+    BeginValue();
+    // Negate as unsigned, the lowest value has no positive counterpart
+    const uint64_t magnitude = value < 0 ? uint64_t(0) - uint64_t(value) : uint64_t(value);
+    char digits[MAX_INTEGER_LENGTH];
+    char *end = digits + MAX_INTEGER_LENGTH;
+    char *start = FormatDigits(magnitude, end);
+    if (value < 0) {
+        *--start = '-';
+    }
+    Write(start, end - start);
+}
+
+void JsonWriter::Bool(bool value) {
+    BeginValue();
+    if (value) {
+        Write("true", 4);
+    } else {
+        Write("false", 5);
+    }
+}
+
+void JsonWriter::BeginValue() {
+    if (mAfterKey) {
+        mAfterKey = false;
+        return;
+    }
+    if (mDepth == 0) {
+        return;
+    }
+    const uint64_t levelBit = uint64_t(1) << (mDepth - 1);
+    if ((mHasValue & levelBit) != 0) {
+        Write(',');
+    }
+    mHasValue |= levelBit;
+}
+
+bool JsonWriter::Push() {
+    // One bit of mHasValue per level
+    static_assert(MAX_DEPTH <= 64, "MAX_DEPTH levels don't fit in mHasValue");
+    if (mDepth >= MAX_DEPTH) {
+        mValid = false;
+        return false;
+    }
+    ++mDepth;
+    return true;
+}
+
+bool JsonWriter::Pop() {
+    if (mDepth == 0) {
+        mValid = false;
+        return false;
+    }
+    mHasValue &= ~(uint64_t(1) << --mDepth);
+    return true;
+}
+
+void JsonWriter::Write(const char *data, size_t size) {
+    if (!mValid) {
+        return;
+    }
+    if (mBuffer != nullptr) {
+        mBuffer->append(data, size);
+    }
+    mSize += size;
+}
+
+void JsonWriter::WriteEscaped(std::string_view text) {
+    while (!text.empty()) {
+        const size_t runLength = Encoding::FindJsonEscape(text);
+        Write(text.data(), runLength);
+        if (runLength == text.size()) {
+            break;
+        }
+        const char c = text[runLength];
+        const char shortEscape = GetShortEscape(c);
+        if (shortEscape != 0) {
+            const char escape[] = {'\\', shortEscape};
+            Write(escape, sizeof(escape));
+        } else {
+            const uint8_t value = static_cast<uint8_t>(c);
+            const char escape[] = {'\\', 'u', '0', '0', HEX_DIGITS[value >> 4],
+                                   HEX_DIGITS[value & 0x0F]};
+            Write(escape, sizeof(escape));
+        }
+        text.remove_prefix(runLength + 1);
+    }
+}
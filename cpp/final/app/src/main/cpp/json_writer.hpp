@@ -0,0 +1,100 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * Writes compact JSON in a single pass. String values are scanned for the
+ * characters JSON has to escape with Encoding::FindJsonEscape, and the
+ * runs between them are copied as they are.
+ *
+ * A writer without a buffer only counts the characters it would write, so
+ * the same code that writes a document can size its buffer first, and a
+ * buffer kept from one document to the next is only ever allocated once.
+ */
+class JsonWriter {
+public:
+    // Deepest nesting of objects and arrays a writer accepts
+    static constexpr uint32_t MAX_DEPTH = 64;
+
+    /**
+     * @param buffer The JSON is appended to it, or null to only count the
+     * size of the JSON.
+     */
+    explicit JsonWriter(std::string *buffer);
+
+    JsonWriter(const JsonWriter &) = delete;
+
+    void operator=(const JsonWriter &) = delete;
+
+    void BeginObject();
+
+    void EndObject();
+
+    void BeginArray();
+
+    void EndArray();
+
+    // Starts a member of the current object, the next call writes its value
+    void Key(std::string_view key);
+
+    void String(std::string_view value);
+
+    void Uint(uint64_t value);
+
+    void Int(int64_t value);
+
+    void Bool(bool value);
+
+    // Number of characters written, or counted, so far
+    size_t GetSize() const { return mSize; }
+
+    // False once objects and arrays were nested deeper than MAX_DEPTH, or
+    // ended without being begun. The writer stops writing at that point,
+    // leaving the JSON incomplete.
+    bool IsValid() const { return mValid; }
+
+private:
+    // Writes the comma that goes before every value in an object or array
+    // but the first
+    void BeginValue();
+
+    void Write(const char *data, size_t size);
+
+    void Write(char c) { Write(&c, 1); }
+
+    void WriteEscaped(std::string_view text);
+
+    // Enters a new level of nesting, or fails the writer if that is too deep
+    bool Push();
+
+    // Leaves the current level of nesting, or fails the writer if there is none
+    bool Pop();
+
+    std::string *mBuffer;
+    size_t mSize;
+    // Nesting depth, and a bit for each level set once it has a value
+    uint32_t mDepth;
+    uint64_t mHasValue;
+    // A key was written, its value needs no comma
+    bool mAfterKey;
+    bool mValid;
+};
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#define LOG_TAG "PlayIntegritySample"
+
+#ifdef __ANDROID__
+
+#include <android/log.h>
+
+#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__);
+#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__);
+#ifdef NDEBUG
+#define ALOGV(...)
+#else
+#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__);
+#endif
+
+#else
+
+// Host builds, like the tests, log to stderr
+#include <cstdio>
+
+#define ALOG_HOST(level, ...) { fprintf(stderr, "%s/" LOG_TAG ": ", level); \
+   fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); }
+
+#define ALOGE(...) ALOG_HOST("E", __VA_ARGS__);
+#define ALOGW(...) ALOG_HOST("W", __VA_ARGS__);
+#define ALOGI(...) ALOG_HOST("I", __VA_ARGS__);
+#ifdef NDEBUG
+#define ALOGV(...)
+#else
+#define ALOGV(...) ALOG_HOST("V", __VA_ARGS__);
+#endif
+
+#endif
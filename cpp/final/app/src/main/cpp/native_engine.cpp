@@ -37,6 +37,10 @@
 // max # of GL errors to print before giving up
 #define MAX_GL_ERRORS 200
 
+// how often (in milliseconds) to update the client manager while we aren't
+// animating but it still has commands to wind down
+#define CLIENT_MANAGER_WIND_DOWN_POLL_MS 100
+
 static NativeEngine *_singleton = NULL;
 
 // workaround for internal bug b/149866792
@@ -190,7 +194,13 @@ void NativeEngine::GameLoop() {
         struct android_poll_source *source;
 
         // If not animating, block until we get an event; if animating, don't block.
-        while ((ALooper_pollAll(IsAnimating() ? 0 : -1, NULL, &events, (void **) &source)) >= 0) {
+        // While the client manager is winding down outstanding commands, wake
+        // up periodically to let it finish or cancel them.
+        const bool clientManagerWindingDown =
+                mClientManager != NULL && mClientManager->HasPendingCancellation();
+        const int pollTimeout = IsAnimating() ? 0 :
+                (clientManagerWindingDown ? CLIENT_MANAGER_WIND_DOWN_POLL_MS : -1);
+        while ((ALooper_pollAll(pollTimeout, NULL, &events, (void **) &source)) >= 0) {
 
             // process event
             if (source != NULL) {
@@ -207,6 +217,8 @@ void NativeEngine::GameLoop() {
 
         if (IsAnimating()) {
             DoFrame();
+        } else if (mClientManager != NULL && mClientManager->HasPendingCancellation()) {
+            mClientManager->Update();
         }
     }
 }
@@ -288,14 +300,23 @@ void NativeEngine::HandleCommand(int32_t cmd) {
         case APP_CMD_PAUSE:
             VLOGD("NativeEngine: APP_CMD_PAUSE");
             mgr->OnPause();
+            if (mClientManager != NULL) {
+                mClientManager->Suspend();
+            }
             break;
         case APP_CMD_RESUME:
             VLOGD("NativeEngine: APP_CMD_RESUME");
             mgr->OnResume();
+            if (mClientManager != NULL) {
+                mClientManager->Resume();
+            }
             break;
         case APP_CMD_STOP:
             VLOGD("NativeEngine: APP_CMD_STOP");
             mIsVisible = false;
+            if (mClientManager != NULL) {
+                mClientManager->Suspend();
+            }
             break;
         case APP_CMD_START:
             VLOGD("NativeEngine: APP_CMD_START");
@@ -478,7 +499,13 @@ bool NativeEngine::PrepareToRender() {
         }
 
         if (mClientManager == NULL) {
-            mClientManager = new ClientManager();
+            ClientContext clientContext;
+            clientContext.mVm = mApp->activity->vm;
+            clientContext.mActivity = mApp->activity->javaGameActivity;
+            clientContext.mDataPath = mApp->activity->internalDataPath;
+            clientContext.mTransport = std::make_shared<HTTPTransport>();
+            clientContext.mClock = Clock;
+            mClientManager = new ClientManager(clientContext);
         }
     }
     if (!mHasGLObjects) {
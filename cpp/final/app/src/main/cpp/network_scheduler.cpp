@@ -0,0 +1,66 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "network_scheduler.hpp"
+
+NetworkScheduler::NetworkScheduler(const Config &config, std::function<float()> clock)
+        : mClock(clock) {
+    mConfig = config;
+    mStats = {};
+    mHasActivity = false;
+    mLastActivityTime = 0.0f;
+    mDeferredSinceActivity = false;
+}
+
+void NetworkScheduler::RecordActivity() {
+    ++mStats.requests;
+    if (!IsRadioAwake()) {
+        ++mStats.wakeups;
+    }
+    mHasActivity = true;
+    mLastActivityTime = mClock();
+    mDeferredSinceActivity = false;
+}
+
+bool NetworkScheduler::CanSendDeferrable() const {
+    if (mConfig.wakeInterval <= 0.0f || IsRadioAwake()) {
+        return true;
+    }
+    // Nothing has woken the radio for a whole interval, wake it ourselves.
+    // The request made then keeps the window open for the rest of the
+    // deferred work.
+    return !mHasActivity || (mClock() - mLastActivityTime) >= mConfig.wakeInterval;
+}
+
+void NetworkScheduler::RecordDeferrableSend() {
+    if (IsRadioAwake()) {
+        ++mStats.piggybacked;
+    } else {
+        ++mStats.windowsOpened;
+    }
+}
+
+void NetworkScheduler::RecordDeferred() {
+    // Work is checked for every frame, count each wait once
+    if (!mDeferredSinceActivity) {
+        mDeferredSinceActivity = true;
+        ++mStats.deferred;
+    }
+}
+
+bool NetworkScheduler::IsRadioAwake() const {
+    return mHasActivity && (mClock() - mLastActivityTime) < mConfig.radioTailTime;
+}
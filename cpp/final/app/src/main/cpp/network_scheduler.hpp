@@ -0,0 +1,93 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+/*
+ * Lines up network work that can wait with the radio being awake anyway.
+ * After any request, a cellular radio stays in a high power state for a
+ * few seconds before dropping back to idle, and every request made from
+ * idle pays to wake it up again. Work that can wait (prefetches, replays,
+ * background commands) goes out while the radio is still up from an
+ * urgent request, and otherwise waits for a wake window, at most one wake
+ * interval after the radio was last used. Urgent work is never held back.
+ */
+class NetworkScheduler {
+public:
+    struct Config {
+        // Longest time in seconds deferrable work waits for the radio to be
+        // woken by something else, zero or less sends it right away
+        float wakeInterval;
+        // Seconds the radio is assumed to stay awake after a request
+        float radioTailTime;
+    };
+
+    struct Stats {
+        // Network requests made
+        uint64_t requests;
+        // Requests made while the radio was idle, each one wakes it up
+        uint64_t wakeups;
+        // Deferrable requests that woke the radio because a wake window opened
+        uint64_t windowsOpened;
+        // Deferrable requests sent while the radio was already awake
+        uint64_t piggybacked;
+        // Times deferrable work was held back, counted at most once
+        // between two requests
+        uint64_t deferred;
+    };
+
+    /**
+     * Constructs a network scheduler.
+     *
+     * @param config Window configuration.
+     * @param clock Returns the current time in seconds.
+     */
+    NetworkScheduler(const Config &config, std::function<float()> clock);
+
+    void SetConfig(const Config &config) { mConfig = config; }
+
+    const Config &GetConfig() const { return mConfig; }
+
+    const Stats &GetStats() const { return mStats; }
+
+    // Records that a network request was just made, urgent or not
+    void RecordActivity();
+
+    // True if work that can wait should be sent now
+    bool CanSendDeferrable() const;
+
+    // Records that deferrable work is being sent, call before its request
+    // is recorded with RecordActivity
+    void RecordDeferrableSend();
+
+    // Records that deferrable work was ready and held back
+    void RecordDeferred();
+
+    // True if the radio is expected to still be awake from the last request
+    bool IsRadioAwake() const;
+
+private:
+    Config mConfig;
+    Stats mStats;
+    std::function<float()> mClock;
+    bool mHasActivity;
+    float mLastActivityTime;
+    // A deferral was counted since the last request
+    bool mDeferredSinceActivity;
+};
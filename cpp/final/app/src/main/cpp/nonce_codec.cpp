@@ -0,0 +1,99 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "nonce_codec.hpp"
+
+#include <cstring>
+
+namespace {
+    constexpr size_t NONCE_PARTS_SIZE = RANDOM_SIZE + SHA256_DIGEST_SIZE;
+
+    static_assert(NonceCodec::GetEncodedLength(NonceCodec::NONCE_FORMAT_HEX) <= NONCE_MAX_LENGTH &&
+                  NonceCodec::GetEncodedLength(NonceCodec::NONCE_FORMAT_COMPACT) <=
+                          NONCE_MAX_LENGTH,
+                  "NonceString is too short for a nonce format");
+    // Formats are told apart by length
+    static_assert(NonceCodec::GetEncodedLength(NonceCodec::NONCE_FORMAT_HEX) !=
+                  NonceCodec::GetEncodedLength(NonceCodec::NONCE_FORMAT_COMPACT),
+                  "Nonce formats have the same length");
+}
+
+bool NonceCodec::Encode(NonceFormat format, std::string_view randomHex, std::string_view hashHex,
+                        NonceString *nonce) {
+    if (randomHex.size() != RANDOM_LENGTH || hashHex.size() != SHA256_HEX_LENGTH) {
+        return false;
+    }
+    if (format == NONCE_FORMAT_COMPACT) {
+        uint8_t parts[NONCE_PARTS_SIZE];
+        if (!Encoding::HexDecode(randomHex, parts) ||
+                !Encoding::HexDecode(hashHex, parts + RANDOM_SIZE)) {
+            return false;
+        }
+        nonce->Clear();
+        Encoding::Base64UrlEncode(parts, sizeof(parts),
+                                  nonce->Extend(GetEncodedLength(NONCE_FORMAT_COMPACT)));
+        return true;
+    }
+    if (!Encoding::IsHex(randomHex) || !Encoding::IsHex(hashHex)) {
+        return false;
+    }
+    nonce->Assign(randomHex);
+    nonce->Append(hashHex);
+    return true;
+}
+
+std::optional<NonceCodec::NonceFormat> NonceCodec::Decode(std::string_view nonce,
+                                                          NonceParts *parts) {
+    uint8_t decoded[NONCE_PARTS_SIZE];
+    NonceFormat format;
+    if (nonce.size() == GetEncodedLength(NONCE_FORMAT_HEX)) {
+        format = NONCE_FORMAT_HEX;
+        if (!Encoding::HexDecode(nonce, decoded)) {
+            return std::nullopt;
+        }
+    } else if (nonce.size() == GetEncodedLength(NONCE_FORMAT_COMPACT)) {
+        format = NONCE_FORMAT_COMPACT;
+        if (!Encoding::Base64UrlDecode(nonce, decoded)) {
+            return std::nullopt;
+        }
+    } else {
+        return std::nullopt;
+    }
+    memcpy(parts->mRandom, decoded, RANDOM_SIZE);
+    memcpy(parts->mHash.data(), decoded + RANDOM_SIZE, SHA256_DIGEST_SIZE);
+    return format;
+}
+
+const char *NonceCodec::GetFormatName(NonceFormat format) {
+    switch (format) {
+        case NONCE_FORMAT_HEX:
+            return "hex";
+        case NONCE_FORMAT_COMPACT:
+            return "base64url";
+        default:
+            return "unknown";
+    }
+}
+
+std::optional<NonceCodec::NonceFormat> NonceCodec::GetFormatForName(std::string_view name) {
+    for (int i = 0; i < NONCE_FORMAT_COUNT; ++i) {
+        if (name == GetFormatName(static_cast<NonceFormat>(i))) {
+            return static_cast<NonceFormat>(i);
+        }
+    }
+    return std::nullopt;
+}
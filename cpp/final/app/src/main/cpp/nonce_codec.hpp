@@ -0,0 +1,76 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "constexpr_sha256.hpp"
+#include "encoding.hpp"
+#include "token_strings.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+/*
+ * Encodes and decodes the nonces sent to Play Integrity, a server random
+ * followed by the SHA-256 of what the nonce covers. There are two formats:
+ * hex (the random hex followed by the hash hex, 96 characters), which
+ * every server understands, and compact (the base64url of the raw 16 + 32
+ * bytes, 64 characters), used with servers that say they accept it. The
+ * lengths differ, so a nonce's format can be told from its length.
+ */
+class NonceCodec {
+public:
+    enum NonceFormat {
+        NONCE_FORMAT_HEX = 0,
+        NONCE_FORMAT_COMPACT,
+        NONCE_FORMAT_COUNT
+    };
+
+    // The raw contents of a nonce
+    struct NonceParts {
+        uint8_t mRandom[RANDOM_SIZE];
+        Sha256Digest mHash;
+    };
+
+    static constexpr size_t GetEncodedLength(NonceFormat format) {
+        return format == NONCE_FORMAT_COMPACT ?
+                Encoding::GetBase64UrlEncodedLength(RANDOM_SIZE + SHA256_DIGEST_SIZE) :
+                RANDOM_LENGTH + SHA256_HEX_LENGTH;
+    }
+
+    /**
+     * Builds a nonce from its hex parts.
+     *
+     * @param format Format of the nonce.
+     * @param randomHex The server random, RANDOM_LENGTH hex digits.
+     * @param hashHex The hash, SHA256_HEX_LENGTH hex digits.
+     * @param nonce Receives the nonce.
+     * @return false if either part isn't the right length of hex.
+     */
+    static bool Encode(NonceFormat format, std::string_view randomHex, std::string_view hashHex,
+                       NonceString *nonce);
+
+    // Returns the format of nonce and writes its contents to parts, or
+    // nothing if nonce isn't valid in either format
+    static std::optional<NonceFormat> Decode(std::string_view nonce, NonceParts *parts);
+
+    // Name of a format in the server's nonceFormats list
+    static const char *GetFormatName(NonceFormat format);
+
+    static std::optional<NonceFormat> GetFormatForName(std::string_view name);
+};
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "nonce_session.hpp"
+#include "encoding.hpp"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+namespace {
+    // Randoms made this close (in seconds) to the end of the session might
+    // not reach the server in time, commands fall back to server randoms
+    constexpr float SESSION_END_MARGIN = 60.0f;
+    // A new session is fetched this long (in seconds) before the current one ends
+    constexpr float SESSION_RENEWAL_MARGIN = 300.0f;
+    // Longest HMAC message, "<session id>:<counter>:<time>"
+    constexpr size_t SESSION_MESSAGE_MAX_LENGTH = SESSION_ID_MAX_LENGTH + 2 * 21;
+
+    int64_t GetWallTimeMillis() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
+
+NonceSession::NonceSession() {
+    mCounter = 0;
+    mClockOffset = 0;
+    mExpireTime = 0.0f;
+    mStarted = false;
+    mStats = {};
+}
+
+bool NonceSession::Start(std::string_view sessionId, std::string_view secretHex,
+                         int64_t serverTime, float lifetime, float currentTime) {
+    uint8_t secret[SESSION_SECRET_SIZE];
+    if (sessionId.empty() || sessionId.size() > SESSION_ID_MAX_LENGTH ||
+            sessionId.find(':') != std::string_view::npos ||
+            secretHex.size() != Encoding::GetHexEncodedLength(SESSION_SECRET_SIZE) ||
+            !Encoding::HexDecode(secretHex, secret) || lifetime <= 0.0f) {
+        return false;
+    }
+    mSessionId.Assign(sessionId);
+    memcpy(mSecret, secret, sizeof(mSecret));
+    // The server counts from the first counter it sees, each session starts over
+    mCounter = 0;
+    mClockOffset = serverTime - GetWallTimeMillis();
+    mExpireTime = currentTime + lifetime;
+    mStarted = true;
+    ++mStats.started;
+    return true;
+}
+
+void NonceSession::End() {
+    mSessionId.Clear();
+    memset(mSecret, 0, sizeof(mSecret));
+    mStarted = false;
+}
+
+bool NonceSession::IsActive(float currentTime) const {
+    return mStarted && currentTime < (mExpireTime - SESSION_END_MARGIN);
+}
+
+bool NonceSession::NeedsRenewal(float currentTime) const {
+    return !mStarted || currentTime >= (mExpireTime - SESSION_RENEWAL_MARGIN);
+}
+
+std::optional<NonceSession::SessionRandom> NonceSession::NextRandom(float currentTime) {
+    if (!IsActive(currentTime)) {
+        if (mStarted && currentTime >= mExpireTime) {
+            ++mStats.expired;
+            End();
+        }
+        return std::nullopt;
+    }
+
+    SessionRandom sessionRandom;
+    sessionRandom.mCounter = ++mCounter;
+    sessionRandom.mTime = GetWallTimeMillis() + mClockOffset;
+    char message[SESSION_MESSAGE_MAX_LENGTH + 1];
+    const int messageLength = snprintf(message, sizeof(message), "%s:%" PRIu64 ":%" PRId64,
+                                       mSessionId.GetCString(), sessionRandom.mCounter,
+                                       sessionRandom.mTime);
+    uint8_t mac[EVP_MAX_MD_SIZE];
+    unsigned int macSize = 0;
+    HMAC(EVP_sha256(), mSecret, sizeof(mSecret), reinterpret_cast<const uint8_t *>(message),
+         messageLength, mac, &macSize);
+    Encoding::HexEncode(mac, RANDOM_SIZE, sessionRandom.mRandom.Extend(RANDOM_LENGTH));
+    ++mStats.generated;
+    return sessionRandom;
+}
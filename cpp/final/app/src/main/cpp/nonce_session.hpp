@@ -0,0 +1,94 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "token_strings.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+/*
+ * Lets the client make up the random part of its nonces instead of
+ * fetching each one from the server. The server issues a session id and
+ * a secret that last a long time. Each random is the HMAC-SHA256, keyed
+ * with the secret, of the session id, a counter that goes up with every
+ * random and the server's clock, cut down to RANDOM_SIZE bytes. Commands
+ * carry the session id, counter and time, so the server can work out the
+ * same random, check that it is recent and that its counter hasn't been
+ * used before.
+ */
+class NonceSession {
+public:
+    struct SessionRandom {
+        RandomString mRandom;
+        uint64_t mCounter;
+        // Server time the random was made, in milliseconds since the epoch
+        int64_t mTime;
+    };
+
+    struct Stats {
+        // Sessions started with values from the server
+        uint64_t started;
+        // Sessions that ran out before a new one replaced them
+        uint64_t expired;
+        // Randoms made from a session
+        uint64_t generated;
+    };
+
+    NonceSession();
+
+    /**
+     * Starts a session, replacing the current one.
+     *
+     * @param sessionId The session id issued by the server.
+     * @param secretHex The session secret issued by the server, in hex.
+     * @param serverTime Server time the session was issued, in milliseconds
+     * since the epoch.
+     * @param lifetime Seconds the server accepts randoms from the session.
+     * @param currentTime Current time in seconds.
+     * @return false, and the current session is kept, if the values are malformed.
+     */
+    bool Start(std::string_view sessionId, std::string_view secretHex, int64_t serverTime,
+               float lifetime, float currentTime);
+
+    void End();
+
+    // True if randoms made now reach the server before the session ends
+    bool IsActive(float currentTime) const;
+
+    // True if a new session should be fetched, ahead of this one ending
+    bool NeedsRenewal(float currentTime) const;
+
+    // Makes the next random, or nothing if the session isn't active
+    std::optional<SessionRandom> NextRandom(float currentTime);
+
+    std::string_view GetSessionId() const { return mSessionId; }
+
+    const Stats &GetStats() const { return mStats; }
+
+private:
+    SessionIdString mSessionId;
+    uint8_t mSecret[SESSION_SECRET_SIZE];
+    uint64_t mCounter;
+    // Server clock minus our wall clock, in milliseconds
+    int64_t mClockOffset;
+    float mExpireTime;
+    bool mStarted;
+    Stats mStats;
+};
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rate_limiter.hpp"
+
+RateLimiter::RateLimiter(const Config &config) {
+    mConfig = config;
+    mStats = {};
+    // Buckets start full the first time they are used
+    for (Bucket &bucket : mEndpointBuckets) {
+        bucket = {};
+    }
+    for (Bucket &bucket : mClassBuckets) {
+        bucket = {};
+    }
+}
+
+void RateLimiter::SetConfig(const Config &config) {
+    mConfig = config;
+}
+
+bool RateLimiter::TryAcquire(CommandPriority commandClass, uint32_t endpoints, float currentTime,
+                             float *retryAfter) {
+    if (!CanAcquire(commandClass, endpoints, currentTime, retryAfter)) {
+        return false;
+    }
+    Take(commandClass, endpoints, currentTime);
+    return true;
+}
+
+bool RateLimiter::TryAcquire(uint32_t endpoints, float currentTime, float *retryAfter) {
+    const float wait = GetWait(nullptr, nullptr, endpoints, currentTime);
+    if (wait > 0.0f) {
+        if (retryAfter != nullptr) {
+            *retryAfter = wait;
+        }
+        return false;
+    }
+    TakeTokens(nullptr, nullptr, endpoints, currentTime);
+    return true;
+}
+
+bool RateLimiter::CanAcquire(CommandPriority commandClass, uint32_t endpoints, float currentTime,
+                             float *retryAfter) {
+    const float wait = GetWait(&mClassBuckets[commandClass], &mConfig.commandClass[commandClass],
+                               endpoints, currentTime);
+    if (wait > 0.0f) {
+        ++mStats.limited[commandClass];
+        if (retryAfter != nullptr) {
+            *retryAfter = wait;
+        }
+        return false;
+    }
+    return true;
+}
+
+void RateLimiter::Take(CommandPriority commandClass, uint32_t endpoints, float currentTime) {
+    TakeTokens(&mClassBuckets[commandClass], &mConfig.commandClass[commandClass], endpoints,
+               currentTime);
+    ++mStats.allowed[commandClass];
+}
+
+void RateLimiter::Take(uint32_t endpoints, float currentTime) {
+    TakeTokens(nullptr, nullptr, endpoints, currentTime);
+}
+
+float RateLimiter::Refill(Bucket &bucket, const BucketConfig &config, float currentTime) {
+    if (config.rate <= 0.0f) {
+        return 0.0f;
+    }
+    if (!bucket.mStarted) {
+        bucket.mStarted = true;
+        bucket.mTokens = config.burst;
+    } else {
+        bucket.mTokens += config.rate * (currentTime - bucket.mLastRefillTime);
+        if (bucket.mTokens > config.burst) {
+            bucket.mTokens = config.burst;
+        }
+    }
+    bucket.mLastRefillTime = currentTime;
+    return bucket.mTokens >= 1.0f ? 0.0f : (1.0f - bucket.mTokens) / config.rate;
+}
+
+float RateLimiter::GetWait(Bucket *classBucket, const BucketConfig *classConfig,
+                          uint32_t endpoints, float currentTime) {
+    // Check every bucket before taking from any, so a refused command
+    // doesn't use up tokens it never spends. The command has to wait for
+    // the slowest bucket.
+    float wait = 0.0f;
+    if (classBucket != nullptr) {
+        wait = Refill(*classBucket, *classConfig, currentTime);
+    }
+    for (int i = 0; i < RATE_LIMIT_ENDPOINT_COUNT; ++i) {
+        if ((endpoints & EndpointBit(static_cast<Endpoint>(i))) == 0) {
+            continue;
+        }
+        const float endpointWait = Refill(mEndpointBuckets[i], mConfig.endpoint[i], currentTime);
+        if (endpointWait > 0.0f) {
+            ++mStats.endpointLimited[i];
+            if (endpointWait > wait) {
+                wait = endpointWait;
+            }
+        }
+    }
+    return wait;
+}
+
+void RateLimiter::TakeTokens(Bucket *classBucket, const BucketConfig *classConfig,
+                             uint32_t endpoints, float currentTime) {
+    // Bring the buckets up to date first, they may not have been checked
+    if (classBucket != nullptr && classConfig->rate > 0.0f) {
+        Refill(*classBucket, *classConfig, currentTime);
+        classBucket->mTokens -= 1.0f;
+    }
+    for (int i = 0; i < RATE_LIMIT_ENDPOINT_COUNT; ++i) {
+        if ((endpoints & EndpointBit(static_cast<Endpoint>(i))) != 0 &&
+                mConfig.endpoint[i].rate > 0.0f) {
+            Refill(mEndpointBuckets[i], mConfig.endpoint[i], currentTime);
+            mEndpointBuckets[i].mTokens -= 1.0f;
+        }
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "command_scheduler.hpp"
+
+#include <cstdint>
+
+/*
+ * Token bucket limits on how fast commands are started, for each command
+ * class and for each endpoint the commands end up calling. Each bucket
+ * refills at a steady rate up to a burst allowance, and a command is only
+ * let through if its class's bucket and the buckets of every endpoint it
+ * uses all have a token to spare. Nothing ever waits: a command that
+ * doesn't get through is refused, with an estimate of when it would.
+ *
+ * Callers that may still decide not to make a call once it is allowed
+ * check with CanAcquire first, and Take the tokens once the call is
+ * certain, so calls that never happen don't use up the limits.
+ */
+class RateLimiter {
+public:
+    enum Endpoint {
+        // Play Integrity token requests
+        RATE_LIMIT_ENDPOINT_INTEGRITY_TOKEN = 0,
+        // Command POSTs to our server
+        RATE_LIMIT_ENDPOINT_SERVER_COMMAND,
+        RATE_LIMIT_ENDPOINT_COUNT
+    };
+
+    struct BucketConfig {
+        // Tokens added per second, zero or less means no limit
+        float rate;
+        // Most tokens the bucket holds, the number of calls allowed in a burst
+        float burst;
+    };
+
+    struct Config {
+        BucketConfig endpoint[RATE_LIMIT_ENDPOINT_COUNT];
+        BucketConfig commandClass[COMMAND_PRIORITY_COUNT];
+    };
+
+    struct Stats {
+        // Commands of each class let through and refused
+        uint64_t allowed[COMMAND_PRIORITY_COUNT];
+        uint64_t limited[COMMAND_PRIORITY_COUNT];
+        // Calls refused because an endpoint's bucket was empty
+        uint64_t endpointLimited[RATE_LIMIT_ENDPOINT_COUNT];
+    };
+
+    // Bit for an endpoint in the endpoints mask passed to TryAcquire
+    static constexpr uint32_t EndpointBit(Endpoint endpoint) { return 1u << endpoint; }
+
+    explicit RateLimiter(const Config &config);
+
+    void SetConfig(const Config &config);
+
+    const Config &GetConfig() const { return mConfig; }
+
+    const Stats &GetStats() const { return mStats; }
+
+    /**
+     * Takes a token for a command from its class's bucket and from the
+     * bucket of each endpoint it uses, or from none of them.
+     *
+     * @param commandClass The priority class of the command.
+     * @param endpoints Mask of EndpointBit values for the endpoints the command uses.
+     * @param currentTime Current time in seconds.
+     * @param retryAfter If the command is refused, receives the number of
+     * seconds until it would be let through.
+     * @return true if the command may be started.
+     */
+    bool TryAcquire(CommandPriority commandClass, uint32_t endpoints, float currentTime,
+                    float *retryAfter);
+
+    // As above, for calls that don't belong to a command class, like
+    // speculative token requests
+    bool TryAcquire(uint32_t endpoints, float currentTime, float *retryAfter);
+
+    // Returns whether TryAcquire would let the command through, without
+    // taking any tokens. A refusal is counted in the stats.
+    bool CanAcquire(CommandPriority commandClass, uint32_t endpoints, float currentTime,
+                    float *retryAfter);
+
+    // Takes a token for a command from its class's bucket and from the
+    // bucket of each endpoint it uses, whether they have one or not. A
+    // bucket that had none makes later calls wait longer.
+    void Take(CommandPriority commandClass, uint32_t endpoints, float currentTime);
+
+    // As above, for tokens taken for a command whose class already paid
+    // for it, like the token request of a command that was let through
+    void Take(uint32_t endpoints, float currentTime);
+
+private:
+    struct Bucket {
+        float mTokens;
+        float mLastRefillTime;
+        bool mStarted;
+    };
+
+    // Refills bucket up to currentTime and returns the seconds until it
+    // has a whole token, zero if it has one now
+    static float Refill(Bucket &bucket, const BucketConfig &config, float currentTime);
+
+    // Returns the seconds until the class bucket, if any, and every
+    // endpoint bucket has a whole token, zero if they all have one now
+    float GetWait(Bucket *classBucket, const BucketConfig *classConfig, uint32_t endpoints,
+                  float currentTime);
+
+    void TakeTokens(Bucket *classBucket, const BucketConfig *classConfig, uint32_t endpoints,
+                    float currentTime);
+
+    Config mConfig;
+    Stats mStats;
+    Bucket mEndpointBuckets[RATE_LIMIT_ENDPOINT_COUNT];
+    Bucket mClassBuckets[COMMAND_PRIORITY_COUNT];
+};
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/*
+ * First in, first out queue with a fixed capacity. Storage for every
+ * slot is allocated up front, pushing and popping never allocate.
+ */
+template<typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity = 0) {
+        mItems = nullptr;
+        mCapacity = 0;
+        mHead = 0;
+        mCount = 0;
+        Reset(capacity);
+    }
+
+    RingBuffer(const RingBuffer &) = delete;
+
+    void operator=(const RingBuffer &) = delete;
+
+    // Empties the buffer and reallocates it if the capacity changed
+    void Reset(size_t capacity) {
+        if (capacity != mCapacity) {
+            mItems.reset(capacity > 0 ? new T[capacity] : nullptr);
+            mCapacity = capacity;
+        } else {
+            Clear();
+        }
+        mHead = 0;
+        mCount = 0;
+    }
+
+    void Clear() {
+        while (mCount > 0) {
+            PopFront();
+        }
+    }
+
+    bool IsEmpty() const { return mCount == 0; }
+
+    bool IsFull() const { return mCount == mCapacity; }
+
+    size_t GetSize() const { return mCount; }
+
+    size_t GetCapacity() const { return mCapacity; }
+
+    // Index 0 is the oldest item
+    T &operator[](size_t index) { return mItems[(mHead + index) % mCapacity]; }
+
+    const T &operator[](size_t index) const { return mItems[(mHead + index) % mCapacity]; }
+
+    T &Front() { return (*this)[0]; }
+
+    const T &Front() const { return (*this)[0]; }
+
+    // Adds an item at the back, the buffer must not be full
+    void PushBack(T item) {
+        mItems[(mHead + mCount) % mCapacity] = std::move(item);
+        ++mCount;
+    }
+
+    // Removes and returns the oldest item, the buffer must not be empty
+    T PopFront() {
+        T item = std::move(mItems[mHead]);
+        mItems[mHead] = T();
+        mHead = (mHead + 1) % mCapacity;
+        --mCount;
+        return item;
+    }
+
+    // Removes and returns the newest item, the buffer must not be empty
+    T PopBack() {
+        T &slot = (*this)[mCount - 1];
+        T item = std::move(slot);
+        slot = T();
+        --mCount;
+        return item;
+    }
+
+private:
+    std::unique_ptr<T[]> mItems;
+    size_t mCapacity;
+    size_t mHead;
+    size_t mCount;
+};
@@ -17,4 +17,6 @@
 #pragma once
 
 constexpr char GET_RANDOM_URL[] = "https://your-play-integrity-server.com/getRandom";
-constexpr char PERFORM_COMMAND_URL[] = "https://your-play-integrity-server.com/performCommand";
\ No newline at end of file
+constexpr char PERFORM_COMMAND_URL[] = "https://your-play-integrity-server.com/performCommand";
+constexpr char START_NONCE_SESSION_URL[] = "https://your-play-integrity-server.com/startNonceSession";
+constexpr char PERFORM_COMMAND_BATCH_URL[] = "https://your-play-integrity-server.com/performCommandBatch";
\ No newline at end of file
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "sha256_batch.hpp"
+#include "cpu_features.hpp"
+#include "sha256_kernels.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <openssl/sha.h>
+
+namespace {
+    constexpr size_t BLOCK_SIZE = ConstexprSha256::BLOCK_SIZE;
+    // Most lanes any multi-buffer kernel has
+    constexpr size_t MAX_LANES = 8;
+    // Length of the message length field at the end of the padding
+    constexpr size_t LENGTH_FIELD_SIZE = sizeof(uint64_t);
+
+    typedef void (*CompressBlocksFunction)(uint32_t *state, const uint8_t *blocks,
+                                           size_t blockCount);
+
+    typedef void (*CompressLanesFunction)(uint32_t *state, const uint8_t *const *laneBlocks);
+
+    // The last one or two blocks of a message: the bytes after its last
+    // full block, then the padding and the message length
+    struct PaddedTail {
+        uint8_t mData[BLOCK_SIZE * 2];
+        size_t mBlockCount;
+    };
+
+    size_t GetFullBlockCount(std::string_view message) {
+        return message.size() / BLOCK_SIZE;
+    }
+
+    void BuildTail(std::string_view message, PaddedTail &tail) {
+        const size_t fullBytes = GetFullBlockCount(message) * BLOCK_SIZE;
+        const size_t remaining = message.size() - fullBytes;
+        tail.mBlockCount = (remaining + 1 + LENGTH_FIELD_SIZE > BLOCK_SIZE) ? 2 : 1;
+        const size_t tailSize = tail.mBlockCount * BLOCK_SIZE;
+        memcpy(tail.mData, message.data() + fullBytes, remaining);
+        tail.mData[remaining] = 0x80;
+        memset(tail.mData + remaining + 1, 0, tailSize - remaining - 1);
+        const uint64_t bitLength = static_cast<uint64_t>(message.size()) * 8;
+        for (size_t i = 0; i < LENGTH_FIELD_SIZE; ++i) {
+            tail.mData[tailSize - 1 - i] = static_cast<uint8_t>(bitLength >> (8 * i));
+        }
+    }
+
+    // Reads a digest out of state words that are stride words apart
+    void StoreDigest(const uint32_t *state, size_t stride, Sha256Digest &digest) {
+        for (size_t i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+            digest[i] = static_cast<uint8_t>(state[(i / 4) * stride] >> (24 - 8 * (i % 4)));
+        }
+    }
+
+    void HashScalar(const std::string_view *messages, size_t count, Sha256Digest *digests) {
+        // Not the one-shot SHA256(), OpenSSL 3 looks the digest up again on
+        // every call of it and that costs more than hashing a command
+        for (size_t i = 0; i < count; ++i) {
+            SHA256_CTX context;
+            SHA256_Init(&context);
+            SHA256_Update(&context, messages[i].data(), messages[i].size());
+            SHA256_Final(digests[i].data(), &context);
+        }
+    }
+
+    void HashSingleBuffer(CompressBlocksFunction compress, const std::string_view *messages,
+                          size_t count, Sha256Digest *digests) {
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t state[8];
+            std::copy(std::begin(ConstexprSha256::INITIAL_STATE),
+                      std::end(ConstexprSha256::INITIAL_STATE), state);
+            const size_t fullBlocks = GetFullBlockCount(messages[i]);
+            if (fullBlocks > 0) {
+                compress(state, reinterpret_cast<const uint8_t *>(messages[i].data()), fullBlocks);
+            }
+            PaddedTail tail;
+            BuildTail(messages[i], tail);
+            compress(state, tail.mData, tail.mBlockCount);
+            StoreDigest(state, 1, digests[i]);
+        }
+    }
+
+    void HashMultiBuffer(CompressLanesFunction compress, size_t lanes,
+                         const std::string_view *messages, size_t count, Sha256Digest *digests) {
+        // Lanes without a block left to hash compress this instead
+        static const uint8_t unusedBlock[BLOCK_SIZE] = {};
+
+        for (size_t first = 0; first < count; first += lanes) {
+            const size_t usedLanes = std::min(lanes, count - first);
+            uint32_t state[8 * MAX_LANES];
+            PaddedTail tails[MAX_LANES];
+            size_t blockCounts[MAX_LANES] = {};
+            size_t maxBlockCount = 0;
+            for (size_t lane = 0; lane < lanes; ++lane) {
+                for (size_t word = 0; word < 8; ++word) {
+                    state[word * lanes + lane] = ConstexprSha256::INITIAL_STATE[word];
+                }
+                if (lane < usedLanes) {
+                    const std::string_view &message = messages[first + lane];
+                    BuildTail(message, tails[lane]);
+                    blockCounts[lane] = GetFullBlockCount(message) + tails[lane].mBlockCount;
+                    maxBlockCount = std::max(maxBlockCount, blockCounts[lane]);
+                }
+            }
+
+            const uint8_t *laneBlocks[MAX_LANES];
+            for (size_t block = 0; block < maxBlockCount; ++block) {
+                for (size_t lane = 0; lane < lanes; ++lane) {
+                    if (lane >= usedLanes || block >= blockCounts[lane]) {
+                        laneBlocks[lane] = unusedBlock;
+                        continue;
+                    }
+                    const std::string_view &message = messages[first + lane];
+                    const size_t fullBlocks = GetFullBlockCount(message);
+                    laneBlocks[lane] = block < fullBlocks ?
+                            reinterpret_cast<const uint8_t *>(message.data()) + block * BLOCK_SIZE :
+                            tails[lane].mData + (block - fullBlocks) * BLOCK_SIZE;
+                }
+                compress(state, laneBlocks);
+                // A lane's digest is read as soon as its message is done,
+                // whatever the lane computes afterwards is thrown away
+                for (size_t lane = 0; lane < usedLanes; ++lane) {
+                    if (block + 1 == blockCounts[lane]) {
+                        StoreDigest(state + lane, lanes, digests[first + lane]);
+                    }
+                }
+            }
+        }
+    }
+
+    bool IsMultiBuffer(Sha256Batch::Implementation implementation) {
+        return implementation == Sha256Batch::SHA256_IMPLEMENTATION_AVX2_MULTI_BUFFER ||
+               implementation == Sha256Batch::SHA256_IMPLEMENTATION_NEON_MULTI_BUFFER;
+    }
+}
+
+void Sha256Batch::Hash(const std::string_view *messages, size_t count, Sha256Digest *digests) {
+    Implementation implementation = GetImplementation();
+    // A lone message would leave all but one lane idle
+    if (count == 1 && IsMultiBuffer(implementation)) {
+        implementation = SHA256_IMPLEMENTATION_SCALAR;
+    }
+    Hash(implementation, messages, count, digests);
+}
+
+void Sha256Batch::Hash(Implementation implementation, const std::string_view *messages,
+                       size_t count, Sha256Digest *digests) {
+    switch (implementation) {
+#if SHA256_KERNELS_X86
+        case SHA256_IMPLEMENTATION_AVX2_MULTI_BUFFER:
+            HashMultiBuffer(Sha256CompressAvx2, SHA256_AVX2_LANES, messages, count, digests);
+            return;
+        case SHA256_IMPLEMENTATION_SHA_NI:
+            HashSingleBuffer(Sha256CompressShaNi, messages, count, digests);
+            return;
+#endif
+#if SHA256_KERNELS_NEON
+        case SHA256_IMPLEMENTATION_NEON_MULTI_BUFFER:
+            HashMultiBuffer(Sha256CompressNeon, SHA256_NEON_LANES, messages, count, digests);
+            return;
+#endif
+#if SHA256_KERNELS_ARMV8
+        case SHA256_IMPLEMENTATION_ARMV8_CRYPTO:
+            HashSingleBuffer(Sha256CompressArmv8, messages, count, digests);
+            return;
+#endif
+        default:
+            HashScalar(messages, count, digests);
+            return;
+    }
+}
+
+Sha256Batch::Implementation Sha256Batch::GetImplementation() {
+    // SHA instructions beat multi-buffer SIMD even with every lane busy.
+    // On x86 neither kernel is picked: OpenSSL's own assembly already uses
+    // SHA-NI or AVX2 there and sha256_benchmark has it ahead of both
+    static const Implementation PREFERENCE[] = {
+            SHA256_IMPLEMENTATION_ARMV8_CRYPTO,
+            SHA256_IMPLEMENTATION_NEON_MULTI_BUFFER
+    };
+    for (Implementation implementation : PREFERENCE) {
+        if (IsSupported(implementation)) {
+            return implementation;
+        }
+    }
+    return SHA256_IMPLEMENTATION_SCALAR;
+}
+
+bool Sha256Batch::IsSupported(Implementation implementation) {
+    const CpuFeatures &features = GetCpuFeatures();
+    switch (implementation) {
+        case SHA256_IMPLEMENTATION_SCALAR:
+            return true;
+#if SHA256_KERNELS_X86
+        case SHA256_IMPLEMENTATION_AVX2_MULTI_BUFFER:
+            return features.mAvx2;
+        case SHA256_IMPLEMENTATION_SHA_NI:
+            return features.mShaNi && features.mSse41 && features.mSsse3;
+#endif
+#if SHA256_KERNELS_NEON
+        case SHA256_IMPLEMENTATION_NEON_MULTI_BUFFER:
+            return features.mNeon;
+#endif
+#if SHA256_KERNELS_ARMV8
+        case SHA256_IMPLEMENTATION_ARMV8_CRYPTO:
+            return features.mArmv8Sha2;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char *Sha256Batch::GetImplementationName(Implementation implementation) {
+    switch (implementation) {
+        case SHA256_IMPLEMENTATION_SCALAR:
+            return "scalar";
+        case SHA256_IMPLEMENTATION_AVX2_MULTI_BUFFER:
+            return "avx2 multi-buffer";
+        case SHA256_IMPLEMENTATION_SHA_NI:
+            return "sha-ni";
+        case SHA256_IMPLEMENTATION_NEON_MULTI_BUFFER:
+            return "neon multi-buffer";
+        case SHA256_IMPLEMENTATION_ARMV8_CRYPTO:
+            return "armv8 crypto";
+        default:
+            return "unknown";
+    }
+}
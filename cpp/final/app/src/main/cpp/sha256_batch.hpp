@@ -0,0 +1,68 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "constexpr_sha256.hpp"
+
+#include <cstddef>
+#include <string_view>
+
+/*
+ * Hashes many messages at once with the fastest SHA-256 the CPU has,
+ * picked the first time it is needed. SHA instructions (SHA-NI on x86,
+ * the ARMv8 crypto extensions) hash one message at a time very quickly.
+ * Without them, multi-buffer SIMD hashes 8 (AVX2) or 4 (NEON) messages
+ * side by side, one per vector lane, which only pays off with several
+ * messages to hash. Anything else goes to OpenSSL, which is also what x86
+ * gets: OpenSSL's assembly is faster there than the x86 kernels, they are
+ * kept to be picked explicitly and measured by sha256_benchmark.
+ */
+class Sha256Batch {
+public:
+    enum Implementation {
+        // OpenSSL, one message at a time
+        SHA256_IMPLEMENTATION_SCALAR = 0,
+        // 8 messages at once in AVX2 lanes
+        SHA256_IMPLEMENTATION_AVX2_MULTI_BUFFER,
+        // x86 SHA extensions
+        SHA256_IMPLEMENTATION_SHA_NI,
+        // 4 messages at once in NEON lanes
+        SHA256_IMPLEMENTATION_NEON_MULTI_BUFFER,
+        // ARMv8 cryptography extensions
+        SHA256_IMPLEMENTATION_ARMV8_CRYPTO,
+        SHA256_IMPLEMENTATION_COUNT
+    };
+
+    /**
+     * Hashes messages with the best implementation for this CPU.
+     *
+     * @param messages The messages to hash.
+     * @param count The number of messages.
+     * @param digests Receives the digest of each message, in order.
+     */
+    static void Hash(const std::string_view *messages, size_t count, Sha256Digest *digests);
+
+    // As above, with a particular implementation, which must be supported
+    static void Hash(Implementation implementation, const std::string_view *messages,
+                     size_t count, Sha256Digest *digests);
+
+    // The implementation Hash picks for batches of several messages
+    static Implementation GetImplementation();
+
+    static bool IsSupported(Implementation implementation);
+
+    static const char *GetImplementationName(Implementation implementation);
+};
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * SHA-256 compression functions for Sha256Batch, each only built for
+ * the architectures it runs on, and only called once the CPU is known to
+ * support it.
+ *
+ * Single buffer kernels compress blockCount consecutive blocks of one
+ * message into state. Multi-buffer kernels compress one block from each
+ * lane, with the state stored word by word: state[word * LANES + lane].
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_KERNELS_X86 1
+
+constexpr size_t SHA256_AVX2_LANES = 8;
+
+void Sha256CompressShaNi(uint32_t *state, const uint8_t *blocks, size_t blockCount);
+
+void Sha256CompressAvx2(uint32_t *state, const uint8_t *const *laneBlocks);
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SHA256_KERNELS_NEON 1
+
+constexpr size_t SHA256_NEON_LANES = 4;
+
+void Sha256CompressNeon(uint32_t *state, const uint8_t *const *laneBlocks);
+#endif
+
+#if defined(__aarch64__)
+#define SHA256_KERNELS_ARMV8 1
+
+void Sha256CompressArmv8(uint32_t *state, const uint8_t *blocks, size_t blockCount);
+#endif
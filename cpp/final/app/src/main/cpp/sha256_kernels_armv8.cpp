@@ -0,0 +1,61 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "sha256_kernels.hpp"
+
+// Built with the cryptography extensions enabled (see CMakeLists.txt), so
+// nothing else belongs in this file
+#if SHA256_KERNELS_ARMV8
+
+#include "constexpr_sha256.hpp"
+
+#include <arm_neon.h>
+
+void Sha256CompressArmv8(uint32_t *state, const uint8_t *blocks, size_t blockCount) {
+    const uint32_t *const K = ConstexprSha256::ROUND_CONSTANTS;
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+
+    for (; blockCount > 0; --blockCount, blocks += ConstexprSha256::BLOCK_SIZE) {
+        const uint32x4_t savedState0 = state0;
+        const uint32x4_t savedState1 = state1;
+        uint32x4_t message[4];
+        for (int i = 0; i < 4; ++i) {
+            message[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + i * 16)));
+        }
+        // Four rounds per group, message[group % 4] holds the group's words
+        // and is then extended to the words four groups later
+        for (int group = 0; group < 16; ++group) {
+            uint32x4_t &words = message[group % 4];
+            const uint32x4_t roundInput = vaddq_u32(words, vld1q_u32(&K[group * 4]));
+            if (group < 12) {
+                words = vsha256su0q_u32(words, message[(group + 1) % 4]);
+            }
+            const uint32x4_t previousState0 = state0;
+            state0 = vsha256hq_u32(state0, state1, roundInput);
+            state1 = vsha256h2q_u32(state1, previousState0, roundInput);
+            if (group < 12) {
+                words = vsha256su1q_u32(words, message[(group + 2) % 4], message[(group + 3) % 4]);
+            }
+        }
+        state0 = vaddq_u32(state0, savedState0);
+        state1 = vaddq_u32(state1, savedState1);
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "sha256_kernels.hpp"
+
+#if SHA256_KERNELS_NEON
+
+#include "constexpr_sha256.hpp"
+
+#include <arm_neon.h>
+
+// Shift counts have to be immediates
+#define ROTATE_RIGHT(value, bits) \
+    vorrq_u32(vshrq_n_u32((value), (bits)), vshlq_n_u32((value), 32 - (bits)))
+
+namespace {
+    const uint32_t *const K = ConstexprSha256::ROUND_CONSTANTS;
+
+    uint32_t LoadBigEndian32(const uint8_t *bytes) {
+        return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+               (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+    }
+}
+
+void Sha256CompressNeon(uint32_t *state, const uint8_t *const *laneBlocks) {
+    // Each vector holds the same word of all 4 messages
+    uint32x4_t schedule[64];
+    for (int i = 0; i < 16; ++i) {
+        const uint32_t laneWords[SHA256_NEON_LANES] = {
+                LoadBigEndian32(laneBlocks[0] + i * 4), LoadBigEndian32(laneBlocks[1] + i * 4),
+                LoadBigEndian32(laneBlocks[2] + i * 4), LoadBigEndian32(laneBlocks[3] + i * 4)
+        };
+        schedule[i] = vld1q_u32(laneWords);
+    }
+    for (int i = 16; i < 64; ++i) {
+        const uint32x4_t s0 = veorq_u32(
+                veorq_u32(ROTATE_RIGHT(schedule[i - 15], 7), ROTATE_RIGHT(schedule[i - 15], 18)),
+                vshrq_n_u32(schedule[i - 15], 3));
+        const uint32x4_t s1 = veorq_u32(
+                veorq_u32(ROTATE_RIGHT(schedule[i - 2], 17), ROTATE_RIGHT(schedule[i - 2], 19)),
+                vshrq_n_u32(schedule[i - 2], 10));
+        schedule[i] = vaddq_u32(vaddq_u32(schedule[i - 16], s0), vaddq_u32(schedule[i - 7], s1));
+    }
+
+    uint32x4_t words[8];
+    for (int i = 0; i < 8; ++i) {
+        words[i] = vld1q_u32(state + i * SHA256_NEON_LANES);
+    }
+    uint32x4_t a = words[0], b = words[1], c = words[2], d = words[3];
+    uint32x4_t e = words[4], f = words[5], g = words[6], h = words[7];
+    for (int i = 0; i < 64; ++i) {
+        const uint32x4_t s1 = veorq_u32(veorq_u32(ROTATE_RIGHT(e, 6), ROTATE_RIGHT(e, 11)),
+                                        ROTATE_RIGHT(e, 25));
+        // Bit selects: e ? f : g, and (a ^ b) ? c : b
+        const uint32x4_t choose = vbslq_u32(e, f, g);
+        const uint32x4_t majority = vbslq_u32(veorq_u32(a, b), c, b);
+        const uint32x4_t temp1 = vaddq_u32(vaddq_u32(vaddq_u32(h, s1), vaddq_u32(choose, schedule[i])),
+                                           vdupq_n_u32(K[i]));
+        const uint32x4_t s0 = veorq_u32(veorq_u32(ROTATE_RIGHT(a, 2), ROTATE_RIGHT(a, 13)),
+                                        ROTATE_RIGHT(a, 22));
+        h = g;
+        g = f;
+        f = e;
+        e = vaddq_u32(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = vaddq_u32(temp1, vaddq_u32(s0, majority));
+    }
+    const uint32x4_t results[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; ++i) {
+        vst1q_u32(state + i * SHA256_NEON_LANES, vaddq_u32(words[i], results[i]));
+    }
+}
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "sha256_kernels.hpp"
+
+#if SHA256_KERNELS_X86
+
+#include "constexpr_sha256.hpp"
+
+#include <immintrin.h>
+
+namespace {
+    const uint32_t *const K = ConstexprSha256::ROUND_CONSTANTS;
+
+    uint32_t LoadBigEndian32(const uint8_t *bytes) {
+        return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+               (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i RotateRight(__m256i value, int bits) {
+        return _mm256_or_si256(_mm256_srli_epi32(value, bits), _mm256_slli_epi32(value, 32 - bits));
+    }
+}
+
+__attribute__((target("sha,sse4.1")))
+void Sha256CompressShaNi(uint32_t *state, const uint8_t *blocks, size_t blockCount) {
+    // Converts big endian message words
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The SHA instructions want the state as ABEF and CDGH
+    __m128i temp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i *>(&state[0])), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i *>(&state[4])), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(temp, state1, 8);
+    state1 = _mm_blend_epi16(state1, temp, 0xF0);
+
+    for (; blockCount > 0; --blockCount, blocks += ConstexprSha256::BLOCK_SIZE) {
+        const __m128i savedState0 = state0;
+        const __m128i savedState1 = state1;
+        __m128i message[4];
+        for (int i = 0; i < 4; ++i) {
+            message[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + i * 16)), byteSwap);
+        }
+        // Four rounds per group, message[group % 4] holds the group's words
+        // and the message schedule runs a few groups ahead. Unrolled so the
+        // four message vectors stay in registers
+#pragma GCC unroll 16
+        for (int group = 0; group < 16; ++group) {
+            __m128i &words = message[group % 4];
+            __m128i roundInput = _mm_add_epi32(
+                    words, _mm_loadu_si128(reinterpret_cast<const __m128i *>(&K[group * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, roundInput);
+            if (group >= 3 && group < 15) {
+                __m128i &nextWords = message[(group + 1) % 4];
+                nextWords = _mm_add_epi32(nextWords,
+                                          _mm_alignr_epi8(words, message[(group + 3) % 4], 4));
+                nextWords = _mm_sha256msg2_epu32(nextWords, words);
+            }
+            roundInput = _mm_shuffle_epi32(roundInput, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, roundInput);
+            if (group >= 1 && group < 13) {
+                __m128i &laterWords = message[(group + 3) % 4];
+                laterWords = _mm_sha256msg1_epu32(laterWords, words);
+            }
+        }
+        state0 = _mm_add_epi32(state0, savedState0);
+        state1 = _mm_add_epi32(state1, savedState1);
+    }
+
+    // Back to ABCD and EFGH
+    temp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(temp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, temp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+}
+
+__attribute__((target("avx2")))
+void Sha256CompressAvx2(uint32_t *state, const uint8_t *const *laneBlocks) {
+    // Each vector holds the same word of all 8 messages
+    __m256i schedule[64];
+    for (int i = 0; i < 16; ++i) {
+        schedule[i] = _mm256_setr_epi32(
+                LoadBigEndian32(laneBlocks[0] + i * 4), LoadBigEndian32(laneBlocks[1] + i * 4),
+                LoadBigEndian32(laneBlocks[2] + i * 4), LoadBigEndian32(laneBlocks[3] + i * 4),
+                LoadBigEndian32(laneBlocks[4] + i * 4), LoadBigEndian32(laneBlocks[5] + i * 4),
+                LoadBigEndian32(laneBlocks[6] + i * 4), LoadBigEndian32(laneBlocks[7] + i * 4));
+    }
+    for (int i = 16; i < 64; ++i) {
+        const __m256i s0 = _mm256_xor_si256(
+                _mm256_xor_si256(RotateRight(schedule[i - 15], 7), RotateRight(schedule[i - 15], 18)),
+                _mm256_srli_epi32(schedule[i - 15], 3));
+        const __m256i s1 = _mm256_xor_si256(
+                _mm256_xor_si256(RotateRight(schedule[i - 2], 17), RotateRight(schedule[i - 2], 19)),
+                _mm256_srli_epi32(schedule[i - 2], 10));
+        schedule[i] = _mm256_add_epi32(_mm256_add_epi32(schedule[i - 16], s0),
+                                       _mm256_add_epi32(schedule[i - 7], s1));
+    }
+
+    __m256i words[8];
+    for (int i = 0; i < 8; ++i) {
+        words[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state + i * 8));
+    }
+    __m256i a = words[0], b = words[1], c = words[2], d = words[3];
+    __m256i e = words[4], f = words[5], g = words[6], h = words[7];
+    for (int i = 0; i < 64; ++i) {
+        const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(RotateRight(e, 6), RotateRight(e, 11)),
+                                            RotateRight(e, 25));
+        const __m256i choose = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        const __m256i temp1 = _mm256_add_epi32(
+                _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(choose, schedule[i])),
+                _mm256_set1_epi32(static_cast<int>(K[i])));
+        const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(RotateRight(a, 2), RotateRight(a, 13)),
+                                            RotateRight(a, 22));
+        const __m256i majority = _mm256_xor_si256(
+                _mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+                _mm256_and_si256(b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(temp1, _mm256_add_epi32(s0, majority));
+    }
+    const __m256i results[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; ++i) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(state + i * 8),
+                            _mm256_add_epi32(words[i], results[i]));
+    }
+}
+
+#endif
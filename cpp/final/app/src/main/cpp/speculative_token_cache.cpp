@@ -0,0 +1,165 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "logging.hpp"
+#include "speculative_token_cache.hpp"
+#include "util.hpp"
+
+SpeculativeTokenCache::SpeculativeTokenCache(const Config &config) {
+    mConfig = config;
+    mStats = {};
+}
+
+SpeculativeTokenCache::~SpeculativeTokenCache() {
+    for (SpeculativeToken &token : mTokens) {
+        DestroyRequest(token);
+    }
+}
+
+bool SpeculativeTokenCache::CanSpeculate(const std::string &command, float currentTime) {
+    if (mTokens.size() >= mConfig.maxTokens) {
+        return false;
+    }
+    for (const SpeculativeToken &token : mTokens) {
+        if (token.mCommand == command) {
+            return false;
+        }
+    }
+    // Forget waste that happened before the current budget window
+    while (!mWasteTimes.empty() &&
+           (currentTime - mWasteTimes.front()) >= mConfig.wasteBudgetWindow) {
+        mWasteTimes.pop_front();
+    }
+    if (mWasteTimes.size() >= mConfig.wasteBudget) {
+        ++mStats.budgetDenied;
+        return false;
+    }
+    return true;
+}
+
+bool SpeculativeTokenCache::StartSpeculation(const std::string &command, const char *nonce,
+                                             float expireTime) {
+    SpeculativeToken token = {command, "", nullptr, nullptr, expireTime, false};
+    IntegrityTokenRequest_create(&token.mRequest);
+    IntegrityTokenRequest_setNonce(token.mRequest, nonce);
+    const IntegrityErrorCode errorCode =
+            IntegrityManager_requestIntegrityToken(token.mRequest, &token.mResponse);
+    ++mStats.requested;
+    if (errorCode != INTEGRITY_NO_ERROR) {
+        ALOGE("Play Integrity returned error for speculative request: %d", errorCode);
+        DestroyRequest(token);
+        ++mStats.failed;
+        return false;
+    }
+    mTokens.push_back(token);
+    return true;
+}
+
+void SpeculativeTokenCache::Update(float currentTime) {
+    auto iter = mTokens.begin();
+    while (iter != mTokens.end()) {
+        SpeculativeToken &token = *iter;
+        bool discard = false;
+        if (!token.mReady) {
+            IntegrityResponseStatus responseStatus = INTEGRITY_RESPONSE_UNKNOWN;
+            const IntegrityErrorCode errorCode =
+                    IntegrityTokenResponse_getStatus(token.mResponse, &responseStatus);
+            if (errorCode != INTEGRITY_NO_ERROR) {
+                ALOGE("Play Integrity returned error for speculative request: %d", errorCode);
+                ++mStats.failed;
+                discard = true;
+            } else if (responseStatus == INTEGRITY_RESPONSE_COMPLETED) {
+                token.mToken = IntegrityTokenResponse_getToken(token.mResponse);
+                token.mReady = true;
+                token.mExpireTime = Min(token.mExpireTime, currentTime + mConfig.maxTokenAge);
+                DestroyRequest(token);
+            }
+        }
+        if (!discard && currentTime >= token.mExpireTime) {
+            RecordWaste(currentTime);
+            discard = true;
+        }
+        if (discard) {
+            DestroyRequest(token);
+            iter = mTokens.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+bool SpeculativeTokenCache::HasReadyToken(const std::string &command, float currentTime) const {
+    for (const SpeculativeToken &token : mTokens) {
+        if (token.mReady && token.mCommand == command && currentTime < token.mExpireTime) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<std::string> SpeculativeTokenCache::TakeReadyToken(const std::string &command,
+                                                                 float currentTime) {
+    for (auto iter = mTokens.begin(); iter != mTokens.end(); ++iter) {
+        if (iter->mReady && iter->mCommand == command && currentTime < iter->mExpireTime) {
+            std::string tokenString = std::move(iter->mToken);
+            mTokens.erase(iter);
+            ++mStats.used;
+            return tokenString;
+        }
+    }
+    return std::nullopt;
+}
+
+bool SpeculativeTokenCache::TakePendingRequest(const std::string &command,
+                                               IntegrityTokenRequest **request,
+                                               IntegrityTokenResponse **response,
+                                               float *expireTime) {
+    for (auto iter = mTokens.begin(); iter != mTokens.end(); ++iter) {
+        if (!iter->mReady && iter->mCommand == command) {
+            *request = iter->mRequest;
+            *response = iter->mResponse;
+            *expireTime = iter->mExpireTime;
+            mTokens.erase(iter);
+            ++mStats.adopted;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SpeculativeTokenCache::Clear(float currentTime) {
+    for (SpeculativeToken &token : mTokens) {
+        DestroyRequest(token);
+        RecordWaste(currentTime);
+    }
+    mTokens.clear();
+}
+
+void SpeculativeTokenCache::DestroyRequest(SpeculativeToken &token) {
+    if (token.mResponse != nullptr) {
+        IntegrityTokenResponse_destroy(token.mResponse);
+        token.mResponse = nullptr;
+    }
+    if (token.mRequest != nullptr) {
+        IntegrityTokenRequest_destroy(token.mRequest);
+        token.mRequest = nullptr;
+    }
+}
+
+void SpeculativeTokenCache::RecordWaste(float currentTime) {
+    mWasteTimes.push_back(currentTime);
+    ++mStats.wasted;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "play/integrity.h"
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+ * Requests Play Integrity tokens ahead of time for commands the game is
+ * likely to send next. The nonce only depends on a server random and the
+ * command string, so a token for a known command can be generated as soon
+ * as a random is available, leaving just the command round trip once the
+ * player actually triggers the command.
+ */
+class SpeculativeTokenCache {
+public:
+    struct Config {
+        // Maximum number of speculative tokens pending or ready at once
+        size_t maxTokens;
+        // Maximum number of tokens allowed to go unused per budget window
+        uint32_t wasteBudget;
+        // Length of the waste budget window in seconds
+        float wasteBudgetWindow;
+        // Age in seconds after which a completed but unused token is discarded
+        float maxTokenAge;
+    };
+
+    struct Stats {
+        // Speculative token requests started
+        uint64_t requested;
+        // Completed tokens handed to a command
+        uint64_t used;
+        // Pending requests handed to a command before they completed
+        uint64_t adopted;
+        // Tokens discarded without being used
+        uint64_t wasted;
+        // Requests that returned an error
+        uint64_t failed;
+        // Speculation skipped because the waste budget was spent
+        uint64_t budgetDenied;
+    };
+
+    explicit SpeculativeTokenCache(const Config &config);
+
+    ~SpeculativeTokenCache();
+
+    SpeculativeTokenCache(const SpeculativeTokenCache &) = delete;
+
+    void operator=(const SpeculativeTokenCache &) = delete;
+
+    void SetConfig(const Config &config) { mConfig = config; }
+
+    const Config &GetConfig() const { return mConfig; }
+
+    const Stats &GetStats() const { return mStats; }
+
+    // Returns true if a speculative request for command may be started now
+    bool CanSpeculate(const std::string &command, float currentTime);
+
+    // Requests a token for command with the given nonce. expireTime is when
+    // the random inside the nonce stops being accepted by the server.
+    bool StartSpeculation(const std::string &command, const char *nonce, float expireTime);
+
+    // Polls outstanding requests and discards tokens that expired
+    void Update(float currentTime);
+
+    // Returns true if a completed token for command is ready to be taken
+    bool HasReadyToken(const std::string &command, float currentTime) const;
+
+    // Removes and returns a completed token for command, if one is ready
+    std::optional<std::string> TakeReadyToken(const std::string &command, float currentTime);
+
+    // Hands ownership of a still pending request for command to the caller,
+    // along with the time the random inside its nonce stops being accepted
+    bool TakePendingRequest(const std::string &command, IntegrityTokenRequest **request,
+                            IntegrityTokenResponse **response, float *expireTime);
+
+    // Discards every speculative token, counting them as wasted
+    void Clear(float currentTime);
+
+private:
+    struct SpeculativeToken {
+        std::string mCommand;
+        std::string mToken;
+        IntegrityTokenRequest *mRequest;
+        IntegrityTokenResponse *mResponse;
+        float mExpireTime;
+        bool mReady;
+    };
+
+    static void DestroyRequest(SpeculativeToken &token);
+
+    void RecordWaste(float currentTime);
+
+    Config mConfig;
+    Stats mStats;
+    std::vector<SpeculativeToken> mTokens;
+    std::deque<float> mWasteTimes;
+};
@@ -0,0 +1,264 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Maximum number of stages a StagedPipeline can have
+constexpr size_t MAX_PIPELINE_STAGES = 8;
+
+// Timestamps recorded for an item as it moves through a StagedPipeline,
+// in seconds of the pipeline's clock. Stages the item hasn't reached are zero.
+struct PipelineTiming {
+    struct StageTiming {
+        // Stage handler has looked at the item
+        bool mStarted;
+        // Item was queued for the stage
+        float mEnterTime;
+        // Stage handler first looked at the item
+        float mStartTime;
+        // Item left the stage
+        float mExitTime;
+    };
+
+    float mSubmitTime;
+    float mCompleteTime;
+    StageTiming mStages[MAX_PIPELINE_STAGES];
+};
+
+struct PipelineStageStats {
+    // Items that finished the stage
+    uint64_t completed;
+    // Items the stage failed
+    uint64_t failed;
+    // Total and worst time items spent queued before the stage started on them
+    float totalQueueTime;
+    float maxQueueTime;
+    // Total and worst time items spent being worked on by the stage
+    float totalActiveTime;
+    float maxActiveTime;
+};
+
+/*
+ * Moves work items through a fixed sequence of stages, with a queue in
+ * front of each stage. Every call to Pump() lets each stage look at up to
+ * its active limit of items from the front of its queue, whether they
+ * finish or keep waiting, so independent items overlap at different
+ * stages and a stage with a limit of one handles one item per pump. A stage handler either finishes with
+ * an item, asks to see it again on the next pump, or fails it, which ends
+ * its trip through the pipeline early.
+ *
+ * Item must have a PipelineTiming member named mTiming.
+ */
+template<typename Item>
+class StagedPipeline {
+public:
+    enum StageStatus {
+        // The item is done with this stage and moves to the next one
+        STAGE_STATUS_DONE = 0,
+        // The item stays at this stage and is looked at again next pump
+        STAGE_STATUS_WAITING,
+        // The item leaves the pipeline without running the remaining stages
+        STAGE_STATUS_FAILED
+    };
+
+    typedef std::function<StageStatus(Item &item, float currentTime)> StageHandler;
+
+    typedef std::function<void(std::unique_ptr<Item> item)> CompletionHandler;
+
+    explicit StagedPipeline(std::function<float()> clock) : mClock(clock) {}
+
+    StagedPipeline(const StagedPipeline &) = delete;
+
+    void operator=(const StagedPipeline &) = delete;
+
+    /**
+     * Appends a stage to the pipeline.
+     *
+     * @param name Name of the stage, for logging.
+     * @param maxActive Maximum number of items the stage works on at once,
+     * and so looks at in one pump.
+     * @param handler Called for each item the stage is working on.
+     * @return The index of the new stage.
+     */
+    size_t AddStage(const char *name, size_t maxActive, StageHandler handler) {
+        // Every item's PipelineTiming has room for this many stages and no more
+        if (mStages.size() >= MAX_PIPELINE_STAGES) {
+            abort();
+        }
+        mStages.emplace_back();
+        Stage &stage = mStages.back();
+        stage.mName = name;
+        stage.mMaxActive = maxActive;
+        stage.mHandler = handler;
+        stage.mStats = {};
+        return mStages.size() - 1;
+    }
+
+    // Sets the function that receives items once they leave the pipeline
+    void SetCompletionHandler(CompletionHandler handler) { mCompletionHandler = handler; }
+
+    // Queues an item for the first stage
+    void Submit(std::unique_ptr<Item> item) {
+        const float currentTime = mClock();
+        item->mTiming = {};
+        item->mTiming.mSubmitTime = currentTime;
+        EnterStage(0, std::move(item), currentTime);
+    }
+
+    // Lets every stage work on the items at the front of its queue
+    void Pump() {
+        for (size_t stageIndex = 0; stageIndex < mStages.size(); ++stageIndex) {
+            Stage &stage = mStages[stageIndex];
+            size_t queueIndex = 0;
+            // Items that finish leave the queue, so the limit counts the
+            // items looked at rather than the queue position reached
+            size_t handledCount = 0;
+            while (queueIndex < stage.mQueue.size() && handledCount < stage.mMaxActive) {
+                ++handledCount;
+                Item &item = *stage.mQueue[queueIndex];
+                PipelineTiming::StageTiming &timing = item.mTiming.mStages[stageIndex];
+                const float startTime = mClock();
+                if (!timing.mStarted) {
+                    timing.mStarted = true;
+                    timing.mStartTime = startTime;
+                }
+                const StageStatus status = stage.mHandler(item, startTime);
+                if (status == STAGE_STATUS_WAITING) {
+                    ++queueIndex;
+                    continue;
+                }
+                // Stage handlers may block (on the network, for example), so
+                // read the clock again to see how long the stage really took
+                const float currentTime = mClock();
+                std::unique_ptr<Item> doneItem = std::move(stage.mQueue[queueIndex]);
+                stage.mQueue.erase(stage.mQueue.begin() + queueIndex);
+                ExitStage(stageIndex, *doneItem, status, currentTime);
+                if (status == STAGE_STATUS_DONE && stageIndex + 1 < mStages.size()) {
+                    EnterStage(stageIndex + 1, std::move(doneItem), currentTime);
+                } else {
+                    Complete(std::move(doneItem), currentTime);
+                }
+            }
+        }
+    }
+
+    // Returns the first item still in the pipeline that predicate accepts, or null
+    template<typename Predicate>
+    Item *FindItem(Predicate predicate) {
+        for (Stage &stage : mStages) {
+            for (std::unique_ptr<Item> &item : stage.mQueue) {
+                if (predicate(*item)) {
+                    return item.get();
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // Takes every item that predicate accepts out of the pipeline, the
+    // completion handler isn't run for them
+    template<typename Predicate>
+    std::vector<std::unique_ptr<Item>> RemoveIf(Predicate predicate) {
+        std::vector<std::unique_ptr<Item>> removed;
+        for (Stage &stage : mStages) {
+            auto iter = stage.mQueue.begin();
+            while (iter != stage.mQueue.end()) {
+                if (predicate(**iter)) {
+                    removed.push_back(std::move(*iter));
+                    iter = stage.mQueue.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+        return removed;
+    }
+
+    // Drops every item in the pipeline without running the completion handler
+    void Clear() {
+        for (Stage &stage : mStages) {
+            stage.mQueue.clear();
+        }
+    }
+
+    size_t GetInFlightCount() const {
+        size_t count = 0;
+        for (const Stage &stage : mStages) {
+            count += stage.mQueue.size();
+        }
+        return count;
+    }
+
+    size_t GetStageCount() const { return mStages.size(); }
+
+    const char *GetStageName(size_t stageIndex) const { return mStages[stageIndex].mName; }
+
+    size_t GetStageDepth(size_t stageIndex) const { return mStages[stageIndex].mQueue.size(); }
+
+    const PipelineStageStats &GetStageStats(size_t stageIndex) const {
+        return mStages[stageIndex].mStats;
+    }
+
+private:
+    struct Stage {
+        const char *mName;
+        size_t mMaxActive;
+        StageHandler mHandler;
+        std::deque<std::unique_ptr<Item>> mQueue;
+        PipelineStageStats mStats;
+    };
+
+    void EnterStage(size_t stageIndex, std::unique_ptr<Item> item, float currentTime) {
+        item->mTiming.mStages[stageIndex].mEnterTime = currentTime;
+        mStages[stageIndex].mQueue.push_back(std::move(item));
+    }
+
+    void ExitStage(size_t stageIndex, Item &item, StageStatus status, float currentTime) {
+        PipelineTiming::StageTiming &timing = item.mTiming.mStages[stageIndex];
+        timing.mExitTime = currentTime;
+        PipelineStageStats &stats = mStages[stageIndex].mStats;
+        const float queueTime = timing.mStartTime - timing.mEnterTime;
+        const float activeTime = timing.mExitTime - timing.mStartTime;
+        stats.totalQueueTime += queueTime;
+        stats.totalActiveTime += activeTime;
+        stats.maxQueueTime = queueTime > stats.maxQueueTime ? queueTime : stats.maxQueueTime;
+        stats.maxActiveTime = activeTime > stats.maxActiveTime ? activeTime : stats.maxActiveTime;
+        if (status == STAGE_STATUS_FAILED) {
+            ++stats.failed;
+        } else {
+            ++stats.completed;
+        }
+    }
+
+    void Complete(std::unique_ptr<Item> item, float currentTime) {
+        item->mTiming.mCompleteTime = currentTime;
+        if (mCompletionHandler) {
+            mCompletionHandler(std::move(item));
+        }
+    }
+
+    std::function<float()> mClock;
+    // Stages own queues of move-only items, a deque never has to move them
+    std::deque<Stage> mStages;
+    CompletionHandler mCompletionHandler;
+};
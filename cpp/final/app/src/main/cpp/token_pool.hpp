@@ -0,0 +1,136 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ring_buffer.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+struct TokenPoolStats {
+    // Tokens handed out from the pool
+    uint64_t hits;
+    // Requests that found the pool empty
+    uint64_t misses;
+    // Tokens discarded because they were too old to use
+    uint64_t expired;
+    // Tokens discarded to make room for newer ones while still usable
+    uint64_t evicted;
+    // Tokens added to the pool
+    uint64_t added;
+};
+
+/*
+ * Holds short-lived values issued by the server ahead of time, such as
+ * nonce randoms or express tokens, so a command does not have to wait on a
+ * round trip to get one. Each token remembers when it was issued and is
+ * dropped once it gets too close to the server's timeout to be safely used.
+ *
+ * Token is an InlineString, and the pool's storage is allocated up front,
+ * so adding and taking tokens never allocates.
+ */
+template<typename Token>
+class TokenPool {
+public:
+    struct PooledToken {
+        Token mToken;
+        float mIssueTime;
+    };
+
+    typedef TokenPoolStats Stats;
+
+    /**
+     * Constructs a token pool.
+     *
+     * @param capacity The number of tokens the pool tries to keep on hand.
+     * @param maxAge Age in seconds after which a pooled token is discarded.
+     */
+    TokenPool(size_t capacity, float maxAge) : mTokens(capacity) {
+        mMaxAge = maxAge;
+        mStats = {};
+    }
+
+    // Adds a token that was issued by the server at issueTime. Tokens
+    // too long for Token are ignored.
+    void AddToken(std::string_view token, float issueTime) {
+        PooledToken pooledToken = {Token(), issueTime};
+        if (token.empty() || !pooledToken.mToken.Assign(token) || mTokens.GetCapacity() == 0) {
+            return;
+        }
+        // Keep the pool bounded, dropping the oldest entry to make room
+        if (mTokens.IsFull()) {
+            mTokens.PopFront();
+            ++mStats.evicted;
+        }
+        // Responses can arrive out of order, move the token back past any
+        // that were issued after it so the pool stays sorted by issue time
+        mTokens.PushBack(pooledToken);
+        for (size_t index = mTokens.GetSize() - 1;
+             index > 0 && mTokens[index - 1].mIssueTime > mTokens[index].mIssueTime; --index) {
+            std::swap(mTokens[index - 1], mTokens[index]);
+        }
+        ++mStats.added;
+    }
+
+    // Removes and returns the oldest usable token, or an empty result
+    // if the pool has none left
+    std::optional<PooledToken> TakeToken(float currentTime) {
+        DiscardExpired(currentTime);
+        if (mTokens.IsEmpty()) {
+            ++mStats.misses;
+            return std::nullopt;
+        }
+        // Hand out the oldest token first, it has the least time left to live
+        ++mStats.hits;
+        return mTokens.PopFront();
+    }
+
+    // Drops every token that is older than the maximum age
+    void DiscardExpired(float currentTime) {
+        // The pool is kept sorted by issue time, so expired entries are always at the front
+        while (!mTokens.IsEmpty() && (currentTime - mTokens.Front().mIssueTime) >= mMaxAge) {
+            mTokens.PopFront();
+            ++mStats.expired;
+        }
+    }
+
+    bool NeedsRefill() const { return !mTokens.IsFull(); }
+
+    // Returns the time at which a token issued at issueTime stops being usable
+    float GetExpireTime(float issueTime) const { return issueTime + mMaxAge; }
+
+    // Returns when the token that would be handed out next was issued
+    std::optional<float> GetOldestIssueTime() const {
+        if (mTokens.IsEmpty()) {
+            return std::nullopt;
+        }
+        return mTokens.Front().mIssueTime;
+    }
+
+    size_t GetCapacity() const { return mTokens.GetCapacity(); }
+
+    size_t GetCount() const { return mTokens.GetSize(); }
+
+    const Stats &GetStats() const { return mStats; }
+
+private:
+    RingBuffer<PooledToken> mTokens;
+    float mMaxAge;
+    Stats mStats;
+};
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "constexpr_sha256.hpp"
+#include "inline_string.hpp"
+
+// Randoms are 16 random bytes from the server, in hex
+constexpr size_t RANDOM_SIZE = 16;
+constexpr size_t RANDOM_LENGTH = RANDOM_SIZE * 2;
+// A nonce is a random followed by the hex SHA-256 of what it covers, the
+// longest of the nonce formats
+constexpr size_t NONCE_MAX_LENGTH = RANDOM_LENGTH + SHA256_HEX_LENGTH;
+// Nonce sessions are identified by a server random, and keyed with a
+// 32 byte secret
+constexpr size_t SESSION_ID_MAX_LENGTH = 64;
+constexpr size_t SESSION_SECRET_SIZE = 32;
+// Client request ids are 16 random bytes made by the client, in hex
+constexpr size_t REQUEST_ID_SIZE = 16;
+constexpr size_t REQUEST_ID_LENGTH = REQUEST_ID_SIZE * 2;
+// Express tokens are server randoms as well, with room to spare in case
+// the server starts issuing longer ones
+constexpr size_t EXPRESS_TOKEN_MAX_LENGTH = 64;
+
+typedef InlineString<RANDOM_LENGTH> RandomString;
+
+typedef InlineString<NONCE_MAX_LENGTH> NonceString;
+
+typedef InlineString<EXPRESS_TOKEN_MAX_LENGTH> ExpressTokenString;
+
+typedef InlineString<REQUEST_ID_LENGTH> RequestIdString;
+
+typedef InlineString<SESSION_ID_MAX_LENGTH> SessionIdString;
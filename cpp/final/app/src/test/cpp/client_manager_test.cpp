@@ -0,0 +1,210 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "client_manager.hpp"
+#include "fake_integrity.hpp"
+#include "json_util.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    constexpr char COMMAND[] = "TRANSFER FROM carol TO dave CURRENCY gold QUANTITY 5";
+    // Issued with every successful command result
+    constexpr char EXPRESS_TOKEN[] = "ZXhwcmVzcw";
+    // Keys of the command payload the tests look at
+    constexpr char COMMANDSTRING_KEY[] = "commandString";
+    constexpr char TOKENSTRING_KEY[] = "tokenString";
+    constexpr char REQUESTID_KEY[] = "requestId";
+    // The fake clock moves this far before each update
+    constexpr float UPDATE_INTERVAL = 0.1f;
+    // Most updates to wait for something to happen, long enough for a
+    // journal replay
+    constexpr int MAX_UPDATES = 200;
+
+    // Answers the client the way the server does, and keeps every POST
+    // for the tests to look at
+    class FakeTransport : public ClientTransport {
+    public:
+        struct SentPost {
+            std::string mUrl;
+            std::string mBody;
+        };
+
+        FakeTransport() {
+            mRandomCount = 0;
+            mFailPosts = false;
+        }
+
+        std::optional<std::string> Get(const std::string & /*url*/,
+                                       std::string * /*error*/) override {
+            // Every random is different, in the 32 hex digits the server sends
+            char random[RANDOM_LENGTH + 1];
+            snprintf(random, sizeof(random), "%032x", ++mRandomCount);
+            return std::string("{\"random\":\"") + random + "\"}";
+        }
+
+        std::optional<std::string> Post(const std::string &url, const std::string &body,
+                                        std::string *error) override {
+            mPosts.push_back({url, body});
+            if (mFailPosts) {
+                *error = "Connection refused";
+                return std::nullopt;
+            }
+            return std::string("{\"commandSuccess\":true,\"diagnosticMessage\":\"Done\","
+                               "\"expressToken\":\"") + EXPRESS_TOKEN + "\"}";
+        }
+
+        unsigned int mRandomCount;
+        // POSTs fail as if the server couldn't be reached
+        bool mFailPosts;
+        std::vector<SentPost> mPosts;
+    };
+
+    // Drives a ClientManager through the fake Play Integrity backend, a
+    // fake transport and a clock that only moves when the test moves it
+    class ClientManagerTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            FakeIntegrity::Config config = FakeIntegrity::GetDefaultConfig();
+            config.latencyDistribution = FakeIntegrity::FAKE_LATENCY_FIXED;
+            config.latencyMin = 0.0f;
+            FakeIntegrity::SetConfig(config);
+            FakeIntegrity::ResetStats();
+            char dataPath[] = "/tmp/client_manager_test_XXXXXX";
+            ASSERT_NE(mkdtemp(dataPath), nullptr);
+            mDataPath = dataPath;
+            mTime = 0.0f;
+            mTransport = std::make_shared<FakeTransport>();
+            ClientContext context = {nullptr, nullptr, mDataPath, mTransport,
+                                     [this]() { return mTime; }};
+            mClient = std::make_unique<ClientManager>(context);
+            // Speculative token requests would take the rate limits and
+            // the randoms the tests are counting on
+            mClient->ClearPredictedCommands();
+        }
+
+        void TearDown() override {
+            mClient.reset();
+            unlink((mDataPath + "/command_journal.bin").c_str());
+            rmdir(mDataPath.c_str());
+            FakeIntegrity::SetConfig(FakeIntegrity::GetDefaultConfig());
+        }
+
+        // Updates until count commands have finished, returns false if
+        // they don't within MAX_UPDATES
+        bool UpdateUntilCompleted(uint64_t count) {
+            for (int i = 0; i < MAX_UPDATES; ++i) {
+                if (mClient->GetLifecycleStats().completed >= count) {
+                    return true;
+                }
+                mTime += UPDATE_INTERVAL;
+                mClient->Update();
+            }
+            return mClient->GetLifecycleStats().completed >= count;
+        }
+
+        // Value of key in the payload of the POST at index
+        std::string GetPostValue(size_t index, const char *key) {
+            JsonLookup lookup;
+            if (index >= mTransport->mPosts.size() ||
+                    !lookup.ParseJson(mTransport->mPosts[index].mBody)) {
+                return "";
+            }
+            return lookup.GetStringValueForKey(key).value_or("");
+        }
+
+        std::string mDataPath;
+        float mTime;
+        std::shared_ptr<FakeTransport> mTransport;
+        std::unique_ptr<ClientManager> mClient;
+    };
+}
+
+TEST_F(ClientManagerTest, SendsIntegrityCommandWithTokenAndRequestId) {
+    EXPECT_EQ(mClient->StartCommandIntegrity(COMMAND), COMMAND_QUEUE_ACCEPTED);
+    ASSERT_TRUE(UpdateUntilCompleted(1));
+
+    ASSERT_EQ(mTransport->mPosts.size(), 1u);
+    EXPECT_EQ(GetPostValue(0, COMMANDSTRING_KEY), COMMAND);
+    EXPECT_FALSE(GetPostValue(0, TOKENSTRING_KEY).empty());
+    EXPECT_EQ(GetPostValue(0, REQUESTID_KEY).size(), REQUEST_ID_LENGTH);
+    ASSERT_FALSE(mClient->GetRecentResults().empty());
+    const ClientManager::CommandResult &result = mClient->GetRecentResults().back();
+    EXPECT_EQ(result.mCommand, COMMAND);
+    EXPECT_EQ(result.mResult, ClientManager::SERVER_OPERATION_SUCCESS);
+    EXPECT_EQ(result.mSummary, "Done");
+    EXPECT_EQ(FakeIntegrity::GetStats().completed, 1u);
+}
+
+TEST_F(ClientManagerTest, ExpressCommandUsesTokenFromIntegrityResult) {
+    // No express token until an integrity command earns one
+    EXPECT_EQ(mClient->StartCommandExpress(COMMAND), COMMAND_QUEUE_REJECTED);
+    mClient->StartCommandIntegrity(COMMAND);
+    ASSERT_TRUE(UpdateUntilCompleted(1));
+    EXPECT_EQ(mClient->GetExpressTokenCount(), 1u);
+
+    EXPECT_EQ(mClient->StartCommandExpress(COMMAND), COMMAND_QUEUE_ACCEPTED);
+    ASSERT_TRUE(UpdateUntilCompleted(2));
+    ASSERT_EQ(mTransport->mPosts.size(), 2u);
+    EXPECT_EQ(GetPostValue(1, TOKENSTRING_KEY), EXPRESS_TOKEN);
+    EXPECT_NE(GetPostValue(1, REQUESTID_KEY), GetPostValue(0, REQUESTID_KEY));
+    EXPECT_EQ(mClient->GetRecentResults().back().mResult,
+              ClientManager::SERVER_OPERATION_SUCCESS);
+}
+
+TEST_F(ClientManagerTest, RefusesCommandsUntilTheRateLimitAllows) {
+    // One Play Integrity token request every two seconds, nothing else limited
+    RateLimiter::Config config = {};
+    config.endpoint[RateLimiter::RATE_LIMIT_ENDPOINT_INTEGRITY_TOKEN] = {0.5f, 1.0f};
+    mClient->SetRateLimiterConfig(config);
+
+    EXPECT_EQ(mClient->StartCommandIntegrity(COMMAND), COMMAND_QUEUE_ACCEPTED);
+    ASSERT_TRUE(UpdateUntilCompleted(1));
+    EXPECT_EQ(mClient->StartCommandIntegrity("SECOND COMMAND"), COMMAND_QUEUE_RATE_LIMITED);
+    EXPECT_GT(mClient->GetRetryAfter(), 0.0f);
+    EXPECT_LE(mClient->GetRetryAfter(), 2.0f);
+
+    mTime += mClient->GetRetryAfter();
+    EXPECT_EQ(mClient->StartCommandIntegrity("SECOND COMMAND"), COMMAND_QUEUE_ACCEPTED);
+    ASSERT_TRUE(UpdateUntilCompleted(2));
+    EXPECT_EQ(mTransport->mPosts.size(), 2u);
+}
+
+TEST_F(ClientManagerTest, ReplaysJournaledCommandWithTheSameRequestId) {
+    mTransport->mFailPosts = true;
+    mClient->StartCommandIntegrity(COMMAND);
+    ASSERT_TRUE(UpdateUntilCompleted(1));
+    EXPECT_EQ(mClient->GetRecentResults().back().mResult,
+              ClientManager::SERVER_OPERATION_NETWORK_ERROR);
+    EXPECT_EQ(mClient->GetJournaledCommandCount(), 1u);
+
+    // The replay is the same command, sent again under the id it was
+    // first sent with so the server can tell it performed it already
+    mTransport->mFailPosts = false;
+    ASSERT_TRUE(UpdateUntilCompleted(2));
+    ASSERT_EQ(mTransport->mPosts.size(), 2u);
+    EXPECT_EQ(GetPostValue(1, COMMANDSTRING_KEY), COMMAND);
+    EXPECT_EQ(GetPostValue(1, REQUESTID_KEY), GetPostValue(0, REQUESTID_KEY));
+    EXPECT_EQ(mClient->GetRecentResults().back().mResult,
+              ClientManager::SERVER_OPERATION_SUCCESS);
+    EXPECT_EQ(mClient->GetJournaledCommandCount(), 0u);
+}
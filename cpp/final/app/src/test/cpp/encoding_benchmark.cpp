@@ -0,0 +1,115 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times Encoding::HexEncode against the HEX_TABLE loop digests were hex
+// encoded with before Encoding, and FindJsonEscape against a plain loop.
+//
+//   encoding_benchmark [data size]
+
+#include "encoding.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+    // Hex conversion table
+    constexpr char HEX_TABLE[] = "0123456789abcdef";
+    // Encode about this many bytes per measurement
+    constexpr size_t BYTES_PER_RUN = 64 * 1024 * 1024;
+    constexpr int RUNS = 5;
+
+    // Keeps the compiler from dropping results nobody reads
+    volatile size_t gSink;
+
+    // Best of several runs, in nanoseconds per call
+    template<typename Encode>
+    double TimeCalls(size_t callCount, Encode encode) {
+        double best = 0.0;
+        for (int run = 0; run < RUNS; ++run) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t call = 0; call < callCount; ++call) {
+                encode();
+            }
+            const std::chrono::duration<double, std::nano> elapsed =
+                    std::chrono::steady_clock::now() - start;
+            const double perCall = elapsed.count() / callCount;
+            if (run == 0 || perCall < best) {
+                best = perCall;
+            }
+        }
+        return best;
+    }
+}
+
+int main(int argc, char **argv) {
+    // A SHA-256 digest by default
+    const size_t size = argc > 1 ? strtoul(argv[1], nullptr, 10) : 32;
+
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>(i * 151 + 7);
+    }
+    std::vector<char> hex(Encoding::GetHexEncodedLength(size) + 1);
+    // JSON text with nothing to escape, so the whole of it is scanned
+    const std::string json(size, 'a');
+    const size_t callCount = BYTES_PER_RUN / (size + 1) + 1;
+
+    printf("%zu bytes\n", size);
+    const double hexBaseline = TimeCalls(callCount, [&]() {
+        char *hexOut = hex.data();
+        for (size_t i = 0; i < size; ++i) {
+            *hexOut++ = HEX_TABLE[((data[i] >> 4) & 0xF)];
+            *hexOut++ = HEX_TABLE[(data[i] & 0xF)];
+        }
+        *hexOut = '\0';
+        gSink = static_cast<uint8_t>(hex[0]);
+    });
+    printf("%-24s %10.1f ns\n", "HEX_TABLE hex", hexBaseline);
+    const double jsonBaseline = TimeCalls(callCount, [&]() {
+        size_t i = 0;
+        for (; i < json.size(); ++i) {
+            const uint8_t c = static_cast<uint8_t>(json[i]);
+            if (c < 0x20 || c == '"' || c == '\\') {
+                break;
+            }
+        }
+        gSink = i;
+    });
+    printf("%-24s %10.1f ns\n", "plain loop json scan", jsonBaseline);
+
+    const Encoding::Implementation detected = Encoding::GetImplementation();
+    for (int i = 0; i < Encoding::ENCODING_IMPLEMENTATION_COUNT; ++i) {
+        const auto implementation = static_cast<Encoding::Implementation>(i);
+        if (!Encoding::SetImplementation(implementation)) {
+            continue;
+        }
+        const double hexTime = TimeCalls(callCount, [&]() {
+            Encoding::HexEncode(data.data(), size, hex.data());
+            gSink = static_cast<uint8_t>(hex[0]);
+        });
+        const double jsonTime = TimeCalls(callCount, [&]() {
+            gSink = Encoding::FindJsonEscape(json);
+        });
+        printf("%-11s hex %10.1f ns  %5.2fx   json scan %10.1f ns  %5.2fx\n",
+               Encoding::GetImplementationName(implementation), hexTime, hexBaseline / hexTime,
+               jsonTime, jsonBaseline / jsonTime);
+    }
+    Encoding::SetImplementation(detected);
+    return 0;
+}
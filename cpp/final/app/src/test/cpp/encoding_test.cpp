@@ -0,0 +1,271 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "encoding.hpp"
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    constexpr char BASE64URL_ALPHABET[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    // Long enough to go through every kernel's main loop several times and
+    // leave every possible tail length for the tables
+    constexpr size_t MAX_FUZZ_LENGTH = 200;
+    constexpr int FUZZ_ROUNDS = 2000;
+
+    // Straightforward versions to check the kernels and tables against
+
+    std::string ReferenceHexEncode(const std::vector<uint8_t> &data) {
+        std::string hex;
+        for (uint8_t byte : data) {
+            hex += HEX_DIGITS[byte >> 4];
+            hex += HEX_DIGITS[byte & 0x0F];
+        }
+        return hex;
+    }
+
+    std::string ReferenceBase64UrlEncode(const std::vector<uint8_t> &data) {
+        std::string text;
+        uint32_t bits = 0;
+        int bitCount = 0;
+        for (uint8_t byte : data) {
+            bits = (bits << 8) | byte;
+            bitCount += 8;
+            while (bitCount >= 6) {
+                bitCount -= 6;
+                text += BASE64URL_ALPHABET[(bits >> bitCount) & 0x3F];
+            }
+        }
+        if (bitCount > 0) {
+            text += BASE64URL_ALPHABET[(bits << (6 - bitCount)) & 0x3F];
+        }
+        return text;
+    }
+
+    bool ReferenceIsHex(std::string_view text) {
+        return text.size() % 2 == 0 &&
+               text.find_first_not_of("0123456789abcdefABCDEF") == std::string_view::npos;
+    }
+
+    bool ReferenceIsBase64Url(std::string_view text) {
+        return text.size() % 4 != 1 &&
+               text.find_first_not_of(BASE64URL_ALPHABET) == std::string_view::npos;
+    }
+
+    size_t ReferenceFindJsonEscape(std::string_view text) {
+        for (size_t i = 0; i < text.size(); ++i) {
+            const uint8_t c = static_cast<uint8_t>(text[i]);
+            if (c < 0x20 || c == '"' || c == '\\') {
+                return i;
+            }
+        }
+        return text.size();
+    }
+
+    std::vector<uint8_t> RandomBytes(std::mt19937 &random, size_t size) {
+        std::vector<uint8_t> data(size);
+        for (uint8_t &byte : data) {
+            byte = static_cast<uint8_t>(random());
+        }
+        return data;
+    }
+
+    // Mostly characters from alphabet, with the odd byte from anywhere so
+    // invalid characters turn up at every position
+    std::string RandomText(std::mt19937 &random, size_t length, std::string_view alphabet) {
+        std::string text(length, '\0');
+        for (char &c : text) {
+            c = random() % 16 == 0 ? static_cast<char>(random()) :
+                alphabet[random() % alphabet.size()];
+        }
+        return text;
+    }
+
+    std::vector<Encoding::Implementation> FindSupportedImplementations() {
+        std::vector<Encoding::Implementation> implementations;
+        for (int i = 0; i < Encoding::ENCODING_IMPLEMENTATION_COUNT; ++i) {
+            const auto implementation = static_cast<Encoding::Implementation>(i);
+            if (Encoding::IsSupported(implementation)) {
+                implementations.push_back(implementation);
+            } else {
+                std::cout << "Skipping unsupported "
+                          << Encoding::GetImplementationName(implementation) << std::endl;
+            }
+        }
+        return implementations;
+    }
+
+    // Found once so each skipped implementation is only reported once
+    const std::vector<Encoding::Implementation> &GetSupportedImplementations() {
+        static const std::vector<Encoding::Implementation> implementations =
+                FindSupportedImplementations();
+        return implementations;
+    }
+}
+
+// Switches between the supported implementations, and puts back the one
+// the CPU picked after each test
+class EncodingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mDetectedImplementation = Encoding::GetImplementation();
+    }
+
+    void TearDown() override {
+        Encoding::SetImplementation(mDetectedImplementation);
+    }
+
+    template<typename Check>
+    void ForEachImplementation(Check check) {
+        for (Encoding::Implementation implementation : GetSupportedImplementations()) {
+            SCOPED_TRACE(Encoding::GetImplementationName(implementation));
+            ASSERT_TRUE(Encoding::SetImplementation(implementation));
+            ASSERT_EQ(Encoding::GetImplementation(), implementation);
+            check();
+        }
+    }
+
+    Encoding::Implementation mDetectedImplementation = Encoding::ENCODING_IMPLEMENTATION_SCALAR;
+};
+
+TEST_F(EncodingTest, ScalarIsAlwaysSupported) {
+    EXPECT_TRUE(Encoding::IsSupported(Encoding::ENCODING_IMPLEMENTATION_SCALAR));
+    EXPECT_TRUE(Encoding::IsSupported(Encoding::GetImplementation()));
+}
+
+TEST_F(EncodingTest, RejectsUnsupportedImplementations) {
+    const Encoding::Implementation before = Encoding::GetImplementation();
+    for (int i = 0; i < Encoding::ENCODING_IMPLEMENTATION_COUNT; ++i) {
+        const auto implementation = static_cast<Encoding::Implementation>(i);
+        if (!Encoding::IsSupported(implementation)) {
+            EXPECT_FALSE(Encoding::SetImplementation(implementation));
+            EXPECT_EQ(Encoding::GetImplementation(), before);
+        }
+    }
+}
+
+TEST_F(EncodingTest, KnownAnswers) {
+    // RFC 4648 section 10 test vectors, without padding
+    const std::string_view data = "foobar";
+    const char *base64Url[] = {"", "Zg", "Zm8", "Zm9v", "Zm9vYg", "Zm9vYmE", "Zm9vYmFy"};
+    ForEachImplementation([&]() {
+        for (size_t size = 0; size <= data.size(); ++size) {
+            EXPECT_EQ(Encoding::Base64UrlEncode(
+                    reinterpret_cast<const uint8_t *>(data.data()), size), base64Url[size]);
+        }
+        const uint8_t bytes[] = {0x00, 0x7F, 0x80, 0xFB, 0xFF, 0x0A};
+        EXPECT_EQ(Encoding::HexEncode(bytes, sizeof(bytes)), "007f80fbff0a");
+        // The two characters base64url has instead of + and /
+        EXPECT_EQ(Encoding::Base64UrlEncode(bytes + 3, 2), "-_8");
+    });
+}
+
+TEST_F(EncodingTest, RoundTripsEveryLength) {
+    std::mt19937 random(45);
+    ForEachImplementation([&]() {
+        for (size_t size = 0; size <= MAX_FUZZ_LENGTH; ++size) {
+            const std::vector<uint8_t> data = RandomBytes(random, size);
+
+            const std::string hex = Encoding::HexEncode(data.data(), data.size());
+            ASSERT_EQ(hex, ReferenceHexEncode(data)) << "size " << size;
+            EXPECT_TRUE(Encoding::IsHex(hex));
+            std::vector<uint8_t> decoded(size);
+            EXPECT_TRUE(Encoding::HexDecode(hex, decoded.data()));
+            EXPECT_EQ(decoded, data) << "size " << size;
+
+            const std::string text = Encoding::Base64UrlEncode(data.data(), data.size());
+            ASSERT_EQ(text, ReferenceBase64UrlEncode(data)) << "size " << size;
+            ASSERT_EQ(text.size(), Encoding::GetBase64UrlEncodedLength(size));
+            EXPECT_TRUE(Encoding::IsBase64Url(text));
+            ASSERT_EQ(Encoding::GetBase64UrlDecodedSize(text.size()), size);
+            decoded.assign(size, 0);
+            EXPECT_TRUE(Encoding::Base64UrlDecode(text, decoded.data()));
+            EXPECT_EQ(decoded, data) << "size " << size;
+        }
+    });
+}
+
+TEST_F(EncodingTest, DecodesUpperCaseHex) {
+    ForEachImplementation([&]() {
+        const std::string hex = "00FFaB7f" + std::string(64, 'E');
+        std::vector<uint8_t> decoded(hex.size() / 2);
+        ASSERT_TRUE(Encoding::HexDecode(hex, decoded.data()));
+        EXPECT_EQ(decoded[1], 0xFF);
+        EXPECT_EQ(decoded[2], 0xAB);
+        EXPECT_EQ(decoded.back(), 0xEE);
+    });
+}
+
+TEST_F(EncodingTest, MatchesScalarOnFuzzedText) {
+    const std::string_view hexAlphabet = "0123456789abcdefABCDEF";
+    const std::string_view jsonAlphabet = "abcdefghijklmnopqrstuvwxyz {}:,0123456789";
+    std::mt19937 random(450);
+    for (int round = 0; round < FUZZ_ROUNDS; ++round) {
+        const size_t length = random() % (MAX_FUZZ_LENGTH + 1);
+        const std::string hex = RandomText(random, length, hexAlphabet);
+        const std::string base64Url = RandomText(random, length, BASE64URL_ALPHABET);
+        const std::string json = RandomText(random, length, jsonAlphabet);
+
+        ASSERT_TRUE(Encoding::SetImplementation(Encoding::ENCODING_IMPLEMENTATION_SCALAR));
+        std::vector<uint8_t> expectedHex(length / 2);
+        const bool hexValid = Encoding::HexDecode(hex, expectedHex.data());
+        std::vector<uint8_t> expectedBase64Url(Encoding::GetBase64UrlDecodedSize(length));
+        const bool base64UrlValid = Encoding::Base64UrlDecode(base64Url, expectedBase64Url.data());
+        ASSERT_EQ(hexValid, ReferenceIsHex(hex)) << hex;
+        ASSERT_EQ(base64UrlValid, ReferenceIsBase64Url(base64Url)) << base64Url;
+
+        ForEachImplementation([&]() {
+            EXPECT_EQ(Encoding::IsHex(hex), hexValid) << hex;
+            std::vector<uint8_t> decoded(expectedHex.size());
+            EXPECT_EQ(Encoding::HexDecode(hex, decoded.data()), hexValid) << hex;
+            if (hexValid) {
+                EXPECT_EQ(decoded, expectedHex) << hex;
+            }
+
+            EXPECT_EQ(Encoding::IsBase64Url(base64Url), base64UrlValid) << base64Url;
+            decoded.assign(expectedBase64Url.size(), 0);
+            EXPECT_EQ(Encoding::Base64UrlDecode(base64Url, decoded.data()), base64UrlValid)
+                    << base64Url;
+            if (base64UrlValid) {
+                EXPECT_EQ(decoded, expectedBase64Url) << base64Url;
+            }
+
+            EXPECT_EQ(Encoding::FindJsonEscape(json), ReferenceFindJsonEscape(json)) << json;
+        });
+        if (HasFailure()) {
+            return;
+        }
+    }
+}
+
+TEST_F(EncodingTest, FindsEveryJsonEscapeAtEveryPosition) {
+    ForEachImplementation([&]() {
+        for (size_t length = 1; length <= 80; ++length) {
+            for (int c = 0; c < 256; ++c) {
+                std::string text(length, 'a');
+                text[length - 1] = static_cast<char>(c);
+                const size_t expected = ReferenceFindJsonEscape(text);
+                ASSERT_EQ(Encoding::FindJsonEscape(text), expected)
+                        << "character " << c << ", length " << length;
+            }
+        }
+    });
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fake_integrity.hpp"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+namespace {
+    // A 16 byte random and a hash, in hex
+    constexpr char RANDOM_HEX[] = "00112233445566778899aabbccddeeff";
+    constexpr char HASH_HEX[] =
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+    // Valid for Play Integrity, but not an app nonce
+    constexpr char PLAIN_NONCE[] = "bm90IGFuIGFwcCBub25jZQ";
+    // Latency for tests that wait on a response
+    constexpr float SHORT_LATENCY = 0.02f;
+    // Longest to wait for a response to complete
+    constexpr std::chrono::seconds COMPLETION_TIMEOUT(5);
+}
+
+// Drives the fake through the play/integrity.h functions the way
+// ClientManager does, with responses that complete as soon as they are
+// polled unless a test says otherwise
+class FakeIntegrityTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mConfig = FakeIntegrity::GetDefaultConfig();
+        mConfig.latencyDistribution = FakeIntegrity::FAKE_LATENCY_FIXED;
+        mConfig.latencyMin = 0.0f;
+        FakeIntegrity::SetConfig(mConfig);
+        FakeIntegrity::ResetStats();
+        ASSERT_EQ(IntegrityManager_init(nullptr, nullptr), INTEGRITY_NO_ERROR);
+    }
+
+    void TearDown() override {
+        IntegrityManager_destroy();
+        FakeIntegrity::SetConfig(FakeIntegrity::GetDefaultConfig());
+        FakeIntegrity::ResetStats();
+    }
+
+    IntegrityErrorCode Request(const std::string &nonce, IntegrityTokenResponse **response) {
+        IntegrityTokenRequest *request = nullptr;
+        EXPECT_EQ(IntegrityTokenRequest_create(&request), INTEGRITY_NO_ERROR);
+        IntegrityTokenRequest_setNonce(request, nonce.c_str());
+        IntegrityTokenRequest_setCloudProjectNumber(request, 1234);
+        const IntegrityErrorCode error = IntegrityManager_requestIntegrityToken(request, response);
+        IntegrityTokenRequest_destroy(request);
+        return error;
+    }
+
+    // Polls response until it completes or COMPLETION_TIMEOUT passes,
+    // returns the error getStatus reports
+    IntegrityErrorCode WaitForCompletion(IntegrityTokenResponse *response) {
+        const auto deadline = std::chrono::steady_clock::now() + COMPLETION_TIMEOUT;
+        IntegrityResponseStatus status = INTEGRITY_RESPONSE_UNKNOWN;
+        IntegrityErrorCode error = INTEGRITY_NO_ERROR;
+        while (std::chrono::steady_clock::now() < deadline) {
+            error = IntegrityTokenResponse_getStatus(response, &status);
+            if (status == INTEGRITY_RESPONSE_COMPLETED) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_EQ(status, INTEGRITY_RESPONSE_COMPLETED);
+        return error;
+    }
+
+    // Requests a token for nonce and waits for it
+    std::string RequestToken(const std::string &nonce) {
+        IntegrityTokenResponse *response = nullptr;
+        EXPECT_EQ(Request(nonce, &response), INTEGRITY_NO_ERROR);
+        if (response == nullptr) {
+            return "";
+        }
+        EXPECT_EQ(WaitForCompletion(response), INTEGRITY_NO_ERROR);
+        const char *token = IntegrityTokenResponse_getToken(response);
+        std::string result = token != nullptr ? token : "";
+        IntegrityTokenResponse_destroy(response);
+        return result;
+    }
+
+    static std::string MakeNonce(NonceCodec::NonceFormat format) {
+        NonceString nonce;
+        EXPECT_TRUE(NonceCodec::Encode(format, RANDOM_HEX, HASH_HEX, &nonce));
+        return std::string(nonce.GetView());
+    }
+
+    FakeIntegrity::Config mConfig;
+};
+
+TEST_F(FakeIntegrityTest, RequiresInitialization) {
+    IntegrityManager_destroy();
+    IntegrityTokenResponse *response = nullptr;
+    EXPECT_EQ(Request(PLAIN_NONCE, &response), INTEGRITY_INITIALIZATION_NEEDED);
+    EXPECT_EQ(response, nullptr);
+    EXPECT_EQ(FakeIntegrity::GetStats().requested, 0u);
+}
+
+TEST_F(FakeIntegrityTest, ChecksNoncesLikePlayIntegrity) {
+    IntegrityTokenResponse *response = nullptr;
+    EXPECT_EQ(Request("c2hvcnQ", &response), INTEGRITY_NONCE_TOO_SHORT);
+    EXPECT_EQ(Request(std::string(501, 'a'), &response), INTEGRITY_NONCE_TOO_LONG);
+    EXPECT_EQ(Request("not+base64/at=all", &response), INTEGRITY_NONCE_IS_NOT_BASE64);
+    EXPECT_EQ(response, nullptr);
+    EXPECT_EQ(FakeIntegrity::GetStats().requested, 3u);
+    EXPECT_EQ(FakeIntegrity::GetStats().rejected, 3u);
+}
+
+TEST_F(FakeIntegrityTest, CountsNonceFormats) {
+    EXPECT_FALSE(RequestToken(MakeNonce(NonceCodec::NONCE_FORMAT_HEX)).empty());
+    EXPECT_FALSE(RequestToken(MakeNonce(NonceCodec::NONCE_FORMAT_COMPACT)).empty());
+    EXPECT_FALSE(RequestToken(PLAIN_NONCE).empty());
+    const FakeIntegrity::Stats stats = FakeIntegrity::GetStats();
+    EXPECT_EQ(stats.nonceFormats[NonceCodec::NONCE_FORMAT_HEX], 1u);
+    EXPECT_EQ(stats.nonceFormats[NonceCodec::NONCE_FORMAT_COMPACT], 1u);
+    EXPECT_EQ(stats.unknownNonces, 1u);
+    EXPECT_EQ(stats.completed, 3u);
+
+    mConfig.requireAppNonce = true;
+    FakeIntegrity::SetConfig(mConfig);
+    IntegrityTokenResponse *response = nullptr;
+    EXPECT_EQ(Request(PLAIN_NONCE, &response), INTEGRITY_INVALID_ARGUMENT);
+    EXPECT_FALSE(RequestToken(MakeNonce(NonceCodec::NONCE_FORMAT_HEX)).empty());
+}
+
+TEST_F(FakeIntegrityTest, TokensAreBase64UrlOfTheConfiguredLength) {
+    for (size_t length = 16; length < 24; ++length) {
+        mConfig.minTokenLength = length;
+        mConfig.maxTokenLength = length;
+        FakeIntegrity::SetConfig(mConfig);
+        const std::string token = RequestToken(PLAIN_NONCE);
+        // Base64url has no lengths of 1 mod 4
+        EXPECT_EQ(token.size(), length % 4 == 1 ? length - 1 : length);
+        EXPECT_TRUE(Encoding::IsBase64Url(token)) << token;
+    }
+}
+
+TEST_F(FakeIntegrityTest, SameSeedGivesSameTokens) {
+    mConfig.seed = 41;
+    FakeIntegrity::SetConfig(mConfig);
+    const std::string first = RequestToken(PLAIN_NONCE);
+    const std::string second = RequestToken(PLAIN_NONCE);
+    EXPECT_NE(first, second);
+
+    FakeIntegrity::SetConfig(mConfig);
+    EXPECT_EQ(RequestToken(PLAIN_NONCE), first);
+    EXPECT_EQ(RequestToken(PLAIN_NONCE), second);
+}
+
+TEST_F(FakeIntegrityTest, WaitsOutTheLatency) {
+    mConfig.latencyMin = SHORT_LATENCY;
+    FakeIntegrity::SetConfig(mConfig);
+    const auto start = std::chrono::steady_clock::now();
+    IntegrityTokenResponse *response = nullptr;
+    ASSERT_EQ(Request(PLAIN_NONCE, &response), INTEGRITY_NO_ERROR);
+    IntegrityResponseStatus status = INTEGRITY_RESPONSE_UNKNOWN;
+    EXPECT_EQ(IntegrityTokenResponse_getStatus(response, &status), INTEGRITY_NO_ERROR);
+    if (std::chrono::steady_clock::now() - start <
+            std::chrono::duration<float>(SHORT_LATENCY)) {
+        EXPECT_EQ(status, INTEGRITY_RESPONSE_WAITING);
+        EXPECT_EQ(IntegrityTokenResponse_getToken(response), nullptr);
+    }
+    EXPECT_EQ(WaitForCompletion(response), INTEGRITY_NO_ERROR);
+    EXPECT_GE(std::chrono::steady_clock::now() - start,
+              std::chrono::duration<float>(SHORT_LATENCY));
+    EXPECT_NE(IntegrityTokenResponse_getToken(response), nullptr);
+    IntegrityTokenResponse_destroy(response);
+}
+
+TEST_F(FakeIntegrityTest, CompletesOnTheWorkerThread) {
+    mConfig.latencyMin = SHORT_LATENCY;
+    mConfig.completionMode = FakeIntegrity::FAKE_COMPLETION_ON_THREAD;
+    FakeIntegrity::SetConfig(mConfig);
+    IntegrityTokenResponse *response = nullptr;
+    ASSERT_EQ(Request(PLAIN_NONCE, &response), INTEGRITY_NO_ERROR);
+    // Completed without being polled
+    const auto deadline = std::chrono::steady_clock::now() + COMPLETION_TIMEOUT;
+    while (FakeIntegrity::GetStats().completed == 0 &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(FakeIntegrity::GetStats().completed, 1u);
+    EXPECT_EQ(WaitForCompletion(response), INTEGRITY_NO_ERROR);
+    EXPECT_NE(IntegrityTokenResponse_getToken(response), nullptr);
+    IntegrityTokenResponse_destroy(response);
+}
+
+TEST_F(FakeIntegrityTest, InjectsErrors) {
+    mConfig.requestErrorRate = 1.0f;
+    mConfig.requestError = INTEGRITY_NETWORK_ERROR;
+    FakeIntegrity::SetConfig(mConfig);
+    IntegrityTokenResponse *response = nullptr;
+    EXPECT_EQ(Request(PLAIN_NONCE, &response), INTEGRITY_NETWORK_ERROR);
+    EXPECT_EQ(response, nullptr);
+
+    mConfig.requestErrorRate = 0.0f;
+    mConfig.responseErrorRate = 1.0f;
+    mConfig.responseError = INTEGRITY_TOO_MANY_REQUESTS;
+    FakeIntegrity::SetConfig(mConfig);
+    ASSERT_EQ(Request(PLAIN_NONCE, &response), INTEGRITY_NO_ERROR);
+    EXPECT_EQ(WaitForCompletion(response), INTEGRITY_TOO_MANY_REQUESTS);
+    EXPECT_EQ(IntegrityTokenResponse_getError(response), INTEGRITY_TOO_MANY_REQUESTS);
+    EXPECT_EQ(IntegrityTokenResponse_getToken(response), nullptr);
+    IntegrityTokenResponse_destroy(response);
+
+    const FakeIntegrity::Stats stats = FakeIntegrity::GetStats();
+    EXPECT_EQ(stats.requested, 2u);
+    EXPECT_EQ(stats.rejected, 1u);
+    EXPECT_EQ(stats.failed, 1u);
+    EXPECT_EQ(stats.completed, 0u);
+}
+
+TEST_F(FakeIntegrityTest, CountsAbandonedResponses) {
+    mConfig.latencyMin = 60.0f;
+    FakeIntegrity::SetConfig(mConfig);
+    IntegrityTokenResponse *response = nullptr;
+    ASSERT_EQ(Request(PLAIN_NONCE, &response), INTEGRITY_NO_ERROR);
+    IntegrityTokenResponse_destroy(response);
+    EXPECT_EQ(FakeIntegrity::GetStats().abandoned, 1u);
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times JsonTape parsing a command response, and the JsonLookup queries
+// ClientManager makes of it, against JsonCpp when it's built in.
+//
+//   json_benchmark [integrity token length]
+
+#include "json_tape.hpp"
+#include "json_util.hpp"
+
+#if JSON_BENCHMARK_JSONCPP
+#include "json/json.h"
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+    // Parse about this many bytes of JSON per measurement
+    constexpr size_t BYTES_PER_RUN = 64 * 1024 * 1024;
+    constexpr int RUNS = 5;
+    // Express tokens the server sends back with a response
+    constexpr int EXPRESS_TOKEN_COUNT = 4;
+
+    // Keeps the compiler from dropping results nobody reads
+    volatile size_t gSink;
+
+    // Best of several runs, in nanoseconds per call
+    template<typename Parse>
+    double TimeCalls(size_t callCount, Parse parse) {
+        double best = 0.0;
+        for (int run = 0; run < RUNS; ++run) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t call = 0; call < callCount; ++call) {
+                parse();
+            }
+            const std::chrono::duration<double, std::nano> elapsed =
+                    std::chrono::steady_clock::now() - start;
+            const double perCall = elapsed.count() / callCount;
+            if (run == 0 || perCall < best) {
+                best = perCall;
+            }
+        }
+        return best;
+    }
+
+    // A command response like the server sends, with a diagnostic message
+    // echoing a token of the given length
+    std::string MakeCommandResponse(size_t tokenLength) {
+        std::string token(tokenLength, 'x');
+        for (size_t i = 0; i < tokenLength; ++i) {
+            token[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"[i % 64];
+        }
+        std::string json = "{\"commandSuccess\":true,\"diagnosticMessage\":\"Token: \\\"" + token +
+                           "\\\"\\n\",\"expressToken\":\"" + token.substr(0, 64) +
+                           "\",\"nextRandom\":\"" + token.substr(0, 32) +
+                           "\",\"additionalExpressTokens\":[";
+        for (int i = 0; i < EXPRESS_TOKEN_COUNT; ++i) {
+            json += (i > 0 ? ",\"" : "\"") + token.substr(i, 64) + "\"";
+        }
+        return json + "]}";
+    }
+}
+
+int main(int argc, char **argv) {
+    // Play Integrity tokens run to a few kilobytes
+    const size_t tokenLength = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2048;
+    const std::string json = MakeCommandResponse(tokenLength);
+    const size_t callCount = BYTES_PER_RUN / json.size() + 1;
+
+    printf("%zu byte response\n", json.size());
+    JsonTape tape;
+    const double tapeTime = TimeCalls(callCount, [&]() {
+        gSink = tape.Parse(json) ? tape.GetCount(JsonTape::ROOT_INDEX) : 0;
+    });
+    printf("%-24s %10.1f ns  %8.1f MB/s\n", "JsonTape parse", tapeTime,
+           json.size() * 1000.0 / tapeTime);
+    const double lookupTime = TimeCalls(callCount, [&]() {
+        JsonLookup lookup;
+        lookup.ParseJson(json);
+        auto success = lookup.GetBoolValueForKey("commandSuccess");
+        auto message = lookup.GetStringValueForKey("diagnosticMessage");
+        auto expressTokens = lookup.GetStringArrayForKey("additionalExpressTokens");
+        gSink = success.value_or(false) + message->size() + expressTokens->size();
+    });
+    printf("%-24s %10.1f ns\n", "JsonLookup queries", lookupTime);
+
+#if JSON_BENCHMARK_JSONCPP
+    Json::Reader reader;
+    Json::Value value;
+    const double jsonCppTime = TimeCalls(callCount, [&]() {
+        gSink = reader.parse(json, value) ? value.size() : 0;
+    });
+    printf("%-24s %10.1f ns  %8.1f MB/s  %5.2fx\n", "JsonCpp parse", jsonCppTime,
+           json.size() * 1000.0 / jsonCppTime, jsonCppTime / tapeTime);
+#endif
+    return 0;
+}
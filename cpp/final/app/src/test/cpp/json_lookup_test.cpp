@@ -0,0 +1,204 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Built twice, once against each JsonLookup backend, so the same queries
+// check that JsonTape answers them the way JsonCpp does. Where the two
+// are meant to differ the expectations say so.
+
+#include "json_util.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+    // JsonCpp accepts some JSON the tape rejects
+#if JSON_LOOKUP_JSONCPP
+    constexpr bool ACCEPTS_LAX_JSON = true;
+#else
+    constexpr bool ACCEPTS_LAX_JSON = false;
+#endif
+    // A command response like the server sends
+    constexpr char COMMAND_RESPONSE[] =
+            "{\"commandSuccess\": true, \"diagnosticMessage\": \"ok\",\n"
+            " \"expressToken\": \"abc-_123\", \"nextRandom\": \"0123456789abcdef\",\n"
+            " \"additionalExpressTokens\": [\"t1\", 2, \"t3\", null],\n"
+            " \"commandResults\": [{\"commandSuccess\": true, \"requestId\": \"r1\"},\n"
+            "                      7,\n"
+            "                      {\"commandSuccess\": false, \"requestId\": \"r2\"}],\n"
+            " \"lifetime\": 300000, \"ratio\": -1.5e3, \"nothing\": null}";
+
+    // Nests count arrays inside each other, around an object with a value
+    std::string NestArrays(size_t count) {
+        return "{\"a\":" + std::string(count, '[') + "{\"b\":1}" + std::string(count, ']') + "}";
+    }
+
+    class JsonLookupTest : public ::testing::Test {
+    protected:
+        // Lookups may point into the JSON, which has to outlive them
+        bool Parse(const std::string &json) {
+            mJson = json;
+            return mLookup.ParseJson(mJson);
+        }
+
+        // Value of the string member "s" of an object holding just it
+        std::optional<std::string> ParseString(const std::string &quotedValue) {
+            if (!Parse("{\"s\":" + quotedValue + "}")) {
+                return std::nullopt;
+            }
+            return mLookup.GetStringValueForKey("s");
+        }
+
+        std::string mJson;
+        JsonLookup mLookup;
+    };
+}
+
+TEST_F(JsonLookupTest, FindsValuesOfEachType) {
+    ASSERT_TRUE(Parse(COMMAND_RESPONSE));
+    EXPECT_EQ(mLookup.GetBoolValueForKey("commandSuccess"), true);
+    EXPECT_EQ(mLookup.GetStringValueForKey("diagnosticMessage"), "ok");
+    EXPECT_EQ(mLookup.GetStringViewForKey("expressToken"), "abc-_123");
+    EXPECT_EQ(mLookup.GetStringValueForKey("nextRandom"), "0123456789abcdef");
+    EXPECT_EQ(mLookup.GetStringValueForKey("lifetime"), "300000");
+}
+
+TEST_F(JsonLookupTest, MatchesKeysIgnoringCase) {
+    ASSERT_TRUE(Parse(COMMAND_RESPONSE));
+    EXPECT_EQ(mLookup.GetBoolValueForKey("COMMANDSUCCESS"), true);
+    EXPECT_EQ(mLookup.GetStringValueForKey("ExpressToken"), "abc-_123");
+}
+
+TEST_F(JsonLookupTest, MissesKeysOfTheWrongType) {
+    ASSERT_TRUE(Parse(COMMAND_RESPONSE));
+    EXPECT_EQ(mLookup.GetStringValueForKey("missing"), std::nullopt);
+    EXPECT_EQ(mLookup.GetBoolValueForKey("diagnosticMessage"), std::nullopt);
+    EXPECT_EQ(mLookup.GetStringViewForKey("lifetime"), std::nullopt);
+    EXPECT_EQ(mLookup.GetStringValueForKey("commandResults"), std::nullopt);
+    EXPECT_EQ(mLookup.GetStringArrayForKey("expressToken"), std::nullopt);
+    EXPECT_EQ(mLookup.GetObjectArrayForKey("diagnosticMessage"), std::nullopt);
+}
+
+TEST_F(JsonLookupTest, SkipsArrayValuesOfOtherTypes) {
+    ASSERT_TRUE(Parse(COMMAND_RESPONSE));
+    EXPECT_EQ(mLookup.GetStringArrayForKey("additionalExpressTokens"),
+              std::vector<std::string>({"t1", "t3"}));
+    auto results = mLookup.GetObjectArrayForKey("commandResults");
+    ASSERT_TRUE(results);
+    ASSERT_EQ(results->size(), 2u);
+    EXPECT_EQ((*results)[0].GetBoolValueForKey("commandSuccess"), true);
+    EXPECT_EQ((*results)[0].GetStringValueForKey("requestId"), "r1");
+    EXPECT_EQ((*results)[1].GetBoolValueForKey("commandSuccess"), false);
+    EXPECT_EQ((*results)[1].GetStringValueForKey("requestId"), "r2");
+}
+
+TEST_F(JsonLookupTest, LookupsOutliveTheirParent) {
+    const std::string json = COMMAND_RESPONSE;
+    std::optional<std::vector<JsonLookup>> results;
+    {
+        JsonLookup lookup;
+        ASSERT_TRUE(lookup.ParseJson(json));
+        results = lookup.GetObjectArrayForKey("commandResults");
+    }
+    ASSERT_TRUE(results);
+    ASSERT_EQ(results->size(), 2u);
+    EXPECT_EQ((*results)[1].GetStringValueForKey("requestId"), "r2");
+}
+
+TEST_F(JsonLookupTest, UnescapesShortEscapes) {
+    EXPECT_EQ(ParseString("\"a\\\"b\\\\c\\/d\""), "a\"b\\c/d");
+    EXPECT_EQ(ParseString("\"\\b\\f\\n\\r\\t\""), "\b\f\n\r\t");
+    EXPECT_EQ(ParseString("\"\""), "");
+}
+
+TEST_F(JsonLookupTest, UnescapesUnicodeEscapesToUtf8) {
+    EXPECT_EQ(ParseString("\"\\u0041\\u00e9\\u20AC\""), "A\xc3\xa9\xe2\x82\xac");
+    EXPECT_EQ(ParseString("\"x\\u0000y\""), std::string("x\0y", 3));
+    // UTF-8 in the JSON is copied as it is
+    EXPECT_EQ(ParseString("\"\xc3\xa9\""), "\xc3\xa9");
+}
+
+TEST_F(JsonLookupTest, JoinsSurrogatePairs) {
+    EXPECT_EQ(ParseString("\"\\ud83d\\ude00\""), "\xf0\x9f\x98\x80");
+    EXPECT_EQ(ParseString("\"\\uD800\\uDC00\""), "\xf0\x90\x80\x80");
+    EXPECT_EQ(ParseString("\"\\udbff\\udfff\""), "\xf4\x8f\xbf\xbf");
+}
+
+TEST_F(JsonLookupTest, RejectsHighSurrogatesWithoutALowOne) {
+    EXPECT_FALSE(ParseString("\"\\ud83d\""));
+    EXPECT_FALSE(ParseString("\"\\ud83dx\""));
+}
+
+TEST_F(JsonLookupTest, RejectsBadEscapes) {
+    EXPECT_FALSE(ParseString("\"\\x\""));
+    EXPECT_FALSE(ParseString("\"\\u12\""));
+    EXPECT_FALSE(ParseString("\"\\u12g4\""));
+}
+
+TEST_F(JsonLookupTest, RejectsTruncatedJson) {
+    const std::string json = COMMAND_RESPONSE;
+    // Every prefix of the response that cuts into it is incomplete
+    for (size_t length = 0; length < json.size(); ++length) {
+        EXPECT_FALSE(Parse(json.substr(0, length))) << "length " << length;
+    }
+    EXPECT_TRUE(Parse(json));
+}
+
+TEST_F(JsonLookupTest, RejectsMalformedJson) {
+    EXPECT_FALSE(Parse("{\"a\" 1}"));
+    EXPECT_FALSE(Parse("{\"a\":1,,\"b\":2}"));
+    EXPECT_FALSE(Parse("{\"a\":[1 2]}"));
+    EXPECT_FALSE(Parse("{\"a\":tru}"));
+    EXPECT_FALSE(Parse("{\"a\":\"b}"));
+    EXPECT_FALSE(Parse("{\"a\":1]"));
+    EXPECT_FALSE(Parse("{\"a\":1e}"));
+    EXPECT_FALSE(Parse(""));
+    EXPECT_FALSE(mLookup.GetStringValueForKey("a"));
+}
+
+TEST_F(JsonLookupTest, AcceptsNestingToTheTapeDepthLimit) {
+    // The root object is one level, so this is JsonTape::MAX_DEPTH in all
+    ASSERT_TRUE(Parse(NestArrays(62)));
+    EXPECT_TRUE(mLookup.GetStringArrayForKey("a"));
+}
+
+#if JSON_LOOKUP_JSONCPP
+TEST_F(JsonLookupTest, JsonCppAcceptsNestingPastTheTapeDepthLimit) {
+    EXPECT_TRUE(Parse(NestArrays(63)));
+}
+#else
+TEST_F(JsonLookupTest, JsonTapeRejectsNestingPastItsDepthLimit) {
+    EXPECT_FALSE(Parse(NestArrays(63)));
+    EXPECT_FALSE(Parse(NestArrays(100000)));
+}
+#endif
+
+TEST_F(JsonLookupTest, OnlyJsonCppAcceptsLaxJson) {
+    // JSON JsonCpp lets through and the tape doesn't
+    const char *laxJson[] = {
+            "{\"a\":1} x",
+            "{\"a\":-}",
+            "{\"a\":1.}",
+            "{\"a\":\"b\nc\"}",
+            "{\"a\":\"\\ud83d\\u0041\"}",
+            "{\"a\":\"\\udc00\"}",
+    };
+    for (const char *json : laxJson) {
+        EXPECT_EQ(Parse(json), ACCEPTS_LAX_JSON) << json;
+    }
+    // Whitespace around the value is fine for both
+    EXPECT_TRUE(Parse(" {\"a\":1}\n"));
+}
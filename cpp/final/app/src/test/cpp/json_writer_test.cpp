@@ -0,0 +1,160 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "json_writer.hpp"
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <string>
+
+namespace {
+    // Writes a document with objects and arrays nested in each other, every
+    // kind of value, and strings that need escaping
+    void WriteSampleDocument(JsonWriter &writer) {
+        writer.BeginObject();
+        writer.Key("command");
+        writer.String("move \"north\"\n");
+        writer.Key("counts");
+        writer.BeginArray();
+        writer.Uint(1);
+        writer.Int(-2);
+        writer.BeginObject();
+        writer.EndObject();
+        writer.BeginArray();
+        writer.Bool(true);
+        writer.Bool(false);
+        writer.EndArray();
+        writer.EndArray();
+        writer.Key("nested");
+        writer.BeginObject();
+        writer.Key("a");
+        writer.BeginArray();
+        writer.EndArray();
+        writer.Key("b");
+        writer.String("");
+        writer.EndObject();
+        writer.EndObject();
+    }
+
+    std::string WriteString(std::string_view value) {
+        std::string json;
+        JsonWriter writer(&json);
+        writer.String(value);
+        return json;
+    }
+}
+
+TEST(JsonWriterTest, WritesShortEscapes) {
+    EXPECT_EQ(WriteString("\" \\ \b \f \n \r \t"), "\"\\\" \\\\ \\b \\f \\n \\r \\t\"");
+}
+
+TEST(JsonWriterTest, WritesOtherControlCharactersAsUnicodeEscapes) {
+    EXPECT_EQ(WriteString(std::string("a\0b", 3)), "\"a\\u0000b\"");
+    EXPECT_EQ(WriteString("\x01\x1f"), "\"\\u0001\\u001f\"");
+    // Only control characters are escaped, DEL and UTF-8 are copied as they are
+    EXPECT_EQ(WriteString("\x7f\xc3\xa9/"), "\"\x7f\xc3\xa9/\"");
+}
+
+TEST(JsonWriterTest, EscapesKeys) {
+    std::string json;
+    JsonWriter writer(&json);
+    writer.BeginObject();
+    writer.Key("a\"b");
+    writer.Uint(0);
+    writer.EndObject();
+    EXPECT_EQ(json, "{\"a\\\"b\":0}");
+}
+
+TEST(JsonWriterTest, WritesIntegerLimits) {
+    std::string json;
+    JsonWriter writer(&json);
+    writer.BeginArray();
+    writer.Int(INT64_MIN);
+    writer.Int(INT64_MAX);
+    writer.Int(0);
+    writer.Uint(UINT64_MAX);
+    writer.EndArray();
+    EXPECT_EQ(json, "[-9223372036854775808,9223372036854775807,0,18446744073709551615]");
+}
+
+TEST(JsonWriterTest, PlacesCommasBetweenValuesAtEachLevel) {
+    std::string json;
+    JsonWriter writer(&json);
+    WriteSampleDocument(writer);
+    EXPECT_TRUE(writer.IsValid());
+    EXPECT_EQ(json, "{\"command\":\"move \\\"north\\\"\\n\",\"counts\":[1,-2,{},[true,false]],"
+                    "\"nested\":{\"a\":[],\"b\":\"\"}}");
+}
+
+TEST(JsonWriterTest, CountingMatchesWriting) {
+    JsonWriter counter(nullptr);
+    WriteSampleDocument(counter);
+    std::string json;
+    JsonWriter writer(&json);
+    WriteSampleDocument(writer);
+    EXPECT_EQ(counter.GetSize(), json.size());
+    EXPECT_EQ(writer.GetSize(), json.size());
+}
+
+TEST(JsonWriterTest, AppendsToTheBuffer) {
+    std::string json = "prefix ";
+    JsonWriter writer(&json);
+    writer.Bool(true);
+    EXPECT_EQ(json, "prefix true");
+    EXPECT_EQ(writer.GetSize(), 4u);
+}
+
+TEST(JsonWriterTest, AcceptsNestingUpToMaxDepth) {
+    std::string json;
+    JsonWriter writer(&json);
+    for (uint32_t depth = 0; depth < JsonWriter::MAX_DEPTH; ++depth) {
+        writer.BeginArray();
+        writer.Uint(depth);
+    }
+    for (uint32_t depth = 0; depth < JsonWriter::MAX_DEPTH; ++depth) {
+        writer.EndArray();
+    }
+    EXPECT_TRUE(writer.IsValid());
+    EXPECT_EQ(json.substr(0, 7), "[0,[1,[");
+    EXPECT_EQ(json.back(), ']');
+}
+
+TEST(JsonWriterTest, RejectsNestingDeeperThanMaxDepth) {
+    std::string json;
+    JsonWriter writer(&json);
+    for (uint32_t depth = 0; depth < JsonWriter::MAX_DEPTH; ++depth) {
+        writer.BeginObject();
+        writer.Key("a");
+    }
+    const size_t validSize = json.size();
+    writer.BeginObject();
+    EXPECT_FALSE(writer.IsValid());
+    // Nothing more is written once the writer has failed
+    writer.String("ignored");
+    writer.EndObject();
+    EXPECT_EQ(json.size(), validSize);
+    EXPECT_EQ(writer.GetSize(), validSize);
+}
+
+TEST(JsonWriterTest, RejectsEndingWhatWasNotBegun) {
+    std::string json;
+    JsonWriter writer(&json);
+    writer.BeginArray();
+    writer.EndArray();
+    writer.EndArray();
+    EXPECT_FALSE(writer.IsValid());
+    EXPECT_EQ(json, "[]");
+}
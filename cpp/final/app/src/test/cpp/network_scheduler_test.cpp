@@ -0,0 +1,116 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "network_scheduler.hpp"
+
+#include <gtest/gtest.h>
+
+namespace {
+    constexpr float WAKE_INTERVAL = 30.0f;
+    constexpr float RADIO_TAIL_TIME = 5.0f;
+
+    class NetworkSchedulerTest : public ::testing::Test {
+    protected:
+        NetworkSchedulerTest()
+                : mTime(0.0f),
+                  mScheduler({WAKE_INTERVAL, RADIO_TAIL_TIME}, [this]() { return mTime; }) {}
+
+        float mTime;
+        NetworkScheduler mScheduler;
+    };
+}
+
+TEST_F(NetworkSchedulerTest, SendsBeforeAnyActivity) {
+    EXPECT_TRUE(mScheduler.CanSendDeferrable());
+    mScheduler.RecordDeferrableSend();
+    mScheduler.RecordActivity();
+    EXPECT_EQ(mScheduler.GetStats().windowsOpened, 1u);
+    EXPECT_EQ(mScheduler.GetStats().wakeups, 1u);
+}
+
+TEST_F(NetworkSchedulerTest, PiggybacksWithinRadioTail) {
+    mScheduler.RecordActivity();
+    mTime = RADIO_TAIL_TIME - 0.5f;
+    EXPECT_TRUE(mScheduler.IsRadioAwake());
+    EXPECT_TRUE(mScheduler.CanSendDeferrable());
+    mScheduler.RecordDeferrableSend();
+    mScheduler.RecordActivity();
+
+    const NetworkScheduler::Stats &stats = mScheduler.GetStats();
+    EXPECT_EQ(stats.piggybacked, 1u);
+    EXPECT_EQ(stats.windowsOpened, 0u);
+    EXPECT_EQ(stats.requests, 2u);
+    // The second request found the radio awake
+    EXPECT_EQ(stats.wakeups, 1u);
+}
+
+TEST_F(NetworkSchedulerTest, DefersAfterRadioTail) {
+    mScheduler.RecordActivity();
+    mTime = RADIO_TAIL_TIME + 1.0f;
+    EXPECT_FALSE(mScheduler.IsRadioAwake());
+    EXPECT_FALSE(mScheduler.CanSendDeferrable());
+    mTime = WAKE_INTERVAL - 0.5f;
+    EXPECT_FALSE(mScheduler.CanSendDeferrable());
+}
+
+TEST_F(NetworkSchedulerTest, OpensWindowAfterWakeInterval) {
+    mScheduler.RecordActivity();
+    mTime = WAKE_INTERVAL;
+    EXPECT_TRUE(mScheduler.CanSendDeferrable());
+    mScheduler.RecordDeferrableSend();
+    mScheduler.RecordActivity();
+    EXPECT_EQ(mScheduler.GetStats().windowsOpened, 1u);
+    EXPECT_EQ(mScheduler.GetStats().wakeups, 2u);
+
+    // The request keeps the window open for the rest of the deferred work
+    mTime += 1.0f;
+    EXPECT_TRUE(mScheduler.CanSendDeferrable());
+    mScheduler.RecordDeferrableSend();
+    EXPECT_EQ(mScheduler.GetStats().piggybacked, 1u);
+}
+
+TEST_F(NetworkSchedulerTest, CheckingDoesNotCount) {
+    mScheduler.RecordActivity();
+    for (int frame = 0; frame < 100; ++frame) {
+        mTime = frame * 0.5f;
+        mScheduler.CanSendDeferrable();
+    }
+    const NetworkScheduler::Stats &stats = mScheduler.GetStats();
+    EXPECT_EQ(stats.piggybacked, 0u);
+    EXPECT_EQ(stats.windowsOpened, 0u);
+    EXPECT_EQ(stats.deferred, 0u);
+}
+
+TEST_F(NetworkSchedulerTest, CountsDeferralOncePerRequest) {
+    mScheduler.RecordActivity();
+    mTime = RADIO_TAIL_TIME + 1.0f;
+    mScheduler.RecordDeferred();
+    mScheduler.RecordDeferred();
+    EXPECT_EQ(mScheduler.GetStats().deferred, 1u);
+
+    mTime = WAKE_INTERVAL;
+    mScheduler.RecordActivity();
+    mTime += RADIO_TAIL_TIME + 1.0f;
+    mScheduler.RecordDeferred();
+    EXPECT_EQ(mScheduler.GetStats().deferred, 2u);
+}
+
+TEST_F(NetworkSchedulerTest, NoWakeIntervalNeverDefers) {
+    mScheduler.SetConfig({0.0f, RADIO_TAIL_TIME});
+    mScheduler.RecordActivity();
+    mTime = RADIO_TAIL_TIME + 1.0f;
+    EXPECT_TRUE(mScheduler.CanSendDeferrable());
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sha256_batch.hpp"
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <openssl/sha.h>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    struct KnownAnswer {
+        std::string message;
+        const char *digestHex;
+    };
+
+    // FIPS 180-2 examples, and messages either side of the padding boundaries
+    const KnownAnswer KNOWN_ANSWERS[] = {
+            {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+            {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+            {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+             "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+            {std::string(55, 'a'),
+             "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318"},
+            {std::string(56, 'a'),
+             "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a"},
+            {std::string(64, 'a'),
+             "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb"},
+            {std::string(1000000, 'a'),
+             "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+    };
+
+    std::string ToHex(const Sha256Digest &digest) {
+        static const char HEX_DIGITS[] = "0123456789abcdef";
+        std::string hex;
+        for (uint8_t byte : digest) {
+            hex += HEX_DIGITS[byte >> 4];
+            hex += HEX_DIGITS[byte & 0x0F];
+        }
+        return hex;
+    }
+
+    Sha256Digest ReferenceHash(std::string_view message) {
+        Sha256Digest digest;
+        SHA256(reinterpret_cast<const unsigned char *>(message.data()), message.size(),
+               digest.data());
+        return digest;
+    }
+
+    std::vector<Sha256Batch::Implementation> FindSupportedImplementations() {
+        std::vector<Sha256Batch::Implementation> implementations;
+        for (int i = 0; i < Sha256Batch::SHA256_IMPLEMENTATION_COUNT; ++i) {
+            const auto implementation = static_cast<Sha256Batch::Implementation>(i);
+            if (Sha256Batch::IsSupported(implementation)) {
+                implementations.push_back(implementation);
+            } else {
+                std::cout << "Skipping unsupported "
+                          << Sha256Batch::GetImplementationName(implementation) << std::endl;
+            }
+        }
+        return implementations;
+    }
+
+    // Found once so each skipped implementation is only reported once
+    const std::vector<Sha256Batch::Implementation> &GetSupportedImplementations() {
+        static const std::vector<Sha256Batch::Implementation> implementations =
+                FindSupportedImplementations();
+        return implementations;
+    }
+}
+
+TEST(Sha256BatchTest, ScalarIsAlwaysSupported) {
+    EXPECT_TRUE(Sha256Batch::IsSupported(Sha256Batch::SHA256_IMPLEMENTATION_SCALAR));
+    EXPECT_TRUE(Sha256Batch::IsSupported(Sha256Batch::GetImplementation()));
+}
+
+TEST(Sha256BatchTest, KnownAnswers) {
+    std::vector<std::string_view> messages;
+    for (const KnownAnswer &answer : KNOWN_ANSWERS) {
+        messages.push_back(answer.message);
+    }
+    for (Sha256Batch::Implementation implementation : GetSupportedImplementations()) {
+        SCOPED_TRACE(Sha256Batch::GetImplementationName(implementation));
+        std::vector<Sha256Digest> digests(messages.size());
+        Sha256Batch::Hash(implementation, messages.data(), messages.size(), digests.data());
+        for (size_t i = 0; i < messages.size(); ++i) {
+            EXPECT_EQ(ToHex(digests[i]), KNOWN_ANSWERS[i].digestHex)
+                    << "message length " << messages[i].size();
+        }
+    }
+}
+
+TEST(Sha256BatchTest, MatchesOpenSslForMixedBatches) {
+    std::mt19937 random(44);
+    for (Sha256Batch::Implementation implementation : GetSupportedImplementations()) {
+        SCOPED_TRACE(Sha256Batch::GetImplementationName(implementation));
+        // Batch sizes around the lane counts, with messages of different
+        // lengths so lanes finish at different blocks
+        for (size_t count = 1; count <= 17; ++count) {
+            std::vector<std::string> strings(count);
+            for (std::string &message : strings) {
+                message.resize(random() % 300);
+                for (char &c : message) {
+                    c = static_cast<char>(random());
+                }
+            }
+            std::vector<std::string_view> messages(strings.begin(), strings.end());
+            std::vector<Sha256Digest> digests(count);
+            Sha256Batch::Hash(implementation, messages.data(), count, digests.data());
+            for (size_t i = 0; i < count; ++i) {
+                EXPECT_EQ(digests[i], ReferenceHash(messages[i]))
+                        << "batch of " << count << ", message length " << messages[i].size();
+            }
+        }
+    }
+}
+
+TEST(Sha256BatchTest, EveryLength) {
+    std::string message;
+    for (size_t length = 0; length <= 260; ++length) {
+        message.push_back(static_cast<char>('a' + length % 26));
+        const std::string_view view(message.data(), length);
+        const Sha256Digest expected = ReferenceHash(view);
+        for (Sha256Batch::Implementation implementation : GetSupportedImplementations()) {
+            Sha256Digest digest;
+            Sha256Batch::Hash(implementation, &view, 1, &digest);
+            EXPECT_EQ(digest, expected) << Sha256Batch::GetImplementationName(implementation)
+                                        << ", length " << length;
+        }
+    }
+}
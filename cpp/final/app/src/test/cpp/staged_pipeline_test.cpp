@@ -0,0 +1,128 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "staged_pipeline.hpp"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+    struct TestItem {
+        int mId;
+        // Pumps the item waits at each stage before it is done
+        int mWaitPumps;
+        PipelineTiming mTiming;
+    };
+
+    typedef StagedPipeline<TestItem> TestPipeline;
+
+    class StagedPipelineTest : public ::testing::Test {
+    protected:
+        StagedPipelineTest() : mTime(0.0f), mPipeline([this]() { return mTime; }) {
+            mPipeline.SetCompletionHandler([this](std::unique_ptr<TestItem> item) {
+                mCompleted.push_back(item->mId);
+            });
+        }
+
+        // Handler that counts its calls, and finishes an item once it has
+        // waited out its pumps
+        TestPipeline::StageHandler CountingHandler(int *calls) {
+            return [calls](TestItem &item, float /*currentTime*/) {
+                ++*calls;
+                if (item.mWaitPumps > 0) {
+                    --item.mWaitPumps;
+                    return TestPipeline::STAGE_STATUS_WAITING;
+                }
+                return TestPipeline::STAGE_STATUS_DONE;
+            };
+        }
+
+        void Submit(int id, int waitPumps = 0) {
+            mPipeline.Submit(std::unique_ptr<TestItem>(new TestItem{id, waitPumps, {}}));
+        }
+
+        float mTime;
+        TestPipeline mPipeline;
+        std::vector<int> mCompleted;
+    };
+}
+
+TEST_F(StagedPipelineTest, StageWithLimitOfOneHandlesOneItemPerPump) {
+    int calls = 0;
+    mPipeline.AddStage("send", 1, CountingHandler(&calls));
+    for (int id = 0; id < 3; ++id) {
+        Submit(id);
+    }
+    mPipeline.Pump();
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(mCompleted, std::vector<int>({0}));
+    mPipeline.Pump();
+    mPipeline.Pump();
+    EXPECT_EQ(calls, 3);
+    EXPECT_EQ(mCompleted, std::vector<int>({0, 1, 2}));
+}
+
+TEST_F(StagedPipelineTest, WaitingItemsCountAgainstTheLimit) {
+    int calls = 0;
+    mPipeline.AddStage("token", 2, CountingHandler(&calls));
+    Submit(0, 1);
+    Submit(1);
+    Submit(2);
+    mPipeline.Pump();
+    // Item 0 waits and item 1 finishes, item 2 isn't looked at
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(mCompleted, std::vector<int>({1}));
+    EXPECT_EQ(mPipeline.GetStageDepth(0), 2u);
+    mPipeline.Pump();
+    EXPECT_EQ(mCompleted, std::vector<int>({1, 0, 2}));
+}
+
+TEST_F(StagedPipelineTest, ItemsMoveOnWithinAPump) {
+    int firstCalls = 0;
+    int secondCalls = 0;
+    mPipeline.AddStage("random", 1, CountingHandler(&firstCalls));
+    mPipeline.AddStage("parse", SIZE_MAX, CountingHandler(&secondCalls));
+    Submit(0);
+    Submit(1);
+    mPipeline.Pump();
+    EXPECT_EQ(mCompleted, std::vector<int>({0}));
+    EXPECT_EQ(mPipeline.GetInFlightCount(), 1u);
+    mPipeline.Pump();
+    EXPECT_EQ(mCompleted, std::vector<int>({0, 1}));
+    EXPECT_EQ(mPipeline.GetStageStats(0).completed, 2u);
+    EXPECT_EQ(mPipeline.GetStageStats(1).completed, 2u);
+}
+
+TEST_F(StagedPipelineTest, FailedItemsSkipTheRemainingStages) {
+    int secondCalls = 0;
+    mPipeline.AddStage("token", 1, [](TestItem &, float) {
+        return TestPipeline::STAGE_STATUS_FAILED;
+    });
+    mPipeline.AddStage("send", 1, CountingHandler(&secondCalls));
+    Submit(0);
+    mPipeline.Pump();
+    EXPECT_EQ(mCompleted, std::vector<int>({0}));
+    EXPECT_EQ(secondCalls, 0);
+    EXPECT_EQ(mPipeline.GetStageStats(0).failed, 1u);
+}
+
+TEST_F(StagedPipelineTest, RejectsTooManyStages) {
+    int calls = 0;
+    for (size_t i = 0; i < MAX_PIPELINE_STAGES; ++i) {
+        mPipeline.AddStage("stage", 1, CountingHandler(&calls));
+    }
+    EXPECT_DEATH(mPipeline.AddStage("extra", 1, CountingHandler(&calls)), "");
+}
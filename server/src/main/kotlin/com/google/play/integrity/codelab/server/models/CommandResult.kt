@@ -20,4 +20,5 @@ import kotlinx.serialization.Serializable
 
 @Serializable
 data class CommandResult(val commandSuccess: Boolean, val diagnosticMessage: String,
-                         val expressToken: String)
\ No newline at end of file
+                         val expressToken: String, val nextRandom: String = "",
+                         val additionalExpressTokens: List<String> = listOf())
\ No newline at end of file
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.google.play.integrity.codelab.server.models
+
+import kotlinx.serialization.Serializable
+
+// One day timeout (in milliseconds), clients replay commands whose response
+// they lost well within it
+const val COMPLETED_COMMAND_TIMEOUT = 1000 * 60 * 60 * 24
+
+val completedCommandStorage = mutableListOf<CompletedCommand>()
+
+// Result of the command the client sent with requestId, if it has been performed
+fun lookupCompletedCommand(requestId: String): CommandResult? {
+    if (requestId.isEmpty()) {
+        return null
+    }
+    val currentTimestamp = System.currentTimeMillis()
+    completedCommandStorage.removeAll {
+        currentTimestamp - it.timestamp >= COMPLETED_COMMAND_TIMEOUT
+    }
+    return completedCommandStorage.find { it.requestId == requestId }?.result
+}
+
+// Remembers a performed command, so it isn't performed again when the client
+// replays it. Commands that failed weren't performed and can be tried again.
+fun recordCompletedCommand(requestId: String, result: CommandResult) {
+    if (requestId.isEmpty() || !result.commandSuccess) {
+        return
+    }
+    completedCommandStorage.add(CompletedCommand(requestId, result, System.currentTimeMillis()))
+}
+
+@Serializable
+data class CompletedCommand(val requestId: String, val result: CommandResult,
+                            val timestamp: Long)
\ No newline at end of file
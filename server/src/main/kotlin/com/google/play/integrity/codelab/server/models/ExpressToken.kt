@@ -26,6 +26,9 @@ const val EXPRESS_TOKEN_TIMEOUT = 1000 * 60 * 60 * 8
 // Char length of express token
 const val EXPRESS_TOKEN_LENGTH = 32
 
+// Maximum number of express tokens issued in response to a single integrity check
+const val EXPRESS_TOKEN_MAX_COUNT = 4
+
 val expressTokenStorage = mutableListOf<ExpressToken>()
 
 fun generateExpressToken(): ExpressToken {
@@ -16,16 +16,25 @@
 
 package com.google.play.integrity.codelab.server.models
 
+import com.google.play.integrity.codelab.server.util.NONCE_TIMEOUT
 import com.google.play.integrity.codelab.server.util.generateRandom
 import kotlinx.serialization.Serializable
 import java.util.logging.Logger
 
+// Randoms are kept for twice the nonce timeout (in milliseconds), so a client
+// using one late is told it expired rather than that it was never issued
+const val RANDOM_STORAGE_TIMEOUT = NONCE_TIMEOUT * 2
+
 val randomStorage = mutableListOf<IntegrityRandom>()
 
 fun generateIntegrityRandom(): IntegrityRandom {
+    val currentTimestamp = System.currentTimeMillis()
+    // Randoms clients never used would otherwise pile up, drop the ones that
+    // expired a while ago
+    randomStorage.removeAll { currentTimestamp - it.timestamp >= RANDOM_STORAGE_TIMEOUT }
     val integrityRandom = IntegrityRandom(
         generateRandom(),
-        System.currentTimeMillis()
+        currentTimestamp
     )
 	val log = Logger.getLogger("generateIntegrityRandom")
 	log.info("Generated random for nonce: " + integrityRandom.random)
@@ -34,4 +43,10 @@ fun generateIntegrityRandom(): IntegrityRandom {
 }
 
 @Serializable
-data class IntegrityRandom(val random: String, val timestamp: Long)
\ No newline at end of file
+data class IntegrityRandom(val random: String, val timestamp: Long)
+
+// Response to /getRandom. Clients that list the nonce formats they can generate
+// are told which of them we accept, the list is left out for everyone else.
+@Serializable
+data class RandomResult(val random: String, val timestamp: Long,
+                        val nonceFormats: List<String> = listOf())
\ No newline at end of file
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.google.play.integrity.codelab.server.models
+
+import com.google.play.integrity.codelab.server.util.RANDOM_BYTE_COUNT
+import com.google.play.integrity.codelab.server.util.generateRandom
+import com.google.play.integrity.codelab.server.util.toHexString
+import kotlinx.serialization.Serializable
+import java.security.SecureRandom
+import java.util.logging.Logger
+import javax.crypto.Mac
+import javax.crypto.spec.SecretKeySpec
+
+// One hour timeout (in milliseconds)
+const val NONCE_SESSION_TIMEOUT = 1000 * 60 * 60
+
+// Byte length of a nonce session secret
+const val NONCE_SESSION_SECRET_BYTE_COUNT = 32
+
+// Counters this far below the highest one seen in a session can still be used
+// once, commands can overtake each other on their way to the server
+const val NONCE_SESSION_REPLAY_WINDOW = 64
+
+val nonceSessionStorage = mutableListOf<NonceSession>()
+
+// A nonce session lets a client make up the random part of its nonces without
+// asking us for each one. Each random is the HMAC-SHA256, keyed with the session
+// secret, of "sessionId:counter:time", cut down to RANDOM_BYTE_COUNT bytes. The
+// client sends the counter and time with the command, each counter can only be
+// used once.
+class NonceSession(val sessionId: String, private val secret: ByteArray,
+                   val timestamp: Long) {
+    private var highestCounter = 0L
+    private val usedCounters = mutableSetOf<Long>()
+
+    fun toResult(): NonceSessionResult {
+        return NonceSessionResult(sessionId, secret.toHexString(), timestamp,
+            NONCE_SESSION_TIMEOUT.toLong())
+    }
+
+    fun sessionRandom(counter: Long, time: Long): String {
+        val mac = Mac.getInstance("HmacSHA256")
+        mac.init(SecretKeySpec(secret, "HmacSHA256"))
+        val macBytes = mac.doFinal("$sessionId:$counter:$time".toByteArray(Charsets.UTF_8))
+        return macBytes.copyOfRange(0, RANDOM_BYTE_COUNT).toHexString()
+    }
+
+    // Records a counter as used, returns false if it was used before, or is too
+    // far behind the highest one seen to tell
+    fun useCounter(counter: Long): Boolean {
+        if (counter <= 0 || counter <= highestCounter - NONCE_SESSION_REPLAY_WINDOW ||
+            counter in usedCounters) {
+            return false
+        }
+        usedCounters.add(counter)
+        if (counter > highestCounter) {
+            highestCounter = counter
+            usedCounters.removeAll { it <= highestCounter - NONCE_SESSION_REPLAY_WINDOW }
+        }
+        return true
+    }
+}
+
+// The nonce session, counter and time a client made the random in its nonce from
+data class SessionNonce(val sessionId: String, val counter: Long, val time: Long)
+
+// Commands leave the session id empty when their random came from /getRandom
+fun sessionNonceOf(sessionId: String, counter: Long, time: Long): SessionNonce? {
+    return if (sessionId.isEmpty()) null else SessionNonce(sessionId, counter, time)
+}
+
+fun generateNonceSession(): NonceSession {
+    val secret = ByteArray(NONCE_SESSION_SECRET_BYTE_COUNT)
+    SecureRandom().nextBytes(secret)
+    val nonceSession = NonceSession(generateRandom(), secret, System.currentTimeMillis())
+    val log = Logger.getLogger("generateNonceSession")
+    log.info("Generated nonce session: " + nonceSession.sessionId)
+    nonceSessionStorage.add(nonceSession)
+    return nonceSession
+}
+
+// Response to /startNonceSession, the lifetime is in milliseconds from the timestamp
+@Serializable
+data class NonceSessionResult(val sessionId: String, val sessionSecret: String,
+                              val timestamp: Long, val lifetime: Long)
\ No newline at end of file
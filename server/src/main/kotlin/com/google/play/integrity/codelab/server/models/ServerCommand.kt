@@ -19,4 +19,8 @@ package com.google.play.integrity.codelab.server.models
 import kotlinx.serialization.Serializable
 
 @Serializable
-data class ServerCommand(val commandString: String, val tokenString: String)
\ No newline at end of file
+data class ServerCommand(val commandString: String, val tokenString: String,
+                         val requestNextRandom: Boolean = false,
+                         val expressTokenCount: Int = 1,
+                         val sessionId: String = "", val nonceCounter: Long = 0,
+                         val nonceTime: Long = 0, val requestId: String = "")
\ No newline at end of file
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.google.play.integrity.codelab.server.models
+
+import kotlinx.serialization.Serializable
+
+// Maximum number of commands accepted in a single batch
+const val COMMAND_BATCH_MAX_SIZE = 16
+
+@Serializable
+data class ServerCommandBatch(val commandStrings: List<String>, val tokenString: String,
+                              val requestNextRandom: Boolean = false,
+                              val expressTokenCount: Int = 1,
+                              val sessionId: String = "", val nonceCounter: Long = 0,
+                              val nonceTime: Long = 0,
+                              val requestIds: List<String> = listOf())
\ No newline at end of file
@@ -23,5 +23,6 @@ enum class ValidateResult {
     VALIDATE_NONCE_NOT_FOUND,
     VALIDATE_NONCE_EXPIRED,
     VALIDATE_NONCE_MISMATCH,
+    VALIDATE_NONCE_REPLAYED,
     VALIDATE_INTEGRITY_FAIL
 }
\ No newline at end of file
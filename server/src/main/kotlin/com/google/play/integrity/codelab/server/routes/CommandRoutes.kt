@@ -34,23 +34,38 @@ fun Route.commandRouting() {
     route("/performCommand") {
         post {
             val incomingCommand = call.receive<ServerCommand>()
+            // Clients can ask for the random for their next integrity check to be
+            // returned with the result, saving them a separate /getRandom round trip
+            val nextRandom = if (incomingCommand.requestNextRandom) {
+                generateIntegrityRandom().random
+            } else {
+                ""
+            }
+            // A client replaying a command whose response it lost gets the
+            // result again instead of the command being performed twice. Its
+            // token was spent the first time, so it isn't checked.
+            val completedResult = lookupCompletedCommand(incomingCommand.requestId)
+            if (completedResult != null) {
+                call.respond(completedResult.copy(nextRandom = nextRandom))
+                return@post
+            }
             // The incoming token string will either be:
             // 1) A token generated by the Play Integrity API
             // 2) An 'express' token, which is just a 16-byte random number
             //    converted to base64.
-            if (incomingCommand.tokenString.length == EXPRESS_TOKEN_LENGTH) {
+            val commandResult = if (incomingCommand.tokenString.length == EXPRESS_TOKEN_LENGTH) {
                 // Express token, the command 'succeeds' as long as it's
                 // in our express token list and hasn't expired.
                 when (lookupExpressToken(incomingCommand.tokenString)) {
                     LookupResult.LOOKUP_FOUND -> {
-                        call.respond(CommandResult(true, "Express success",
-                            generateExpressToken().random))
+                        CommandResult(true, "Express success", generateExpressToken().random,
+                            nextRandom)
                     }
                     LookupResult.LOOKUP_EXPIRED -> {
-                        call.respond(CommandResult(false, "Express token expired", ""))
+                        CommandResult(false, "Express token expired", "", nextRandom)
                     }
                     LookupResult.LOOKUP_NOT_FOUND -> {
-                        call.respond(CommandResult(false, "Express token invalid", ""))
+                        CommandResult(false, "Express token invalid", "", nextRandom)
                     }
                 }
             } else {
@@ -60,36 +75,160 @@ fun Route.commandRouting() {
                     IntegrityVerdictPayload::class.java)
                 if (integrityVerdictPayload != null) {
                     val integrityVerdict = integrityVerdictPayload.tokenPayloadExternal
-                    when (validateCommand(incomingCommand.commandString, integrityVerdict)) {
+                    val sessionNonce = sessionNonceOf(incomingCommand.sessionId,
+                        incomingCommand.nonceCounter, incomingCommand.nonceTime)
+                    when (validateCommand(incomingCommand.commandString, integrityVerdict,
+                        sessionNonce)) {
                         ValidateResult.VALIDATE_SUCCESS -> {
-                            call.respond(CommandResult(true,
-                                summarizeVerdict(integrityVerdict), generateExpressToken().random))
+                            // A client can keep a pool of express tokens, so issue
+                            // as many as it asked for up to our limit. Express commands
+                            // only ever trade their token for a single new one.
+                            val expressTokenCount = incomingCommand.expressTokenCount
+                                .coerceIn(1, EXPRESS_TOKEN_MAX_COUNT)
+                            val additionalExpressTokens = List(expressTokenCount - 1) {
+                                generateExpressToken().random
+                            }
+                            CommandResult(true, summarizeVerdict(integrityVerdict),
+                                generateExpressToken().random, nextRandom,
+                                additionalExpressTokens)
                         }
                         ValidateResult.VALIDATE_NONCE_NOT_FOUND -> {
-                            call.respond(CommandResult(false,
-                                "Failed to find matching nonce", ""))
+                            CommandResult(false, "Failed to find matching nonce", "", nextRandom)
                         }
                         ValidateResult.VALIDATE_NONCE_EXPIRED -> {
-                            call.respond(CommandResult(false,
-                                "Token nonce expired", ""))
+                            CommandResult(false, "Token nonce expired", "", nextRandom)
                         }
                         ValidateResult.VALIDATE_NONCE_MISMATCH -> {
-                            call.respond(CommandResult(false,
-                                "Token nonce didn't match command hash", ""))
+                            CommandResult(false,
+                                "Token nonce didn't match command hash", "", nextRandom)
+                        }
+                        ValidateResult.VALIDATE_NONCE_REPLAYED -> {
+                            CommandResult(false, "Token nonce already used", "", nextRandom)
                         }
                         ValidateResult.VALIDATE_INTEGRITY_FAIL -> {
                             // Integrity signals didn't pass our 'success' criteria,
                             // pass the verdict summary string
                             // back in the diagnostic field
-                            call.respond(CommandResult(false,
-                                summarizeVerdict(integrityVerdict), ""))
+                            CommandResult(false, summarizeVerdict(integrityVerdict), "",
+                                nextRandom)
+                        }
+                    }
+                } else {
+                    CommandResult(false, "Token invalid", "", nextRandom)
+                }
+            }
+            recordCompletedCommand(incomingCommand.requestId, commandResult)
+            call.respond(commandResult)
+        }
+    }
+
+    route("/performCommandBatch") {
+        post {
+            val incomingBatch = call.receive<ServerCommandBatch>()
+            val nextRandom = if (incomingBatch.requestNextRandom) {
+                generateIntegrityRandom().random
+            } else {
+                ""
+            }
+            val commandCount = incomingBatch.commandStrings.size
+            if (commandCount == 0 || commandCount > COMMAND_BATCH_MAX_SIZE) {
+                call.respond(CommandBatchResult(List(commandCount) {
+                    CommandResult(false, "Invalid command batch size", "")
+                }, nextRandom))
+                return@post
+            }
+            // Request ids are optional, but there has to be one per command
+            val requestIds = if (incomingBatch.requestIds.size == commandCount) {
+                incomingBatch.requestIds
+            } else {
+                List(commandCount) { "" }
+            }
+            val completedResults = requestIds.map { requestId ->
+                lookupCompletedCommand(requestId)?.copy(nextRandom = "")
+            }
+            // A replayed batch whose commands have all been performed gets their
+            // results again, its token was spent the first time
+            if (completedResults.all { it != null }) {
+                call.respond(CommandBatchResult(completedResults.filterNotNull(), nextRandom))
+                return@post
+            }
+            // A batch is covered by a single token, of either kind, and the
+            // token check decides the result of every command in the batch
+            val batchResult = if (incomingBatch.tokenString.length == EXPRESS_TOKEN_LENGTH) {
+                when (lookupExpressToken(incomingBatch.tokenString)) {
+                    LookupResult.LOOKUP_FOUND -> {
+                        CommandResult(true, "Express success", generateExpressToken().random)
+                    }
+                    LookupResult.LOOKUP_EXPIRED -> {
+                        CommandResult(false, "Express token expired", "")
+                    }
+                    LookupResult.LOOKUP_NOT_FOUND -> {
+                        CommandResult(false, "Express token invalid", "")
+                    }
+                }
+            } else {
+                // Play Integrity token, its nonce hash covers the whole batch
+                val decodedTokenString = decryptToken(incomingBatch.tokenString)
+                val integrityVerdictPayload = Gson().fromJson(decodedTokenString,
+                    IntegrityVerdictPayload::class.java)
+                if (integrityVerdictPayload != null) {
+                    val integrityVerdict = integrityVerdictPayload.tokenPayloadExternal
+                    val sessionNonce = sessionNonceOf(incomingBatch.sessionId,
+                        incomingBatch.nonceCounter, incomingBatch.nonceTime)
+                    when (validateCommandBatch(incomingBatch.commandStrings, integrityVerdict,
+                        sessionNonce)) {
+                        ValidateResult.VALIDATE_SUCCESS -> {
+                            val expressTokenCount = incomingBatch.expressTokenCount
+                                .coerceIn(1, EXPRESS_TOKEN_MAX_COUNT)
+                            val additionalExpressTokens = List(expressTokenCount - 1) {
+                                generateExpressToken().random
+                            }
+                            CommandResult(true, summarizeVerdict(integrityVerdict),
+                                generateExpressToken().random, "", additionalExpressTokens)
+                        }
+                        ValidateResult.VALIDATE_NONCE_NOT_FOUND -> {
+                            CommandResult(false, "Failed to find matching nonce", "")
+                        }
+                        ValidateResult.VALIDATE_NONCE_EXPIRED -> {
+                            CommandResult(false, "Token nonce expired", "")
+                        }
+                        ValidateResult.VALIDATE_NONCE_MISMATCH -> {
+                            CommandResult(false, "Token nonce didn't match batch hash", "")
+                        }
+                        ValidateResult.VALIDATE_NONCE_REPLAYED -> {
+                            CommandResult(false, "Token nonce already used", "")
+                        }
+                        ValidateResult.VALIDATE_INTEGRITY_FAIL -> {
+                            CommandResult(false, summarizeVerdict(integrityVerdict), "")
                         }
                     }
                 } else {
-                    val invalidToken = CommandResult(false, "Token invalid", "")
-                    call.respond(invalidToken)
+                    CommandResult(false, "Token invalid", "")
                 }
             }
+            val commandBatchResult = splitBatchResult(batchResult, completedResults, nextRandom)
+            commandBatchResult.commandResults.forEachIndexed { index, commandResult ->
+                if (completedResults[index] == null) {
+                    recordCompletedCommand(requestIds[index], commandResult)
+                }
+            }
+            call.respond(commandBatchResult)
+        }
+    }
+}
+
+// Gives every command in a batch the batch's result, except the commands
+// performed before, which get their earlier result again. Express tokens earned
+// by the batch are only returned once, with the first command performed now.
+fun splitBatchResult(batchResult: CommandResult, completedResults: List<CommandResult?>,
+                     nextRandom: String): CommandBatchResult {
+    val firstPerformedIndex = completedResults.indexOfFirst { it == null }
+    val commandResults = completedResults.mapIndexed { index, completedResult ->
+        when {
+            completedResult != null -> completedResult
+            index == firstPerformedIndex -> batchResult
+            else -> batchResult.copy(expressToken = "", additionalExpressTokens = listOf())
         }
     }
+    return CommandBatchResult(commandResults, nextRandom)
 }
\ No newline at end of file
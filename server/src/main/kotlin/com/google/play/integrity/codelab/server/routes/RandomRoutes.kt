@@ -16,7 +16,10 @@
 
 package com.google.play.integrity.codelab.server.routes
 
+import com.google.play.integrity.codelab.server.models.RandomResult
 import com.google.play.integrity.codelab.server.models.generateIntegrityRandom
+import com.google.play.integrity.codelab.server.models.generateNonceSession
+import com.google.play.integrity.codelab.server.util.NONCE_FORMATS
 import io.ktor.application.*
 import io.ktor.response.*
 import io.ktor.routing.*
@@ -30,7 +33,17 @@ fun Application.registerRandomRoutes() {
 fun Route.randomRouting() {
     route("/getRandom") {
         get {
-            call.respond(generateIntegrityRandom())
+            val integrityRandom = generateIntegrityRandom()
+            val clientNonceFormats =
+                call.request.queryParameters["nonceFormats"]?.split(",") ?: listOf()
+            call.respond(RandomResult(integrityRandom.random, integrityRandom.timestamp,
+                NONCE_FORMATS.filter { it in clientNonceFormats }))
+        }
+    }
+    // Clients with a nonce session make up their own randoms, see NonceSession
+    route("/startNonceSession") {
+        get {
+            call.respond(generateNonceSession().toResult())
         }
     }
 }
\ No newline at end of file
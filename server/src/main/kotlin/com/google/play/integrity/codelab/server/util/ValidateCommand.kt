@@ -17,15 +17,32 @@
 package com.google.play.integrity.codelab.server.util
 
 import com.google.play.integrity.codelab.server.models.IntegrityVerdict
+import com.google.play.integrity.codelab.server.models.NONCE_SESSION_TIMEOUT
+import com.google.play.integrity.codelab.server.models.SessionNonce
 import com.google.play.integrity.codelab.server.models.ValidateResult
+import com.google.play.integrity.codelab.server.models.nonceSessionStorage
 import com.google.play.integrity.codelab.server.models.randomStorage
 import java.security.MessageDigest
 import java.util.*
 import java.util.logging.Logger
+import kotlin.math.abs
 
 // Five minute timeout (in milliseconds)
 const val NONCE_TIMEOUT = 1000 * 60 * 5
 
+// Nonce formats we accept, advertised to clients that ask with /getRandom. Hex nonces
+// are the random followed by the command hash, both in hex. Compact nonces are
+// the base64url of the raw random and hash bytes, and are told apart by length.
+const val NONCE_FORMAT_HEX = "hex"
+const val NONCE_FORMAT_BASE64URL = "base64url"
+val NONCE_FORMATS = listOf(NONCE_FORMAT_HEX, NONCE_FORMAT_BASE64URL)
+
+// Byte length of a SHA256 hash
+const val SHA256_BYTE_COUNT = 32
+
+// Char length of a compact nonce, the raw bytes are a multiple of 3 so there is no padding
+const val COMPACT_NONCE_LENGTH = (RANDOM_BYTE_COUNT + SHA256_BYTE_COUNT) / 3 * 4
+
 // Package name of the client application
 const val APPLICATION_PACKAGE_IDENTIFIER = "your.package.identifier"
 
@@ -40,7 +57,26 @@ const val VERDICT_VAL_LICENSED = "LICENSED"
 const val VERDICT_VAL_UNLICENSED = "UNLICENSED"
 
 fun validateCommand(commandString: String,
-                  integrityVerdict: IntegrityVerdict
+                  integrityVerdict: IntegrityVerdict,
+                  sessionNonce: SessionNonce? = null
+): ValidateResult {
+    return validateNonce(integrityVerdict, sessionNonce) { hashString ->
+        validateHash(commandString, hashString)
+    }
+}
+
+fun validateCommandBatch(commandStrings: List<String>,
+                         integrityVerdict: IntegrityVerdict,
+                         sessionNonce: SessionNonce? = null
+): ValidateResult {
+    return validateNonce(integrityVerdict, sessionNonce) { hashString ->
+        validateBatchHash(commandStrings, hashString)
+    }
+}
+
+fun validateNonce(integrityVerdict: IntegrityVerdict,
+                  sessionNonce: SessionNonce?,
+                  validateHashSegment: (String) -> Boolean
 ): ValidateResult {
     if (integrityVerdict.requestDetails.nonce != null) {
         var nonceString: String = integrityVerdict.requestDetails.nonce!!
@@ -48,48 +84,104 @@ fun validateCommand(commandString: String,
         // match our web-safe original
         val utfEqualRegex = "\\u003d$".toRegex()
         nonceString = utfEqualRegex.replace(nonceString, "")
-        val nonceBytes = Base64.getUrlDecoder().decode(nonceString)
         // The nonce string contains two parts, the random number previously generated,
         // and the SHA256 hash of the command string, we need to separate them
-        // The values were written out as hex values, so they are base64 compatible, but
-        // we don't actually base64 decode them.
-        val randomString = nonceString.slice(IntRange(0, (RANDOM_BYTE_COUNT * 2) - 1))
-        val hashString = nonceString.slice(IntRange(RANDOM_BYTE_COUNT * 2, nonceString.lastIndex))
+        val randomString: String
+        val hashString: String
+        if (nonceString.length == COMPACT_NONCE_LENGTH) {
+            // Compact nonce, the raw bytes are base64url encoded. Convert the parts
+            // back to hex to match the stored random and the hash we compute.
+            val nonceBytes = try {
+                Base64.getUrlDecoder().decode(nonceString)
+            } catch (e: IllegalArgumentException) {
+                return ValidateResult.VALIDATE_NONCE_NOT_FOUND
+            }
+            randomString = nonceBytes.copyOfRange(0, RANDOM_BYTE_COUNT).toHexString()
+            hashString = nonceBytes.copyOfRange(RANDOM_BYTE_COUNT, nonceBytes.size).toHexString()
+        } else {
+            // The values were written out as hex values, so they are base64 compatible, but
+            // we don't actually base64 decode them.
+            randomString = nonceString.slice(IntRange(0, (RANDOM_BYTE_COUNT * 2) - 1))
+            hashString = nonceString.slice(IntRange(RANDOM_BYTE_COUNT * 2, nonceString.lastIndex))
+        }
 
         val log = Logger.getLogger("validateCommand")
         log.info("Raw nonce: $nonceString")
         log.info("Random nonce segment: $randomString")
         log.info("Hash nonce segment: $hashString")
 
-        // Verify the random part of the nonce was a random number previously generated on
-        // the server, and that it hasn't expired
-        val matchingRandom = randomStorage.find { it.random == randomString }
-        if (matchingRandom != null) {
-            val currentTimestamp = System.currentTimeMillis()
-            val timeDelta = currentTimestamp - matchingRandom.timestamp
-            // Can only use once, remove from the server's random list after matching
-            randomStorage.remove(matchingRandom)
-            if (timeDelta < NONCE_TIMEOUT) {
-                return if (validateHash(commandString, hashString)) {
-                    if (validateVerdict(integrityVerdict)) {
-                        ValidateResult.VALIDATE_SUCCESS
-                    } else {
-                        ValidateResult.VALIDATE_INTEGRITY_FAIL
-                    }
-                } else {
-                    ValidateResult.VALIDATE_NONCE_MISMATCH
-                }
+        val randomResult = if (sessionNonce != null) {
+            validateSessionRandom(sessionNonce, randomString)
+        } else {
+            validateServerRandom(randomString)
+        }
+        if (randomResult != ValidateResult.VALIDATE_SUCCESS) {
+            return randomResult
+        }
+        return if (validateHashSegment(hashString)) {
+            if (validateVerdict(integrityVerdict)) {
+                ValidateResult.VALIDATE_SUCCESS
+            } else {
+                ValidateResult.VALIDATE_INTEGRITY_FAIL
             }
+        } else {
+            ValidateResult.VALIDATE_NONCE_MISMATCH
+        }
+    }
+    return ValidateResult.VALIDATE_NONCE_NOT_FOUND
+}
+
+fun validateServerRandom(randomString: String): ValidateResult {
+    // Verify the random part of the nonce was a random number previously generated on
+    // the server, and that it hasn't expired
+    val matchingRandom = randomStorage.find { it.random == randomString }
+    if (matchingRandom != null) {
+        val currentTimestamp = System.currentTimeMillis()
+        val timeDelta = currentTimestamp - matchingRandom.timestamp
+        // Can only use once, remove from the server's random list after matching
+        randomStorage.remove(matchingRandom)
+        if (timeDelta < NONCE_TIMEOUT) {
+            return ValidateResult.VALIDATE_SUCCESS
+        }
+        return ValidateResult.VALIDATE_NONCE_EXPIRED
+    }
+    return ValidateResult.VALIDATE_NONCE_NOT_FOUND
+}
+
+fun validateSessionRandom(sessionNonce: SessionNonce, randomString: String): ValidateResult {
+    // Verify the random part of the nonce was made from a nonce session we issued,
+    // that neither the session nor the random has expired, and that the random's
+    // counter hasn't been used before
+    val nonceSession = nonceSessionStorage.find { it.sessionId == sessionNonce.sessionId }
+    if (nonceSession != null) {
+        val currentTimestamp = System.currentTimeMillis()
+        if (currentTimestamp - nonceSession.timestamp >= NONCE_SESSION_TIMEOUT) {
+            nonceSessionStorage.remove(nonceSession)
             return ValidateResult.VALIDATE_NONCE_EXPIRED
         }
+        if (randomString != nonceSession.sessionRandom(sessionNonce.counter, sessionNonce.time)) {
+            return ValidateResult.VALIDATE_NONCE_NOT_FOUND
+        }
+        // The client's time comes from our clock, but allow as much time ahead as behind
+        if (abs(currentTimestamp - sessionNonce.time) >= NONCE_TIMEOUT) {
+            return ValidateResult.VALIDATE_NONCE_EXPIRED
+        }
+        if (!nonceSession.useCounter(sessionNonce.counter)) {
+            return ValidateResult.VALIDATE_NONCE_REPLAYED
+        }
+        return ValidateResult.VALIDATE_SUCCESS
     }
     return ValidateResult.VALIDATE_NONCE_NOT_FOUND
 }
 
-fun validateHash(commandString: String, hashString: String) : Boolean {
+fun hashCommand(commandString: String) : String {
     val messageDigest = MessageDigest.getInstance("SHA-256")
     val commandHashBytes = messageDigest.digest(commandString.toByteArray(Charsets.UTF_8))
-    val commandHashString = commandHashBytes.toHexString()
+    return commandHashBytes.toHexString()
+}
+
+fun validateHash(commandString: String, hashString: String) : Boolean {
+    val commandHashString = hashCommand(commandString)
     val hashMatch = hashString.contentEquals(commandHashString)
 
     val log = Logger.getLogger("validateHash")
@@ -101,6 +193,22 @@ fun validateHash(commandString: String, hashString: String) : Boolean {
     return hashMatch
 }
 
+fun validateBatchHash(commandStrings: List<String>, hashString: String) : Boolean {
+    // The batch hash is the hash of the hex hashes of every command, in order
+    val batchHashString = hashCommand(commandStrings.joinToString(separator = "") {
+        hashCommand(it)
+    })
+    val hashMatch = hashString.contentEquals(batchHashString)
+
+    val log = Logger.getLogger("validateBatchHash")
+    log.info("Batch command count: ${commandStrings.size}")
+    log.info("token hash string: $hashString")
+    log.info("batch hash string: $batchHashString")
+    log.info("hashMatch: $hashMatch")
+
+    return hashMatch
+}
+
 fun validateVerdict(integrityVerdict: IntegrityVerdict) : Boolean {
     // Process the integrity verdict and 'validate' the command if the following positive
     // signals exist: